@@ -55,6 +55,7 @@
 
 #include "cy_utils.h"
 #include "cy_syslib.h"
+#include "cy_device_headers.h"
 
 /* Get the low power configuration parameters from
  * the ModusToolbox Device Configurator GeneratedSource:
@@ -97,7 +98,15 @@
 #define configUSE_DAEMON_TASK_STARTUP_HOOK      0
 
 /* Run time and task stats gathering related definitions. */
-#define configGENERATE_RUN_TIME_STATS           0
+#define configGENERATE_RUN_TIME_STATS           1
+/* The run time counter is the DWT cycle counter (see app_cycles.h). It only counts while the core
+ * is awake, which lets the sampler tell busy time apart from idle and sleep. */
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS()                 \
+    do {                                                         \
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;          \
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;                     \
+    } while (0)
+#define portGET_RUN_TIME_COUNTER_VALUE()        (DWT->CYCCNT)
 #define configUSE_TRACE_FACILITY                1
 #define configUSE_STATS_FORMATTING_FUNCTIONS    0
 
@@ -167,8 +176,8 @@ to exclude the API function. */
 #define INCLUDE_vTaskDelay                      1
 #define INCLUDE_xTaskGetSchedulerState          1
 #define INCLUDE_xTaskGetCurrentTaskHandle       1
-#define INCLUDE_uxTaskGetStackHighWaterMark     0
-#define INCLUDE_xTaskGetIdleTaskHandle          0
+#define INCLUDE_uxTaskGetStackHighWaterMark     1
+#define INCLUDE_xTaskGetIdleTaskHandle          1
 #define INCLUDE_eTaskGetState                   0
 #define INCLUDE_xEventGroupSetBitFromISR        1
 #define INCLUDE_xTimerPendFunctionCall          1
@@ -0,0 +1,56 @@
+//! @file
+//!
+//! @brief
+//! Application overrides for mbedTLS, applied on top of the mbedtls_user_config.h shipped with
+//! the wifi-core middleware. Selected through MBEDTLS_USER_CONFIG_FILE in the Makefile.
+
+#ifndef MBEDTLS_APP_CONFIG_H
+#define MBEDTLS_APP_CONFIG_H
+
+#include "mbedtls_user_config.h"
+
+// Let the application install its own calloc/free so TLS allocations are served by the pool
+// allocator in source/app_pool.c instead of the general purpose heap
+#ifndef MBEDTLS_PLATFORM_MEMORY
+  #define MBEDTLS_PLATFORM_MEMORY
+#endif
+
+// Let the client ask for smaller records, see APP_UPLOAD_TLS_MFL in source/app_upload.h
+#ifndef MBEDTLS_SSL_MAX_FRAGMENT_LENGTH
+  #define MBEDTLS_SSL_MAX_FRAGMENT_LENGTH
+#endif
+
+// Low-memory profile for the Memfault upload client. Trade-offs are listed in the README.
+#ifndef APP_TLS_LOW_MEMORY
+  #define APP_TLS_LOW_MEMORY 1
+#endif
+
+#if APP_TLS_LOW_MEMORY
+
+  // Shrink the record buffers to the negotiated fragment length once the handshake is done. The
+  // input buffer must stay 16 KB during the handshake in case the server ignores the MFL request.
+  #define MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH
+
+  // The client never sends more than one APP_UPLOAD_RECORD_PAYLOAD_SIZE record at a time
+  #undef MBEDTLS_SSL_OUT_CONTENT_LEN
+  #define MBEDTLS_SSL_OUT_CONTENT_LEN 2048
+
+  // Only ECDHE key exchange with AES-128-GCM, for ECDSA and RSA server certificates. Keeps the
+  // ClientHello small and the record overhead at the 29 bytes APP_UPLOAD_TLS_RECORD_OVERHEAD
+  // assumes.
+  #undef MBEDTLS_SSL_CIPHERSUITES
+  #define MBEDTLS_SSL_CIPHERSUITES                   \
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_GCM_SHA256, \
+      MBEDTLS_TLS_ECDHE_RSA_WITH_AES_128_GCM_SHA256
+
+  // Smaller ECC precomputation tables: less heap during ECDHE and ECDSA verification in exchange
+  // for slower point multiplication. The RSA window size is left alone, verifying with the small
+  // public exponent does not use large windows.
+  #undef MBEDTLS_ECP_WINDOW_SIZE
+  #define MBEDTLS_ECP_WINDOW_SIZE 2
+  #undef MBEDTLS_ECP_FIXED_POINT_OPTIM
+  #define MBEDTLS_ECP_FIXED_POINT_OPTIM 0
+
+#endif /* APP_TLS_LOW_MEMORY */
+
+#endif /* MBEDTLS_APP_CONFIG_H */
@@ -10,8 +10,21 @@ extern "C" {
 #endif
 
 #define MEMFAULT_COREDUMP_COLLECT_LOG_REGIONS 1
+// Logs made through APP_LOG_* are stored as format string address + arguments, see
+// source/app_log.h and configs/memfault_compact_log.ld
+#define MEMFAULT_COMPACT_LOG_ENABLE 1
+// Coredump regions are selected by source/app_coredump.c
+#define MEMFAULT_PLATFORM_COREDUMP_STORAGE_REGIONS_CUSTOM 1
+// Coredumps are stored on the external QSPI flash by source/app_coredump_storage.c instead of
+// the port's internal flash backend
+#define MEMFAULT_PLATFORM_COREDUMP_STORAGE_USE_FLASH 0
 // Currently unavailable for this example app.
 #define MEMFAULT_FREERTOS_COLLECT_THREAD_METRICS 0
+// 1 to upload the application's metrics as delta encoded frames instead of in the SDK
+// heartbeat, see source/app_metrics.h
+#ifndef APP_METRICS_COMPACT
+  #define APP_METRICS_COMPACT 0
+#endif
 
 #ifdef __cplusplus
 }
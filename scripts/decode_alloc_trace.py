@@ -0,0 +1,179 @@
+#!/usr/bin/env python3
+"""Rebuild live allocations per call site from the allocator trace ring.
+
+The firmware records recent malloc/free and pool events into a ring buffer
+(source/app_alloc_trace.c) which is saved as a coredump region. This script
+finds the ring in a raw coredump (as saved in coredump storage) or in a plain
+RAM dump, replays the events in order and reports which call sites still hold
+memory at the time of the crash.
+
+Usage:
+    decode_alloc_trace.py coredump.bin [--elf app.elf] [--addr2line arm-none-eabi-addr2line]
+"""
+
+import argparse
+import collections
+import shutil
+import struct
+import subprocess
+import sys
+
+# Keep in sync with sAppAllocTrace / sAppAllocTraceEntry in source/app_alloc_trace.h
+TRACE_MAGIC = 0x43525441
+TRACE_VERSION = 1
+HEADER_FMT = "<IHHII"
+HEADER_SIZE = struct.calcsize(HEADER_FMT)
+ENTRY_FMT = "<IIIII"
+ENTRY_SIZE = struct.calcsize(ENTRY_FMT)
+
+OP_HEAP_ALLOC = 0
+OP_HEAP_FREE = 1
+OP_HEAP_ALLOC_FAILED = 2
+OP_POOL_ALLOC = 3
+OP_POOL_FREE = 4
+
+OP_NAMES = {
+    OP_HEAP_ALLOC: "heap_alloc",
+    OP_HEAP_FREE: "heap_free",
+    OP_HEAP_ALLOC_FAILED: "heap_alloc_failed",
+    OP_POOL_ALLOC: "pool_alloc",
+    OP_POOL_FREE: "pool_free",
+}
+
+Event = collections.namedtuple("Event", "caller ptr task timestamp size op")
+
+
+def find_ring(data):
+    """Returns the events in the ring, oldest first."""
+    magic = struct.pack("<I", TRACE_MAGIC)
+    offset = data.find(magic)
+    while offset >= 0:
+        if offset + HEADER_SIZE <= len(data):
+            _, version, entry_size, num_entries, write_count = struct.unpack_from(
+                HEADER_FMT, data, offset
+            )
+            ring_size = HEADER_SIZE + num_entries * ENTRY_SIZE
+            if (
+                version == TRACE_VERSION
+                and entry_size == ENTRY_SIZE
+                and 0 < num_entries <= 4096
+                and offset + ring_size <= len(data)
+            ):
+                return parse_ring(data, offset + HEADER_SIZE, num_entries, write_count)
+        offset = data.find(magic, offset + 1)
+    return None
+
+
+def parse_ring(data, entries_offset, num_entries, write_count):
+    count = min(write_count, num_entries)
+    first = write_count - count
+    events = []
+    for seq in range(first, write_count):
+        slot = seq % num_entries
+        caller, ptr, task, timestamp, size_and_op = struct.unpack_from(
+            ENTRY_FMT, data, entries_offset + slot * ENTRY_SIZE
+        )
+        events.append(
+            Event(caller, ptr, task, timestamp, size_and_op & 0xFFFFFF, size_and_op >> 24)
+        )
+    return events, write_count
+
+
+def replay(events):
+    """Returns (live allocations keyed by pointer, frees of blocks allocated before the window)."""
+    live = {}
+    unmatched_frees = 0
+    for event in events:
+        if event.op in (OP_HEAP_ALLOC, OP_POOL_ALLOC):
+            live[event.ptr] = event
+        elif event.op in (OP_HEAP_FREE, OP_POOL_FREE):
+            if live.pop(event.ptr, None) is None:
+                unmatched_frees += 1
+    return live, unmatched_frees
+
+
+class Symbolizer:
+    def __init__(self, elf, addr2line):
+        self._elf = elf
+        self._addr2line = shutil.which(addr2line) if elf else None
+        self._cache = {}
+
+    def __call__(self, lr):
+        if not self._addr2line:
+            return ""
+        if lr not in self._cache:
+            # step back from the return address into the call instruction
+            addr = (lr & ~1) - 1
+            out = subprocess.run(
+                [self._addr2line, "-f", "-C", "-s", "-e", self._elf, hex(addr)],
+                capture_output=True,
+                text=True,
+                check=False,
+            ).stdout.split()
+            self._cache[lr] = " ".join(out[:2]) if out else "?"
+        return self._cache[lr]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("dump", help="raw coredump or RAM dump containing the trace ring")
+    parser.add_argument("--elf", help="symbol file used to resolve call sites")
+    parser.add_argument("--addr2line", default="arm-none-eabi-addr2line")
+    args = parser.parse_args()
+
+    with open(args.dump, "rb") as f:
+        data = f.read()
+
+    ring = find_ring(data)
+    if ring is None:
+        sys.exit("Allocation trace ring not found in {}".format(args.dump))
+    events, write_count = ring
+    symbolize = Symbolizer(args.elf, args.addr2line)
+
+    print(
+        "{} events recorded since boot, {} in the ring (ticks {} .. {})".format(
+            write_count,
+            len(events),
+            events[0].timestamp if events else 0,
+            events[-1].timestamp if events else 0,
+        )
+    )
+
+    failures = [e for e in events if e.op == OP_HEAP_ALLOC_FAILED]
+    for event in failures:
+        print(
+            "FAILED alloc of {} bytes from 0x{:08x} {} (task 0x{:08x}, tick {})".format(
+                event.size, event.caller, symbolize(event.caller), event.task, event.timestamp
+            )
+        )
+
+    live, unmatched_frees = replay(events)
+    per_site = collections.defaultdict(lambda: [0, 0, set()])
+    for event in live.values():
+        site = per_site[(event.caller, OP_NAMES[event.op].split("_")[0])]
+        site[0] += 1
+        site[1] += event.size
+        site[2].add(event.task)
+
+    print("\nLive allocations made inside the trace window, by call site:")
+    print("{:>8} {:>6} {:<5} {:<10} {}".format("bytes", "count", "kind", "caller", "location"))
+    for (caller, kind), (count, size, tasks) in sorted(
+        per_site.items(), key=lambda item: item[1][1], reverse=True
+    ):
+        print(
+            "{:>8} {:>6} {:<5} 0x{:08x} {} tasks={}".format(
+                size,
+                count,
+                kind,
+                caller,
+                symbolize(caller),
+                ",".join("0x{:08x}".format(t) for t in sorted(tasks)),
+            )
+        )
+
+    if unmatched_frees:
+        print("\n{} frees of blocks allocated before the trace window".format(unmatched_frees))
+
+
+if __name__ == "__main__":
+    main()
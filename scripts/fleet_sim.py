@@ -0,0 +1,330 @@
+#!/usr/bin/env python3
+"""Simulate a fleet of devices uploading through one ingestion endpoint.
+
+Runs N virtual devices in one process. Each device follows the scheduling of
+memfault_http_task(): startup jitter, the post interval with jitter and jittered
+exponential backoff after failures (source/app_backoff.h). They post chunk data over
+HTTP to a local stand-in for the chunks endpoint, which has a fixed number of
+workers and rejects requests with 503 when its queue is full. The endpoint
+goes down for an outage window, so the run shows how the fleet recovers.
+
+The policy constants are read from the firmware sources, so the simulation
+follows the values the firmware is built with. All times are simulated and
+compressed by --time-scale.
+
+Usage:
+    fleet_sim.py [--devices 500] [--policy jitter|fixed|both] [--boot-spread-s 0]
+                 [--outage-start-s 120] [--outage-s 300] [--time-scale 0.005]
+"""
+
+import argparse
+import asyncio
+import collections
+import os
+import random
+import re
+import statistics
+import sys
+
+REPO_ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+# Chunk data a device queues per post interval: one heartbeat plus some logs
+DEFAULT_BYTES_PER_INTERVAL = 600
+
+
+def read_defines(path, names):
+    """Evaluates simple arithmetic #defines, e.g. `#define X (5 * 1000)`."""
+    values = {}
+    with open(path) as f:
+        for line in f:
+            match = re.match(r"\s*#define\s+(\w+)\s+([\d\s*+()-]+?)\s*$", line)
+            if match and match.group(1) in names:
+                values[match.group(1)] = int(eval(match.group(2), {"__builtins__": {}}))
+    missing = set(names) - set(values)
+    if missing:
+        sys.exit("{}: missing {}".format(path, ", ".join(sorted(missing))))
+    return values
+
+
+def load_policy():
+    backoff = read_defines(
+        os.path.join(REPO_ROOT, "source", "app_backoff.h"),
+        [
+            "APP_BACKOFF_BASE_MS",
+            "APP_BACKOFF_MIN_MS",
+            "APP_BACKOFF_CAP_MS",
+            "APP_BACKOFF_INTERVAL_JITTER_PERMILLE",
+            "APP_BACKOFF_STARTUP_JITTER_MS",
+        ],
+    )
+    task = read_defines(
+        os.path.join(REPO_ROOT, "source", "app_config.h"),
+        ["MEMFAULT_POST_SEND_INTERVAL_MS"],
+    )
+    backoff.update(task)
+    return backoff
+
+
+class Scheduler:
+    """Mirrors app_backoff.c. The 'fixed' policy is the schedule before it was added."""
+
+    def __init__(self, policy, constants, rng):
+        self.policy = policy
+        self.c = constants
+        self.rng = rng
+        self.failures = 0
+
+    def startup_delay_ms(self):
+        if self.policy == "fixed":
+            return 0
+        return self.rng.randint(0, self.c["APP_BACKOFF_STARTUP_JITTER_MS"])
+
+    def failure_delay_ms(self):
+        if self.policy == "fixed":
+            return self.c["MEMFAULT_POST_SEND_INTERVAL_MS"]
+        ceiling = self.c["APP_BACKOFF_BASE_MS"] * (2 ** min(self.failures, 31))
+        ceiling = min(ceiling, self.c["APP_BACKOFF_CAP_MS"])
+        self.failures += 1
+        floor = self.c["APP_BACKOFF_MIN_MS"]
+        return self.rng.randint(floor, max(ceiling, floor))
+
+    def success_delay_ms(self):
+        self.failures = 0
+        interval = self.c["MEMFAULT_POST_SEND_INTERVAL_MS"]
+        if self.policy == "fixed":
+            return interval
+        spread = interval * self.c["APP_BACKOFF_INTERVAL_JITTER_PERMILLE"] // 1000
+        return self.rng.randint(interval - spread, interval + spread)
+
+
+class Clock:
+    def __init__(self, time_scale):
+        self.time_scale = time_scale
+        self.start = asyncio.get_event_loop().time()
+
+    def now_s(self):
+        """Simulated seconds since the start of the run."""
+        return (asyncio.get_event_loop().time() - self.start) / self.time_scale
+
+    async def sleep_ms(self, ms):
+        await asyncio.sleep(ms / 1000.0 * self.time_scale)
+
+
+class IngestionServer:
+    """Stand-in for the chunks endpoint: a worker pool with a bounded queue."""
+
+    def __init__(self, clock, workers, queue_limit, service_ms, outage):
+        self.clock = clock
+        self.workers = asyncio.Semaphore(workers)
+        self.queue_limit = queue_limit
+        self.waiting = 0
+        self.service_ms = service_ms
+        self.outage = outage
+        self.accepted_bytes = 0
+
+    def down(self):
+        start, end = self.outage
+        return start <= self.clock.now_s() < end
+
+    async def handle(self, reader, writer):
+        try:
+            request = await reader.readuntil(b"\r\n\r\n")
+            if self.down():
+                return
+            length = 0
+            for line in request.split(b"\r\n"):
+                if line.lower().startswith(b"content-length:"):
+                    length = int(line.split(b":")[1])
+            await reader.readexactly(length)
+
+            if self.waiting >= self.queue_limit:
+                status = b"503 Service Unavailable"
+            else:
+                self.waiting += 1
+                async with self.workers:
+                    self.waiting -= 1
+                    await self.clock.sleep_ms(self.service_ms)
+                self.accepted_bytes += length
+                status = b"202 Accepted"
+            writer.write(b"HTTP/1.1 " + status + b"\r\nContent-Length: 0\r\n\r\n")
+            await writer.drain()
+        except (asyncio.IncompleteReadError, ConnectionError):
+            pass
+        finally:
+            writer.close()
+
+
+class Stats:
+    def __init__(self):
+        self.attempts = collections.Counter()
+        self.failures = collections.Counter()
+        self.successes = collections.Counter()
+        self.latencies_ms = []
+        self.recovered_at = {}
+
+    def record(self, second, ok, latency_ms):
+        self.attempts[second] += 1
+        if ok:
+            self.successes[second] += 1
+            self.latencies_ms.append(latency_ms)
+        else:
+            self.failures[second] += 1
+
+
+async def post(port, serial, size):
+    """Posts one chunk message like app_upload_post_chunk(), returns True on 2xx."""
+    reader, writer = await asyncio.open_connection("127.0.0.1", port)
+    try:
+        header = (
+            "POST /api/v0/chunks/{} HTTP/1.1\r\n"
+            "Host: chunks.memfault.com\r\n"
+            "Content-Type: application/octet-stream\r\n"
+            "Content-Length: {}\r\n\r\n".format(serial, size)
+        )
+        writer.write(header.encode() + bytes(size))
+        await writer.drain()
+        status_line = await reader.readline()
+        return status_line.split(b" ")[1:2] == [b"202"]
+    except (ConnectionError, IndexError):
+        return False
+    finally:
+        writer.close()
+
+
+async def device(index, args, constants, clock, port, stats, outage_end_s, stop_s):
+    # Stand-in for memfault_platform_init_serial_number()
+    serial = "SIM{:05d}".format(index)
+    scheduler = Scheduler(args.policy_name, constants, random.Random(args.seed * 100003 + index))
+    interval_s = constants["MEMFAULT_POST_SEND_INTERVAL_MS"] / 1000.0
+    # By default the whole fleet boots together, e.g. after a site-wide power cut
+    await clock.sleep_ms(random.Random(index).uniform(0, args.boot_spread_s * 1000))
+    await clock.sleep_ms(scheduler.startup_delay_ms())
+    last_post_s = clock.now_s()
+
+    while clock.now_s() < stop_s:
+        # Data accumulates while posts fail
+        queued = int(args.bytes_per_interval * max(1.0, (clock.now_s() - last_post_s) / interval_s))
+        start_s = clock.now_s()
+        try:
+            ok = await post(port, serial, queued)
+        except OSError:
+            ok = False
+        now_s = clock.now_s()
+        latency_ms = (now_s - start_s) * 1000.0
+        stats.record(int(now_s), ok, latency_ms)
+
+        if ok:
+            last_post_s = now_s
+            if now_s >= outage_end_s and serial not in stats.recovered_at:
+                stats.recovered_at[serial] = now_s - outage_end_s
+            delay_ms = scheduler.success_delay_ms()
+        else:
+            delay_ms = scheduler.failure_delay_ms()
+        await clock.sleep_ms(delay_ms)
+
+
+def percentile(values, pct):
+    if not values:
+        return 0.0
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(len(ordered) * pct / 100.0))]
+
+
+def report(policy, args, stats, outage, server):
+    start, end = outage
+    after = [s for s in stats.attempts if s >= end]
+    attempts_after = [stats.attempts[s] for s in range(int(end), int(args.duration_s))]
+    print("== policy: {} ({} devices)".format(policy, args.devices))
+    total_ok = sum(stats.successes.values())
+    print("  accepted posts:           {} ({:.2f}/s)".format(total_ok, total_ok / args.duration_s))
+    print("  accepted bytes:           {}".format(server.accepted_bytes))
+    print("  failed attempts:          {}".format(sum(stats.failures.values())))
+    print(
+        "  latency ms p50/p95/p99:   {:.1f} / {:.1f} / {:.1f}".format(
+            percentile(stats.latencies_ms, 50),
+            percentile(stats.latencies_ms, 95),
+            percentile(stats.latencies_ms, 99),
+        )
+    )
+    if stats.attempts:
+        peak_second = max(stats.attempts, key=lambda s: stats.attempts[s])
+        print(
+            "  peak load:                {} attempts/s at {}s, {} of them rejected".format(
+                stats.attempts[peak_second], peak_second, stats.failures[peak_second]
+            )
+        )
+    if after:
+        peak_second = max(after, key=lambda s: stats.attempts[s])
+        print(
+            "  retry storm after outage: peak {} attempts/s at +{}s, {} of them rejected".format(
+                stats.attempts[peak_second], peak_second - int(end), stats.failures[peak_second]
+            )
+        )
+    if attempts_after:
+        mean = statistics.mean(attempts_after)
+        print(
+            "  load spread after outage: peak/mean {:.1f}, stdev {:.1f} attempts/s".format(
+                max(attempts_after) / mean if mean else 0.0, statistics.pstdev(attempts_after)
+            )
+        )
+    recovered = sorted(stats.recovered_at.values())
+    print(
+        "  recovered devices:        {}/{}, p50 {:.0f}s, p95 {:.0f}s, last {:.0f}s "
+        "after outage".format(
+            len(recovered),
+            args.devices,
+            percentile(recovered, 50),
+            percentile(recovered, 95),
+            recovered[-1] if recovered else 0,
+        )
+    )
+
+
+async def run(policy, args, constants):
+    clock = Clock(args.time_scale)
+    outage = (args.outage_start_s, args.outage_start_s + args.outage_s)
+    server = IngestionServer(clock, args.server_workers, args.server_queue, args.service_ms, outage)
+    listener = await asyncio.start_server(server.handle, "127.0.0.1", 0)
+    port = listener.sockets[0].getsockname()[1]
+
+    stats = Stats()
+    args.policy_name = policy
+    await asyncio.gather(
+        *[
+            device(i, args, constants, clock, port, stats, outage[1], args.duration_s)
+            for i in range(args.devices)
+        ]
+    )
+    listener.close()
+    await listener.wait_closed()
+    report(policy, args, stats, outage, server)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--devices", type=int, default=500)
+    parser.add_argument("--policy", choices=["jitter", "fixed", "both"], default="both")
+    parser.add_argument("--duration-s", type=float, default=20 * 60, help="simulated run time")
+    parser.add_argument("--boot-spread-s", type=float, default=0, help="window devices boot in")
+    parser.add_argument("--outage-start-s", type=float, default=2 * 60)
+    parser.add_argument("--outage-s", type=float, default=5 * 60)
+    parser.add_argument("--time-scale", type=float, default=0.005, help="real s per simulated s")
+    parser.add_argument("--server-workers", type=int, default=8)
+    parser.add_argument("--server-queue", type=int, default=64)
+    parser.add_argument("--service-ms", type=float, default=500, help="server time per post")
+    parser.add_argument("--post-interval-ms", type=int, help="override the firmware default")
+    parser.add_argument("--bytes-per-interval", type=int, default=DEFAULT_BYTES_PER_INTERVAL)
+    parser.add_argument("--seed", type=int, default=1)
+    args = parser.parse_args()
+
+    constants = load_policy()
+    if args.post_interval_ms:
+        # Devices tuned with `config set post_interval_ms`
+        constants["MEMFAULT_POST_SEND_INTERVAL_MS"] = args.post_interval_ms
+    policies = ["fixed", "jitter"] if args.policy == "both" else [args.policy]
+    for policy in policies:
+        asyncio.run(run(policy, args, constants))
+
+
+if __name__ == "__main__":
+    main()
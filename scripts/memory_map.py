@@ -0,0 +1,181 @@
+#!/usr/bin/env python3
+"""Report static RAM per subsystem and the TLS heap headroom from a linker map file.
+
+The application's RTOS objects are placed in one section per subsystem
+(configs/app_memmap.ld). This script reads the GNU ld map file of a build and
+prints the static bytes of each subsystem, the rest of .data and .bss grouped
+by library, and the heap left for the allocator. It then checks the heap
+against the TLS reserve. The heap bytes each subsystem holds at runtime are
+printed on the device by the `memmap` shell command.
+
+It also reports the hot code that source/app_placement.h copies to SRAM.
+
+Usage:
+    memory_map.py build/CY8CPROTO-062-4343W/Debug/mtb-example-memfault.map [--objects]
+"""
+
+import argparse
+import collections
+import os
+import re
+import sys
+
+APP_STATIC_PREFIX = ".bss.app_static."
+# Input sections of source/app_placement.h, with where they run from
+PLACEMENT_SECTIONS = collections.OrderedDict(
+    [
+        (".cy_ramfunc", "SRAM, also kept in internal flash as the load image"),
+    ]
+)
+# Output sections which are not static storage
+SKIPPED_OUTPUT_SECTIONS = (".heap", ".stack_dummy")
+
+MEMORY_RE = re.compile(r"^(\w+)\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)")
+OUTPUT_SECTION_RE = re.compile(r"^(\.\S+)(?:\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+))?")
+INPUT_SECTION_RE = re.compile(
+    r"^ (\.\S+|COMMON)(?:\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(.*))?$"
+)
+CONTINUATION_RE = re.compile(r"^\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(.*)$")
+SYMBOL_RE = re.compile(r"^\s+0x([0-9a-fA-F]+)\s+(?:PROVIDE \()?(\w+) = ")
+
+InputSection = collections.namedtuple("InputSection", "output name address size path")
+
+
+def parse_map(path):
+    """Returns the RAM region, the input sections with their output section, and symbols."""
+    ram = None
+    sections = []
+    symbols = {}
+    output = None
+    pending = None
+    in_memory_map = False
+    with open(path) as f:
+        for line in f:
+            line = line.rstrip("\n")
+            if not in_memory_map:
+                match = MEMORY_RE.match(line)
+                if match and match.group(1) == "ram":
+                    start = int(match.group(2), 16)
+                    ram = (start, start + int(match.group(3), 16))
+                if line.startswith("Linker script and memory map"):
+                    in_memory_map = True
+                continue
+
+            if pending is not None:
+                match = CONTINUATION_RE.match(line)
+                if match:
+                    address, size, obj = match.groups()
+                    sections.append(
+                        InputSection(output, pending, int(address, 16), int(size, 16), obj)
+                    )
+                pending = None
+                continue
+
+            match = SYMBOL_RE.match(line)
+            if match:
+                symbols[match.group(2)] = int(match.group(1), 16)
+                continue
+            match = OUTPUT_SECTION_RE.match(line)
+            if match:
+                output = match.group(1)
+                continue
+            match = INPUT_SECTION_RE.match(line)
+            if match:
+                name, address, size, obj = match.groups()
+                if address is None:
+                    # Long names put the address and size on the next line
+                    pending = name
+                else:
+                    sections.append(
+                        InputSection(output, name, int(address, 16), int(size, 16), obj)
+                    )
+    return ram, sections, symbols
+
+
+def component(path):
+    """Groups an object file by the library it was built from."""
+    parts = path.replace("\\", "/").split("/")
+    for marker in ("mtb_shared", "libs"):
+        if marker in parts and parts.index(marker) + 1 < len(parts):
+            return parts[parts.index(marker) + 1]
+    archive = re.match(r"(?:.*/)?lib(\w+)\.a\(", path)
+    if archive:
+        return "lib" + archive.group(1)
+    if "source" in parts:
+        return "app"
+    return os.path.basename(path) or "linker"
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("map", help="linker map file of the build")
+    parser.add_argument("--objects", action="store_true", help="list the objects per subsystem")
+    args = parser.parse_args()
+
+    ram, sections, symbols = parse_map(args.map)
+    if ram is None:
+        sys.exit("No 'ram' memory region in {}".format(args.map))
+
+    subsystems = collections.OrderedDict()
+    objects = collections.defaultdict(collections.Counter)
+    others = collections.Counter()
+    placed = collections.defaultdict(collections.Counter)
+    for section in sections:
+        if section.name in PLACEMENT_SECTIONS:
+            placed[section.name][os.path.basename(section.path)] += section.size
+        if section.size == 0 or not ram[0] <= section.address < ram[1]:
+            continue
+        if section.output in SKIPPED_OUTPUT_SECTIONS:
+            continue
+        if section.name.startswith(APP_STATIC_PREFIX):
+            name = section.name[len(APP_STATIC_PREFIX) :]
+            subsystems[name] = subsystems.get(name, 0) + section.size
+            objects[name][os.path.basename(section.path)] += section.size
+        else:
+            others[component(section.path)] += section.size
+
+    print("{:<24} {:>8}".format("Subsystem", "Static"))
+    for name, size in subsystems.items():
+        print("{:<24} {:>8}".format(name, size))
+        if args.objects:
+            for obj, obj_size in objects[name].most_common():
+                print("  {:<22} {:>8}".format(obj, obj_size))
+    print()
+    print("Other .data/.bss")
+    for name, size in others.most_common():
+        print("{:<24} {:>8}".format(name, size))
+
+    static_bytes = sum(subsystems.values()) + sum(others.values())
+    print()
+    print(
+        "Static RAM: {} bytes, {} in app RTOS objects".format(
+            static_bytes, sum(subsystems.values())
+        )
+    )
+
+    print()
+    print("Code placement")
+    for name, description in PLACEMENT_SECTIONS.items():
+        print("{:<24} {:>8}  {}".format(name, sum(placed[name].values()), description))
+        if args.objects:
+            for obj, obj_size in placed[name].most_common():
+                print("  {:<22} {:>8}".format(obj, obj_size))
+
+    print()
+    if "__HeapBase" not in symbols or "__HeapLimit" not in symbols:
+        print("Heap symbols not found, skipping the TLS reserve check")
+        return 0
+    heap = symbols["__HeapLimit"] - symbols["__HeapBase"]
+    reserve = symbols.get("__app_memmap_tls_heap_reserve")
+    print("Heap: {} bytes".format(heap))
+    if reserve is None:
+        print("No TLS reserve in the map, is configs/app_memmap.ld linked?")
+        return 0
+    print(
+        "TLS reserve: {} bytes, {} bytes left for everything else".format(reserve, heap - reserve)
+    )
+    return 0 if heap >= reserve else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -7,9 +7,14 @@
 
 #include <FreeRTOS.h>
 #include <semphr.h>
+#include <stdio.h>
 #include <task.h>
 
+#include "app_config.h"
 #include "app_kvstore.h"
+#include "app_log.h"
+#include "app_supervisor.h"
+#include "app_trace.h"
 #include "cy_wcm.h"
 #include "cy_wcm_error.h"
 #include "cyhal.h"
@@ -18,7 +23,9 @@
 /* IP address related header files (part of the lwIP TCP/IP stack). */
 #include "ip_addr.h"
 
-#define WIFI_CONN_RETRY_INTERVAL_MSEC              (5000)
+//! Params of the last successful join, reused to roam between the APs of the network
+static cy_wcm_connect_params_t s_last_connect_params;
+static bool s_last_connect_params_valid;
 
 //! Helper function to convert from cy_wcm_security_t value to a string
 static const char *wifi_utils_authtype_to_str(cy_wcm_security_t sec) {
@@ -49,11 +56,7 @@ static const char *wifi_utils_authtype_to_str(cy_wcm_security_t sec) {
   }
 }
 
-//! Helper function to convert a string to cy_wcm_security_t
-//!
-//! @param auth_str String representing an auth type
-//! @returns cy_wcm_security_t representing the auth type
-static cy_wcm_security_t wifi_utils_str_to_authtype(const char *auth_str) {
+cy_wcm_security_t wifi_utils_str_to_authtype(const char *auth_str) {
   if (strcmp(auth_str, "open") == 0) {
     return CY_WCM_SECURITY_OPEN;
   } else if (strcmp(auth_str, "wpa2_tkip") == 0) {
@@ -71,7 +74,7 @@ static cy_wcm_security_t wifi_utils_str_to_authtype(const char *auth_str) {
   } else if (strcmp(auth_str, "wpa3_wpa2") == 0) {
     return CY_WCM_SECURITY_WPA3_WPA2_PSK;
   } else {
-    MEMFAULT_LOG_ERROR("Unsupported auth type: '%s'", auth_str);
+    APP_LOG_ERROR("Unsupported auth type: '%s'", auth_str);
     return CY_WCM_SECURITY_UNKNOWN;
   }
 }
@@ -96,7 +99,7 @@ static int convert_to_wcm_connect_params(const char *ssid, const char *auth_type
   // security type
   connect_params->ap_credentials.security = wifi_utils_str_to_authtype(auth_type);
   if (connect_params->ap_credentials.security == CY_WCM_SECURITY_UNKNOWN) {
-    MEMFAULT_LOG_ERROR("Cannot connect due to unsupported auth type.");
+    APP_LOG_ERROR("Cannot connect due to unsupported auth type.");
     return -1;
   }
 
@@ -123,38 +126,70 @@ static cy_rslt_t prv_wifi_ap_connect(cy_wcm_connect_params_t *wifi_conn_param) {
     return result;
   }
 
-  MEMFAULT_LOG_INFO("Successfully connected to Wi-Fi network '%s'",
-                    wifi_conn_param->ap_credentials.SSID);
+  APP_LOG_INFO("Successfully connected to Wi-Fi network '%s'",
+               (const char *)wifi_conn_param->ap_credentials.SSID);
 
 #if(USE_IPV6_ADDRESS)
   result = cy_wcm_get_ipv6_addr(CY_WCM_INTERFACE_TYPE_STA,
                                 CY_WCM_IPV6_LINK_LOCAL, &ip_address,1);
   if (result == CY_RSLT_SUCCESS) {
-    MEMFAULT_LOG_INFO("IPv6 address (link-local) assigned: %s",
-                      ip6addr_ntoa((const ip6_addr_t*)&ip_address.ip.v6));
+    APP_LOG_INFO("IPv6 address (link-local) assigned: %s",
+                 ip6addr_ntoa((const ip6_addr_t*)&ip_address.ip.v6));
   }
 #else
-  MEMFAULT_LOG_INFO("IPv4 address assigned: %s\n",
-                    ip4addr_ntoa((const ip4_addr_t*)&ip_address.ip.v4));
+  APP_LOG_INFO("IPv4 address assigned: %s\n",
+               ip4addr_ntoa((const ip4_addr_t*)&ip_address.ip.v4));
 #endif /* USE_IPV6_ADDRESS */
   return result;
 }
 
+int ap_format_scan_result(const cy_wcm_scan_result_t *result, char *buf, size_t buf_len) {
+  const char *auth_type = wifi_utils_authtype_to_str(result->security);
+
+  return snprintf(buf, buf_len, "%-20s %-14s %-10d %-7d %02X:%02X:%02X:%02X:%02X:%02X",
+                  (const char *)result->SSID, auth_type, result->signal_strength,
+                  result->channel, result->BSSID[0], result->BSSID[1], result->BSSID[2],
+                  result->BSSID[3], result->BSSID[4], result->BSSID[5]);
+}
+
 //! Callback function used to log scan results to console during a scan.
 static void prv_scan_result_cb(cy_wcm_scan_result_t *result_ptr, void *user_data,
                                cy_wcm_scan_status_t status) {
   if (status == CY_WCM_SCAN_INCOMPLETE) {
-    const char *auth_type = wifi_utils_authtype_to_str(result_ptr->security);
-
-    MEMFAULT_LOG_INFO("%-20s %-14s %-10d %-7d %02X:%02X:%02X:%02X:%02X:%02X", result_ptr->SSID,
-                      auth_type, result_ptr->signal_strength, result_ptr->channel,
-                      result_ptr->BSSID[0], result_ptr->BSSID[1], result_ptr->BSSID[2],
-                      result_ptr->BSSID[3], result_ptr->BSSID[4], result_ptr->BSSID[5]);
+    char line[AP_SCAN_RESULT_LINE_MAX_LEN];
+    ap_format_scan_result(result_ptr, line, sizeof(line));
+    MEMFAULT_LOG_INFO("%s", line);
   } else if (status == CY_WCM_SCAN_COMPLETE) {
     MEMFAULT_LOG_INFO("#### Scan Results END ####");
   }
 }
 
+//! Helper function to connect, retrying after a delay, and to save the params once connected
+//!
+//! Runs in the CLI and HTTP tasks, whose supervisor deadlines are shorter than the longest retry
+//! sequence the config allows, so it checks in for the calling task on every attempt and during
+//! the delays.
+static cy_rslt_t prv_connect_with_retries(cy_wcm_connect_params_t *wifi_conn_param,
+                                          uint32_t retries) {
+  cy_rslt_t result = -1;
+  for (uint32_t conn_retries = 0; conn_retries < retries; conn_retries++) {
+    app_supervisor_checkin_current();
+    result = prv_wifi_ap_connect(wifi_conn_param);
+    if (result == CY_RSLT_SUCCESS) {
+      s_last_connect_params = *wifi_conn_param;
+      s_last_connect_params_valid = true;
+      return result;
+    }
+    APP_TRACE_EVENT(WifiConnectFailure, result);
+    APP_LOG_WARN("Connection to Wi-Fi network failed with error code. rv=0x%x."
+                 "Retrying in %d ms...", (int)result, (int)APP_CONFIG_GET(wifi_retry_delay_ms));
+    app_supervisor_delay_ms(APP_CONFIG_GET(wifi_retry_delay_ms));
+  }
+
+  APP_LOG_ERROR("Exceeded maximum Wi-Fi connection attempts\n");
+  return result;
+}
+
 cy_rslt_t connect_to_wifi_ap(const char *ssid, const char *auth_type, const char *password,
                              uint32_t retries) {
   // Set the Wi-Fi SSID, password and security type.
@@ -165,28 +200,36 @@ cy_rslt_t connect_to_wifi_ap(const char *ssid, const char *auth_type, const char
   cy_wcm_connect_params_t wifi_conn_param = {0};
   cy_rslt_t result = convert_to_wcm_connect_params(ssid, auth_type, password, &wifi_conn_param);
   if (result != CY_RSLT_SUCCESS) {
-    MEMFAULT_LOG_ERROR("Could not parse args correctly");
+    APP_LOG_ERROR("Could not parse args correctly");
     return result;
   }
 
-  for (uint32_t conn_retries = 0; conn_retries < retries; conn_retries++) {
-    result = prv_wifi_ap_connect(&wifi_conn_param);
-    if (result == CY_RSLT_SUCCESS) {
-      return result;
-    }
-    MEMFAULT_LOG_WARN("Connection to Wi-Fi network failed with error code. rv=0x%x."
-                      "Retrying in %d ms...", (int)result, WIFI_CONN_RETRY_INTERVAL_MSEC);
-    vTaskDelay(pdMS_TO_TICKS(WIFI_CONN_RETRY_INTERVAL_MSEC));
+  return prv_connect_with_retries(&wifi_conn_param, retries);
+}
+
+cy_rslt_t ap_join_bssid(const cy_wcm_mac_t bssid) {
+  if (!s_last_connect_params_valid) {
+    return -1;
   }
+  cy_wcm_connect_params_t wifi_conn_param = s_last_connect_params;
+  memcpy(wifi_conn_param.BSSID, bssid, sizeof(wifi_conn_param.BSSID));
+  return prv_wifi_ap_connect(&wifi_conn_param);
+}
 
-  MEMFAULT_LOG_ERROR("Exceeded maximum Wi-Fi connection attempts\n");
-  return result;
+cy_rslt_t ap_rejoin(uint32_t retries) {
+  if (!s_last_connect_params_valid) {
+    return -1;
+  }
+  cy_wcm_connect_params_t wifi_conn_param = s_last_connect_params;
+  memset(wifi_conn_param.BSSID, 0, sizeof(wifi_conn_param.BSSID));
+  return prv_connect_with_retries(&wifi_conn_param, retries);
 }
 
 cy_rslt_t scan_wifi_ap(void) {
   cy_rslt_t res = cy_wcm_start_scan(prv_scan_result_cb, NULL, NULL);
   if (res != CY_RSLT_SUCCESS && res != CY_RSLT_WCM_SCAN_IN_PROGRESS) {
-    MEMFAULT_LOG_ERROR("Error while scanning. Res: %u", (unsigned int)res);
+    APP_LOG_ERROR("Error while scanning. Res: %u", (unsigned int)res);
+    APP_TRACE_EVENT(WifiScanFailure, res);
   }
 
   return res;
@@ -1,9 +1,14 @@
 #pragma once
 //! @file Functions to control the WiFi AP connection
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include "cy_result.h"
+#include "cy_wcm.h"
+
+//! Buffer size which fits any line produced by ap_format_scan_result()
+#define AP_SCAN_RESULT_LINE_MAX_LEN 96
 
 //! Attempts to connect to a Wifi AP
 //!
@@ -12,8 +17,30 @@
 cy_rslt_t connect_to_wifi_ap(const char *ssid, const char *auth_type, const char *password,
                              uint32_t retries);
 
+//! Joins a given AP of the network last joined, without retrying
+//!
+//! @return CY_RSLT_SUCCESS if connection succeeded, -1 if no network was joined yet, else error
+//! code
+cy_rslt_t ap_join_bssid(const cy_wcm_mac_t bssid);
+
+//! Joins the network last joined again, on whichever AP WCM picks
+//!
+//! @param retries Number of retries to attempt when connecting to an AP
+//! @return CY_RSLT_SUCCESS if connection succeeded, -1 if no network was joined yet, else error
+//! code
+cy_rslt_t ap_rejoin(uint32_t retries);
+
 //! Scans for available WiFi APs
 //!
 //! Prints information on scanned APs including the SSID and auth type
 //! @return CY_RSLT_SUCCESS if scan succeeded, else error code
-cy_rslt_t scan_wifi_ap(void);
\ No newline at end of file
+cy_rslt_t scan_wifi_ap(void);
+//! Converts an auth type string as accepted by wifi_join, e.g. "wpa2_aes", to cy_wcm_security_t
+//!
+//! @return The auth type, or CY_WCM_SECURITY_UNKNOWN if the string is not supported
+cy_wcm_security_t wifi_utils_str_to_authtype(const char *auth_str);
+
+//! Formats one scan result as a row of the wifi_scan table
+//!
+//! @return Number of characters written, excluding the terminator, as for snprintf()
+int ap_format_scan_result(const cy_wcm_scan_result_t *result, char *buf, size_t buf_len);
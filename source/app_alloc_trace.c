@@ -0,0 +1,55 @@
+//! @file
+//!
+//! @brief
+//! Allocator event ring buffer. Recording is a handful of stores inside a critical section so it
+//! can sit on the malloc/free hot path.
+
+#include "app_alloc_trace.h"
+
+#include <FreeRTOS.h>
+#include <task.h>
+
+#include "app_placement.h"
+#include "cy_device_headers.h"
+#include "cy_syslib.h"
+
+#define APP_ALLOC_TRACE_MAX_SIZE (0x00FFFFFFUL)
+
+static sAppAllocTrace s_alloc_trace = {
+  .magic = APP_ALLOC_TRACE_MAGIC,
+  .version = APP_ALLOC_TRACE_VERSION,
+  .entry_size = sizeof(sAppAllocTraceEntry),
+  .num_entries = APP_ALLOC_TRACE_NUM_ENTRIES,
+};
+
+APP_RAMFUNC static uint32_t prv_current_task(void) {
+  if ((__get_IPSR() != 0) || (xTaskGetSchedulerState() == taskSCHEDULER_NOT_STARTED)) {
+    return 0;
+  }
+  return (uint32_t)(uintptr_t)xTaskGetCurrentTaskHandle();
+}
+
+APP_RAMFUNC void app_alloc_trace_record(eAppAllocTraceOp op, const void *ptr, size_t size,
+                                        const void *caller) {
+  const uint32_t saturated_size = (size > APP_ALLOC_TRACE_MAX_SIZE) ? APP_ALLOC_TRACE_MAX_SIZE
+                                                                    : (uint32_t)size;
+  const uint32_t task = prv_current_task();
+  const uint32_t timestamp = xTaskGetTickCount();
+
+  const uint32_t irq_state = Cy_SysLib_EnterCriticalSection();
+  sAppAllocTraceEntry *entry =
+    &s_alloc_trace.entries[s_alloc_trace.write_count % APP_ALLOC_TRACE_NUM_ENTRIES];
+  s_alloc_trace.write_count++;
+  *entry = (sAppAllocTraceEntry){
+    .caller = (uint32_t)(uintptr_t)caller,
+    .ptr = (uint32_t)(uintptr_t)ptr,
+    .task = task,
+    .timestamp = timestamp,
+    .size_and_op = saturated_size | ((uint32_t)op << 24),
+  };
+  Cy_SysLib_ExitCriticalSection(irq_state);
+}
+
+const sAppAllocTrace *app_alloc_trace_get(void) {
+  return &s_alloc_trace;
+}
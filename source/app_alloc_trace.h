@@ -0,0 +1,66 @@
+#pragma once
+
+//! @file
+//!
+//! @brief
+//! Ring buffer of recent allocator events, captured in coredumps
+//!
+//! Every alloc/free made through the heap wrappers (app_heap_stats.c) and the pool allocator
+//! (app_pool.c) is recorded with the caller's return address, the size, the calling task and a
+//! timestamp. When the device runs out of memory the ring ends up in the coredump and
+//! scripts/decode_alloc_trace.py rebuilds the live allocations per call site from it.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef APP_ALLOC_TRACE_NUM_ENTRIES
+  #define APP_ALLOC_TRACE_NUM_ENTRIES 64
+#endif
+
+//! 'ATRC', lets the host decoder find the ring inside a coredump memory region
+#define APP_ALLOC_TRACE_MAGIC 0x43525441
+#define APP_ALLOC_TRACE_VERSION 1
+
+typedef enum {
+  kAppAllocTraceOp_HeapAlloc = 0,
+  kAppAllocTraceOp_HeapFree = 1,
+  kAppAllocTraceOp_HeapAllocFailed = 2,
+  kAppAllocTraceOp_PoolAlloc = 3,
+  kAppAllocTraceOp_PoolFree = 4,
+} eAppAllocTraceOp;
+
+//! Layout is decoded on the host, keep in sync with scripts/decode_alloc_trace.py
+typedef struct {
+  //! Return address of the allocator call
+  uint32_t caller;
+  //! Pointer returned by the allocator or passed to free
+  uint32_t ptr;
+  //! TCB of the calling task, 0 before the scheduler starts or from an interrupt
+  uint32_t task;
+  //! RTOS tick count at the time of the event
+  uint32_t timestamp;
+  //! bits 0-23: requested size (saturated), bits 24-31: eAppAllocTraceOp
+  uint32_t size_and_op;
+} sAppAllocTraceEntry;
+
+typedef struct {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t entry_size;
+  uint32_t num_entries;
+  //! Total number of events recorded, the next event goes to write_count % num_entries
+  uint32_t write_count;
+  sAppAllocTraceEntry entries[APP_ALLOC_TRACE_NUM_ENTRIES];
+} sAppAllocTrace;
+
+//! Records an allocator event
+//!
+//! @param op The kind of event
+//! @param ptr The block allocated or freed
+//! @param size The requested size, ignored for frees
+//! @param caller Return address of the code which called into the allocator
+void app_alloc_trace_record(eAppAllocTraceOp op, const void *ptr, size_t size,
+                            const void *caller);
+
+//! Returns the ring buffer so it can be added to the coredump regions
+const sAppAllocTrace *app_alloc_trace_get(void);
@@ -0,0 +1,62 @@
+//! @file
+//!
+//! @brief
+//! Jittered upload scheduling, see app_backoff.h
+
+#include "app_backoff.h"
+
+#include <stdbool.h>
+
+#include "cyhal.h"
+#include "memfault/components.h"
+
+static uint32_t s_rng_state;
+
+//! xorshift32, seeded from the TRNG so devices booted at the same time diverge
+static uint32_t prv_random(void) {
+  if (s_rng_state == 0) {
+    cyhal_trng_t trng;
+    if (cyhal_trng_init(&trng) == CY_RSLT_SUCCESS) {
+      s_rng_state = cyhal_trng_generate(&trng);
+      cyhal_trng_free(&trng);
+    }
+    // xorshift never leaves 0, fall back to the uptime if the TRNG is unavailable
+    if (s_rng_state == 0) {
+      s_rng_state = memfault_platform_get_time_since_boot_ms() | 1;
+    }
+  }
+  s_rng_state ^= s_rng_state << 13;
+  s_rng_state ^= s_rng_state >> 17;
+  s_rng_state ^= s_rng_state << 5;
+  return s_rng_state;
+}
+
+//! Returns a random value in [min, max]
+static uint32_t prv_random_between(uint32_t min, uint32_t max) {
+  if (max <= min) {
+    return min;
+  }
+  return min + (prv_random() % (max - min + 1));
+}
+
+uint32_t app_backoff_next_failure_delay_ms(sAppBackoff *backoff) {
+  // Stop doubling once the cap is reached so the shift can't overflow
+  uint32_t ceiling_ms = APP_BACKOFF_BASE_MS;
+  for (uint32_t i = 0; (i < backoff->failures) && (ceiling_ms < APP_BACKOFF_CAP_MS); i++) {
+    ceiling_ms *= 2;
+  }
+  ceiling_ms = MEMFAULT_MIN(ceiling_ms, APP_BACKOFF_CAP_MS);
+  backoff->failures++;
+  return prv_random_between(APP_BACKOFF_MIN_MS, ceiling_ms);
+}
+
+uint32_t app_backoff_next_success_delay_ms(sAppBackoff *backoff, uint32_t interval_ms) {
+  backoff->failures = 0;
+  const uint32_t spread_ms =
+    (uint32_t)(((uint64_t)interval_ms * APP_BACKOFF_INTERVAL_JITTER_PERMILLE) / 1000);
+  return prv_random_between(interval_ms - spread_ms, interval_ms + spread_ms);
+}
+
+uint32_t app_backoff_startup_delay_ms(void) {
+  return prv_random_between(0, APP_BACKOFF_STARTUP_JITTER_MS);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+//! @file
+//!
+//! @brief
+//! Jittered upload scheduling, so a fleet that loses connectivity at the same time does not
+//! retry and post in lockstep once it comes back
+//!
+//! - Failed posts are retried after a random delay in [APP_BACKOFF_MIN_MS, base * 2^failures],
+//!   capped at APP_BACKOFF_CAP_MS ("full jitter").
+//! - The regular post interval is spread by +/- APP_BACKOFF_INTERVAL_JITTER_PERMILLE.
+//! - The first post after boot waits a random delay of up to APP_BACKOFF_STARTUP_JITTER_MS,
+//!   for devices that were power cycled together.
+//!
+//! scripts/fleet_sim.py reads these defaults to simulate a fleet with this policy.
+
+#include <stdint.h>
+
+#ifndef APP_BACKOFF_BASE_MS
+  #define APP_BACKOFF_BASE_MS (5 * 1000)
+#endif
+
+#ifndef APP_BACKOFF_MIN_MS
+  #define APP_BACKOFF_MIN_MS (1000)
+#endif
+
+#ifndef APP_BACKOFF_CAP_MS
+  #define APP_BACKOFF_CAP_MS (10 * 60 * 1000)
+#endif
+
+#ifndef APP_BACKOFF_INTERVAL_JITTER_PERMILLE
+  #define APP_BACKOFF_INTERVAL_JITTER_PERMILLE (100)
+#endif
+
+#ifndef APP_BACKOFF_STARTUP_JITTER_MS
+  #define APP_BACKOFF_STARTUP_JITTER_MS (20 * 1000)
+#endif
+
+typedef struct {
+  //! Consecutive failures
+  uint32_t failures;
+} sAppBackoff;
+
+//! Records a failed attempt and returns the delay before the next one
+uint32_t app_backoff_next_failure_delay_ms(sAppBackoff *backoff);
+
+//! Records a successful attempt and returns interval_ms with jitter applied
+uint32_t app_backoff_next_success_delay_ms(sAppBackoff *backoff, uint32_t interval_ms);
+
+//! Returns a random delay for the first post after boot
+uint32_t app_backoff_startup_delay_ms(void);
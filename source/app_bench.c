@@ -0,0 +1,408 @@
+//! @file
+//!
+//! @brief
+//! Hot path microbenchmarks, see app_bench.h
+
+#include "app_bench.h"
+
+#include <FreeRTOS.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <task.h>
+
+#include "ap.h"
+#include "app_cycles.h"
+#include "app_heap_stats.h"
+#include "app_kvstore.h"
+#include "app_pool.h"
+#include "app_supervisor.h"
+#include "app_upload.h"
+#include "memfault/components.h"
+
+#define APP_BENCH_KVSTORE_KEY "bench"
+#define APP_BENCH_KVSTORE_VALUE_SIZE (64)
+// Every write programs at least one flash row
+#define APP_BENCH_MAX_FLASH_ITERATIONS (8)
+
+// A heartbeat-sized message posted as 128 byte chunks, the chunk size of the port's client
+#define APP_BENCH_MESSAGE_SIZE (1024)
+#define APP_BENCH_CHUNK_SIZE (128)
+// One line of `export` output
+#define APP_BENCH_BASE64_INPUT_SIZE (96)
+// Longest wait for a post in progress before the packetizer case is skipped, well within the
+// shell's supervisor deadline
+#define APP_BENCH_UPLOAD_WAIT_MS (5 * 1000)
+
+//! Runs one op of a case
+//!
+//! @param i Iteration number, to vary the input where that matters
+//! @return false if the op failed and the results are not meaningful
+typedef bool (*AppBenchFn)(uint32_t i);
+
+//! X(case, isolated, max_iterations)
+//!
+//! isolated cases don't block and run with the scheduler suspended
+#define APP_BENCH_CASES(X)                                \
+  X(packetizer, false, UINT32_MAX)                        \
+  X(chunk_transport, true, UINT32_MAX)                    \
+  X(base64_encode, true, UINT32_MAX)                      \
+  X(kvstore_write, false, APP_BENCH_MAX_FLASH_ITERATIONS) \
+  X(kvstore_read, false, UINT32_MAX)                      \
+  X(log_format, true, UINT32_MAX)                         \
+  X(authtype_parse, true, UINT32_MAX)                     \
+  X(scan_result_format, true, UINT32_MAX)                 \
+  X(pool_alloc_free, true, UINT32_MAX)                    \
+  X(coredump_regions, true, UINT32_MAX)
+
+typedef enum {
+#define APP_BENCH_CASE_ENUM(name_, isolated_, max_iterations_) kAppBenchCase_##name_,
+  APP_BENCH_CASES(APP_BENCH_CASE_ENUM)
+#undef APP_BENCH_CASE_ENUM
+  kAppBenchCase_NumCases,
+} eAppBenchCase;
+
+typedef struct {
+  const char *name;
+  AppBenchFn fn;
+  bool isolated;
+  uint32_t max_iterations;
+} sAppBenchCase;
+
+typedef struct {
+  uint32_t cycles;
+  uint32_t heap_bytes;
+} sAppBenchBaseline;
+
+typedef struct {
+  uint32_t iterations;
+  uint32_t min_cycles;
+  uint32_t mean_cycles;
+  uint32_t heap_bytes;
+  bool failed;
+} sAppBenchResult;
+
+static uint8_t s_message[APP_BENCH_MESSAGE_SIZE];
+static uint8_t s_chunk[APP_BENCH_CHUNK_SIZE];
+static char s_base64[MEMFAULT_BASE64_ENCODE_LEN(APP_BENCH_BASE64_INPUT_SIZE) + 1];
+static uint8_t s_kvstore_value[APP_BENCH_KVSTORE_VALUE_SIZE];
+static char s_line[AP_SCAN_RESULT_LINE_MAX_LEN];
+//! Set while `bench` holds off chunk posts, see app_upload_pause()
+static bool s_uploads_paused;
+
+//! Loads the next queued message into the packetizer and produces its first packet, what each
+//! post of the upload client starts with. The message is rewound before its last packet, so it
+//! isn't marked read and is still uploaded.
+static bool prv_bench_packetizer(uint32_t i) {
+  const sPacketizerConfig config = {
+    .enable_multi_packet_chunk = true,
+  };
+  sPacketizerMetadata metadata;
+  if (!s_uploads_paused || !memfault_packetizer_begin(&config, &metadata)) {
+    return false;
+  }
+  bool more_data = false;
+  if (metadata.single_chunk_message_length > sizeof(s_chunk)) {
+    size_t chunk_len = sizeof(s_chunk);
+    more_data = memfault_packetizer_get_next(s_chunk, &chunk_len) ==
+                kMemfaultPacketizerStatus_MoreDataForChunk;
+  }
+  memfault_packetizer_abort();
+  return more_data;
+}
+
+static void prv_read_message(uint32_t offset, void *buf, size_t buf_len) {
+  memcpy(buf, &s_message[offset], buf_len);
+}
+
+//! Splits a synthetic message into chunks with the SDK's chunk transport, the packetizer's inner
+//! loop, independently of the data queued
+static bool prv_bench_chunk_transport(uint32_t i) {
+  sMfltChunkTransportCtx ctx = {
+    .total_size = sizeof(s_message),
+    .read_msg = prv_read_message,
+  };
+  memfault_chunk_transport_get_chunk_info(&ctx);
+  bool more_data;
+  do {
+    size_t chunk_len = sizeof(s_chunk);
+    more_data = memfault_chunk_transport_get_next_chunk(&ctx, s_chunk, &chunk_len);
+  } while (more_data);
+  return true;
+}
+
+static bool prv_bench_base64_encode(uint32_t i) {
+  memfault_base64_encode(s_message, APP_BENCH_BASE64_INPUT_SIZE, s_base64);
+  return true;
+}
+
+static bool prv_bench_kvstore_write(uint32_t i) {
+  memcpy(s_kvstore_value, &i, sizeof(i));
+  return app_kvstore_write(APP_BENCH_KVSTORE_KEY, s_kvstore_value, sizeof(s_kvstore_value)) ==
+         CY_RSLT_SUCCESS;
+}
+
+static bool prv_bench_kvstore_read(uint32_t i) {
+  uint32_t len = sizeof(s_kvstore_value);
+  return app_kvstore_read(APP_BENCH_KVSTORE_KEY, s_kvstore_value, &len) == CY_RSLT_SUCCESS;
+}
+
+static bool prv_bench_log_format(uint32_t i) {
+  // What MEMFAULT_LOG_* costs before the line reaches the UART, for a typical status log
+  snprintf(s_line, sizeof(s_line), "Connection to Wi-Fi network failed. rv=0x%x, retrying in %d ms",
+           (int)i, 5000);
+  return true;
+}
+
+static bool prv_bench_authtype_parse(uint32_t i) {
+  // The last string compared, the worst case
+  return wifi_utils_str_to_authtype("wpa3_wpa2") == CY_WCM_SECURITY_WPA3_WPA2_PSK;
+}
+
+static bool prv_bench_scan_result_format(uint32_t i) {
+  static const cy_wcm_scan_result_t s_result = {
+    .SSID = "memfault-bench-network",
+    .BSSID = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55},
+    .signal_strength = -67,
+    .channel = 11,
+    .security = CY_WCM_SECURITY_WPA2_AES_PSK,
+  };
+  return ap_format_scan_result(&s_result, s_line, sizeof(s_line)) > 0;
+}
+
+static bool prv_bench_pool_alloc_free(uint32_t i) {
+  // What mbedTLS pays for each of its buffer allocations during a handshake
+  sAppPoolStats stats;
+  app_pool_get_stats(0, &stats);
+  void *block = app_pool_alloc(stats.block_size);
+  app_pool_free(block);
+  return block != NULL;
+}
+
+static bool prv_bench_coredump_regions(uint32_t i) {
+  // The part of a fault capture which doesn't wait on the flash
+  uint32_t stack_marker = i;
+  const sCoredumpCrashInfo crash_info = {
+    .stack_address = &stack_marker,
+  };
+  size_t num_regions = 0;
+  return (memfault_platform_coredump_get_regions(&crash_info, &num_regions) != NULL) &&
+         (num_regions > 0);
+}
+
+static const sAppBenchCase s_cases[kAppBenchCase_NumCases] = {
+#define APP_BENCH_CASE_INIT(name_, isolated_, max_iterations_) \
+  [kAppBenchCase_##name_] = {                                  \
+    .name = #name_,                                            \
+    .fn = prv_bench_##name_,                                   \
+    .isolated = (isolated_),                                   \
+    .max_iterations = (max_iterations_),                       \
+  },
+  APP_BENCH_CASES(APP_BENCH_CASE_INIT)
+#undef APP_BENCH_CASE_INIT
+};
+
+//! A cycles value of 0 is a case without a baseline
+static const sAppBenchBaseline s_baselines[kAppBenchCase_NumCases] = {
+#define APP_BENCH_BASELINE(name_, cycles_, heap_bytes_) \
+  [kAppBenchCase_##name_] = { .cycles = (cycles_), .heap_bytes = (heap_bytes_) },
+#include "app_bench_baselines.def"
+#undef APP_BENCH_BASELINE
+};
+
+//! Returns why a case can't run right now, NULL if it can
+static const char *prv_skip_reason(eAppBenchCase bench_case) {
+  if (bench_case != kAppBenchCase_packetizer) {
+    return NULL;
+  }
+  if (!s_uploads_paused) {
+    return "upload in progress";
+  }
+  const sPacketizerConfig config = {
+    .enable_multi_packet_chunk = true,
+  };
+  sPacketizerMetadata metadata;
+  if (!memfault_packetizer_begin(&config, &metadata)) {
+    return "no data queued";
+  }
+  memfault_packetizer_abort();
+  // Reading the only packet of a message would mark it read
+  return (metadata.single_chunk_message_length > sizeof(s_chunk)) ? NULL : "message too short";
+}
+
+static void prv_run_case(eAppBenchCase bench_case, uint32_t iterations, sAppBenchResult *result) {
+  const sAppBenchCase *info = &s_cases[bench_case];
+  iterations = MEMFAULT_MIN(iterations, info->max_iterations);
+
+  uint64_t total_cycles = 0;
+  uint32_t min_cycles = UINT32_MAX;
+  uint32_t heap_bytes = 0;
+  bool failed = false;
+
+  for (uint32_t batch = 0; batch < iterations; batch += APP_BENCH_BATCH_ITERATIONS) {
+    const uint32_t batch_end = MEMFAULT_MIN(iterations, batch + APP_BENCH_BATCH_ITERATIONS);
+    sAppHeapStats before;
+    sAppHeapStats after;
+
+    if (info->isolated) {
+      vTaskSuspendAll();
+    }
+    app_heap_stats_get(&before);
+    for (uint32_t i = batch; i < batch_end; i++) {
+      const uint32_t start = app_cycles_get();
+      failed |= !info->fn(i);
+      const uint32_t cycles = app_cycles_get() - start;
+      total_cycles += cycles;
+      min_cycles = MEMFAULT_MIN(min_cycles, cycles);
+    }
+    app_heap_stats_get(&after);
+    if (info->isolated) {
+      xTaskResumeAll();
+    }
+    heap_bytes += after.alloc_bytes - before.alloc_bytes;
+    // The timer task feeds the watchdog while the scheduler runs, as long as the shell checks in
+    app_supervisor_checkin(kAppSupervisorTask_Cli);
+  }
+
+  *result = (sAppBenchResult){
+    .iterations = iterations,
+    .min_cycles = min_cycles,
+    .mean_cycles = (uint32_t)(total_cycles / iterations),
+    .heap_bytes = heap_bytes / iterations,
+    .failed = failed,
+  };
+}
+
+static uint32_t prv_cycles_to_ns(uint32_t cycles) {
+  return (uint32_t)(((uint64_t)cycles * 1000) / (SystemCoreClock / 1000000UL));
+}
+
+//! Returns true if the case is slower or allocates more than its baseline allows
+static bool prv_regressed(const sAppBenchBaseline *baseline, const sAppBenchResult *result) {
+  const uint64_t limit_cycles =
+    ((uint64_t)baseline->cycles * (100 + APP_BENCH_TOLERANCE_PCT)) / 100;
+  return (result->min_cycles > limit_cycles) || (result->heap_bytes > baseline->heap_bytes);
+}
+
+static void prv_setup(void) {
+  app_cycles_init();
+  // The packetizer case shares the packetizer with the upload client
+  s_uploads_paused = app_upload_pause(APP_BENCH_UPLOAD_WAIT_MS);
+  for (size_t i = 0; i < sizeof(s_message); i++) {
+    s_message[i] = (uint8_t)(i * 31);
+  }
+  // The read case needs the key to exist even when only it is run
+  prv_bench_kvstore_write(0);
+}
+
+static void prv_teardown(void) {
+  app_kvstore_delete(APP_BENCH_KVSTORE_KEY);
+  if (s_uploads_paused) {
+    app_upload_resume();
+    s_uploads_paused = false;
+  }
+}
+
+static void prv_print_baselines(uint32_t iterations) {
+  for (eAppBenchCase bench_case = 0; bench_case < kAppBenchCase_NumCases; bench_case++) {
+    const char *skip_reason = prv_skip_reason(bench_case);
+    if (skip_reason != NULL) {
+      MEMFAULT_LOG_INFO("// %s skipped, %s", s_cases[bench_case].name, skip_reason);
+      continue;
+    }
+    sAppBenchResult result;
+    prv_run_case(bench_case, iterations, &result);
+    MEMFAULT_LOG_INFO("APP_BENCH_BASELINE(%s, %" PRIu32 ", %" PRIu32 ")%s",
+                      s_cases[bench_case].name, result.min_cycles, result.heap_bytes,
+                      result.failed ? " // failed, don't use" : "");
+  }
+}
+
+int app_bench_cli_cmd(int argc, char *argv[]) {
+  const char *selected = NULL;
+  bool baseline = false;
+  int arg = 1;
+  if ((argc > arg) && (strcmp(argv[arg], "baseline") == 0)) {
+    baseline = true;
+    arg++;
+  } else if ((argc > arg) && (strcmp(argv[arg], "all") != 0) &&
+             ((argv[arg][0] < '0') || (argv[arg][0] > '9'))) {
+    selected = argv[arg];
+    arg++;
+  }
+  uint32_t iterations =
+    (argc > arg) ? (uint32_t)strtoul(argv[arg], NULL, 0) : APP_BENCH_DEFAULT_ITERATIONS;
+  if (iterations == 0) {
+    iterations = 1;
+  }
+
+  prv_setup();
+  if (baseline) {
+    prv_print_baselines(iterations);
+    prv_teardown();
+    return 0;
+  }
+
+  MEMFAULT_LOG_INFO("%-18s %5s %10s %10s %10s %9s %10s", "Case", "Iter", "Min cyc", "Mean cyc",
+                    "ns/op", "Heap B/op", "Baseline");
+  uint32_t run = 0;
+  uint32_t regressions = 0;
+  uint32_t unchecked = 0;
+  for (eAppBenchCase bench_case = 0; bench_case < kAppBenchCase_NumCases; bench_case++) {
+    const sAppBenchCase *info = &s_cases[bench_case];
+    if ((selected != NULL) && (strcmp(selected, info->name) != 0)) {
+      continue;
+    }
+    run++;
+
+    const char *skip_reason = prv_skip_reason(bench_case);
+    if (skip_reason != NULL) {
+      MEMFAULT_LOG_INFO("%-18s skipped, %s", info->name, skip_reason);
+      unchecked++;
+      continue;
+    }
+
+    sAppBenchResult result;
+    prv_run_case(bench_case, iterations, &result);
+
+    const sAppBenchBaseline *baseline_info = &s_baselines[bench_case];
+    const char *verdict;
+    if (result.failed) {
+      verdict = "ERROR";
+      regressions++;
+    } else if (baseline_info->cycles == 0) {
+      verdict = "no baseline";
+      unchecked++;
+    } else if (prv_regressed(baseline_info, &result)) {
+      verdict = "REGRESSED";
+      regressions++;
+    } else {
+      verdict = "ok";
+    }
+    MEMFAULT_LOG_INFO("%-18s %5" PRIu32 " %10" PRIu32 " %10" PRIu32 " %10" PRIu32 " %9" PRIu32
+                      " %10" PRIu32 " %s",
+                      info->name, result.iterations, result.min_cycles, result.mean_cycles,
+                      prv_cycles_to_ns(result.min_cycles), result.heap_bytes,
+                      baseline_info->cycles, verdict);
+  }
+  prv_teardown();
+
+  if (run == 0) {
+    MEMFAULT_LOG_ERROR("Unknown case '%s'", selected);
+    return -1;
+  }
+  if (regressions != 0) {
+    MEMFAULT_LOG_INFO("bench: FAIL (%" PRIu32 " of %" PRIu32 " cases)", regressions, run);
+    return -1;
+  }
+  if (unchecked != 0) {
+    // Not checked is not passed, capture the missing baselines with `bench baseline`
+    MEMFAULT_LOG_INFO("bench: INCOMPLETE (%" PRIu32 " of %" PRIu32 " cases not checked)",
+                      unchecked, run);
+    return -1;
+  }
+  MEMFAULT_LOG_INFO("bench: PASS");
+  return 0;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+//! @file
+//!
+//! @brief
+//! Microbenchmarks of the operations the firmware runs constantly, checked against the baselines
+//! in configs/app_bench_baselines.def
+//!
+//! Each case reports cycles and nanoseconds per op and heap bytes allocated per op. Cases which
+//! don't block run with the scheduler suspended, so other tasks don't add to the numbers. The
+//! scheduler is resumed every APP_BENCH_BATCH_ITERATIONS iterations so the watchdog keeps being
+//! fed. The kv-store cases run with the scheduler running and are limited to a few iterations to
+//! limit flash wear. The packetizer case reads the next queued message and rewinds it, with chunk
+//! posts held off while `bench` runs.
+
+#ifndef APP_BENCH_DEFAULT_ITERATIONS
+  #define APP_BENCH_DEFAULT_ITERATIONS (64)
+#endif
+
+//! How much slower than its baseline a case may get before it counts as a regression
+#ifndef APP_BENCH_TOLERANCE_PCT
+  #define APP_BENCH_TOLERANCE_PCT (15)
+#endif
+
+//! Iterations run back to back with the scheduler suspended
+#ifndef APP_BENCH_BATCH_ITERATIONS
+  #define APP_BENCH_BATCH_ITERATIONS (16)
+#endif
+
+//! Shell command which runs the benchmarks
+//!
+//! Prints one row per case and "bench: PASS" at the end if every case ran within its baseline.
+//! Returns non-zero if a case regressed or failed, or wasn't checked for lack of a baseline or of
+//! queued data. `bench baseline` prints the results as lines for configs/app_bench_baselines.def
+//! instead.
+//!
+//! Usage: bench [case|baseline] [iterations]
+int app_bench_cli_cmd(int argc, char *argv[]);
@@ -0,0 +1,150 @@
+//! @file
+//!
+//! @brief
+//! Boot phase timing, see app_boot_profile.h
+//!
+//! Marks made before the scheduler starts use the cycle counter. Later marks are timed with the
+//! tick count, relative to the last pre-scheduler mark: the cycle counter stops while the core
+//! sleeps in the idle task, and the tick count is stepped over the sleep.
+
+#include "app_boot_profile.h"
+
+#include <FreeRTOS.h>
+#include <inttypes.h>
+#include <task.h>
+
+#include "app_coredump.h"
+#include "app_cycles.h"
+#include "app_metrics.h"
+#include "memfault/components.h"
+
+typedef struct {
+  uint32_t cycles;
+  uint32_t ticks;
+  bool scheduler_running;
+  bool recorded;
+} sAppBootMark;
+
+static uint32_t s_start_cycles;
+// Cycle count of the last mark made before the scheduler started
+static uint32_t s_anchor_cycles;
+static sAppBootMark s_marks[kAppBootPhase_NumPhases];
+static uint32_t s_reported_phases;
+
+static const char *const s_phase_descriptions[kAppBootPhase_NumPhases] = {
+#define APP_BOOT_PHASE_DESCRIPTION(name_, desc_) desc_,
+  APP_BOOT_PHASES(APP_BOOT_PHASE_DESCRIPTION)
+#undef APP_BOOT_PHASE_DESCRIPTION
+};
+
+void app_boot_profile_start(void) {
+  app_cycles_init();
+  s_start_cycles = app_cycles_get();
+  s_anchor_cycles = s_start_cycles;
+}
+
+void app_boot_profile_mark(eAppBootPhase phase) {
+  if ((phase >= kAppBootPhase_NumPhases) || s_marks[phase].recorded) {
+    return;
+  }
+  const bool scheduler_running = xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED;
+  const uint32_t cycles = app_cycles_get();
+  s_marks[phase] = (sAppBootMark){
+    .cycles = cycles,
+    .ticks = scheduler_running ? xTaskGetTickCount() : 0,
+    .scheduler_running = scheduler_running,
+    .recorded = true,
+  };
+  if (!scheduler_running) {
+    s_anchor_cycles = cycles;
+  }
+}
+
+static uint32_t prv_mark_to_us(const sAppBootMark *mark) {
+  if (!mark->scheduler_running) {
+    return app_cycles_to_us(mark->cycles - s_start_cycles);
+  }
+
+  const uint64_t us = app_cycles_to_us(s_anchor_cycles - s_start_cycles) +
+                      (uint64_t)mark->ticks * portTICK_PERIOD_MS * 1000;
+  return (uint32_t)MEMFAULT_MIN(us, UINT32_MAX);
+}
+
+bool app_boot_profile_get_us(eAppBootPhase phase, uint32_t *us_since_start) {
+  if ((phase >= kAppBootPhase_NumPhases) || !s_marks[phase].recorded) {
+    return false;
+  }
+  *us_since_start = prv_mark_to_us(&s_marks[phase]);
+  return true;
+}
+
+static void prv_report_phase_ms(eAppBootPhase phase, AppMetricId key) {
+  uint32_t us;
+  if ((s_reported_phases & (1UL << phase)) || !app_boot_profile_get_us(phase, &us)) {
+    return;
+  }
+  app_metrics_set_unsigned(key, us / 1000);
+  s_reported_phases |= (1UL << phase);
+}
+
+//! Reports the time from the fault to the coredump being accepted, once after a crash
+static void prv_report_crash_to_cloud(void) {
+  sAppCoredumpCaptureStats crash;
+  uint32_t coredump_us;
+  if ((s_reported_phases & (1UL << kAppBootPhase_CoredumpAccepted)) ||
+      !app_coredump_get_last_capture(&crash) ||
+      !app_boot_profile_get_us(kAppBootPhase_CoredumpAccepted, &coredump_us)) {
+    return;
+  }
+  APP_METRIC_SET(crash_to_cloud_ms,
+                 (uint32_t)(((uint64_t)crash.fault_to_reboot_us + coredump_us) / 1000));
+}
+
+void app_boot_profile_collect_metrics(void) {
+  prv_report_crash_to_cloud();
+  prv_report_phase_ms(kAppBootPhase_HttpTaskStart, APP_METRIC_KEY(boot_scheduler_ms));
+  prv_report_phase_ms(kAppBootPhase_WifiConnected, APP_METRIC_KEY(boot_wifi_connected_ms));
+  prv_report_phase_ms(kAppBootPhase_FirstUpload, APP_METRIC_KEY(boot_first_upload_ms));
+  prv_report_phase_ms(kAppBootPhase_CoredumpAccepted, APP_METRIC_KEY(boot_coredump_upload_ms));
+}
+
+static uint32_t prv_previous_mark_us(uint32_t us) {
+  uint32_t previous_us = 0;
+  for (eAppBootPhase phase = 0; phase < kAppBootPhase_NumPhases; phase++) {
+    uint32_t phase_us;
+    if (app_boot_profile_get_us(phase, &phase_us) && (phase_us < us)) {
+      previous_us = MEMFAULT_MAX(previous_us, phase_us);
+    }
+  }
+  return previous_us;
+}
+
+int app_boot_profile_cli_cmd(int argc, char *argv[]) {
+  sAppCoredumpCaptureStats crash;
+  const bool after_crash = app_coredump_get_last_capture(&crash);
+  if (after_crash) {
+    MEMFAULT_LOG_INFO("Crash reboot, fault to reboot: %" PRIu32 " us", crash.fault_to_reboot_us);
+  }
+
+  MEMFAULT_LOG_INFO("%-42s %10s %10s", "Phase", "At (us)", "+ (us)");
+  for (eAppBootPhase phase = 0; phase < kAppBootPhase_NumPhases; phase++) {
+    uint32_t us;
+    if (!app_boot_profile_get_us(phase, &us)) {
+      if ((phase != kAppBootPhase_CoredumpAccepted) || after_crash) {
+        MEMFAULT_LOG_INFO("%-42s %10s", s_phase_descriptions[phase], "pending");
+      }
+      continue;
+    }
+    // Phases can run in parallel, so show the time since the previous mark in time rather than
+    // in the list
+    MEMFAULT_LOG_INFO("%-42s %10" PRIu32 " %10" PRIu32, s_phase_descriptions[phase], us,
+                      us - prv_previous_mark_us(us));
+  }
+
+  uint32_t coredump_us;
+  if (after_crash && app_boot_profile_get_us(kAppBootPhase_CoredumpAccepted, &coredump_us)) {
+    MEMFAULT_LOG_INFO("Fault to coredump accepted: %" PRIu32 " ms (+ reset and startup code)",
+                      (uint32_t)(((uint64_t)crash.fault_to_reboot_us + coredump_us) / 1000));
+  }
+  return 0;
+}
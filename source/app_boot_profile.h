@@ -0,0 +1,55 @@
+#pragma once
+
+//! @file
+//!
+//! @brief
+//! Boot phase timing from main() to the first successful upload
+//!
+//! Each phase is marked when it completes, so its duration is the time since the previous mark.
+//! Phases are timed with the cycle counter until the scheduler starts and with the RTOS tick
+//! after that: the cycle counter stops in tickless idle sleep and wraps in under a minute.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//! X(name, description), in the order the phases complete on a normal boot
+#define APP_BOOT_PHASES(X)                                                  \
+  X(Bsp, "cybsp_init")                                                      \
+  X(RetargetIo, "retarget-io, LED")                                         \
+  X(Qspi, "QSPI flash, XIP")                                                \
+  X(Log, "cy_log_init")                                                     \
+  X(KvStore, "kv-store init")                                               \
+  X(MemfaultBoot, "coredump storage, memfault_platform_boot")               \
+  X(TasksCreated, "task creation")                                          \
+  X(HttpTaskStart, "scheduler start")                                       \
+  X(WcmInit, "cy_wcm_init")                                                 \
+  X(WifiConnected, "Wi-Fi auto-connect")                                    \
+  X(SocketInit, "cy_socket_init")                                           \
+  X(CaLoaded, "root CA load")                                               \
+  X(FirstUpload, "first chunk upload accepted")                             \
+  X(CoredumpAccepted, "coredump upload accepted")
+
+typedef enum {
+#define APP_BOOT_PHASE_ENUM(name_, desc_) kAppBootPhase_##name_,
+  APP_BOOT_PHASES(APP_BOOT_PHASE_ENUM)
+#undef APP_BOOT_PHASE_ENUM
+  kAppBootPhase_NumPhases,
+} eAppBootPhase;
+
+//! Starts the profile. Call first thing in main().
+void app_boot_profile_start(void);
+
+//! Records the completion of a phase. Only the first mark of each phase is kept.
+void app_boot_profile_mark(eAppBootPhase phase);
+
+//! Returns the time from app_boot_profile_start() to the end of a phase, saturating after about
+//! 71 minutes
+//!
+//! @return false if the phase has not completed yet
+bool app_boot_profile_get_us(eAppBootPhase phase, uint32_t *us_since_start);
+
+//! Records boot times in the first heartbeat after they are known
+void app_boot_profile_collect_metrics(void);
+
+//! Shell command which prints the boot timeline, and the crash timeline after a crash reboot
+int app_boot_profile_cli_cmd(int argc, char *argv[]);
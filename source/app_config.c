@@ -0,0 +1,239 @@
+//! @file
+//!
+//! @brief
+//! Runtime configuration registry, see app_config.h
+
+#include "app_config.h"
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "app_kvstore.h"
+#include "app_log.h"
+#include "cy_syslib.h"
+
+//! Keys are saved as "cfg_<name>"
+#define APP_CONFIG_KVSTORE_PREFIX "cfg_"
+#define APP_CONFIG_KVSTORE_KEY_MAX_LEN (32)
+
+typedef struct {
+  const char *name;
+  size_t offset;
+  uint8_t size;
+  int64_t default_value;
+  int64_t min;
+  int64_t max;
+} sAppConfigKeyInfo;
+
+typedef struct {
+  eAppConfigKey key;
+  AppConfigChangedCb callback;
+} sAppConfigCallback;
+
+sAppConfig g_app_config = {
+#define APP_CONFIG_KEY_DEFAULT(name_, type_, default_, min_, max_) .name_ = (default_),
+  APP_CONFIG_KEYS(APP_CONFIG_KEY_DEFAULT)
+#undef APP_CONFIG_KEY_DEFAULT
+};
+
+static const sAppConfigKeyInfo s_keys[kAppConfigKey_NumKeys] = {
+#define APP_CONFIG_KEY_INFO(name_, type_, default_, min_, max_) \
+  [kAppConfigKey_##name_] = {                                   \
+    .name = #name_,                                             \
+    .offset = offsetof(sAppConfig, name_),                      \
+    .size = sizeof(type_),                                      \
+    .default_value = (default_),                                \
+    .min = (min_),                                              \
+    .max = (max_),                                              \
+  },
+  APP_CONFIG_KEYS(APP_CONFIG_KEY_INFO)
+#undef APP_CONFIG_KEY_INFO
+};
+
+#define APP_CONFIG_KEY_CHECK(name_, type_, default_, min_, max_)           \
+  MEMFAULT_STATIC_ASSERT(((min_) <= (default_)) && ((default_) <= (max_)), \
+                         "Default of " #name_ " is out of bounds");        \
+  MEMFAULT_STATIC_ASSERT(((min_) >= 0) && ((max_) <= (type_)-1),           \
+                         "Bounds of " #name_ " don't fit its type");       \
+  MEMFAULT_STATIC_ASSERT((type_)-1 > 0, #name_ " must be unsigned");       \
+  MEMFAULT_STATIC_ASSERT((sizeof(type_) == 1) || (sizeof(type_) == 2) ||   \
+                           (sizeof(type_) == 4),                           \
+                         "Unsupported type for " #name_);                  \
+  MEMFAULT_STATIC_ASSERT(sizeof(APP_CONFIG_KVSTORE_PREFIX #name_) <=       \
+                           APP_CONFIG_KVSTORE_KEY_MAX_LEN,                 \
+                         "kv-store key of " #name_ " is too long");
+APP_CONFIG_KEYS(APP_CONFIG_KEY_CHECK)
+#undef APP_CONFIG_KEY_CHECK
+
+static sAppConfigCallback s_callbacks[APP_CONFIG_MAX_CALLBACKS];
+static size_t s_num_callbacks;
+
+static uint32_t prv_get(eAppConfigKey key) {
+  const sAppConfigKeyInfo *info = &s_keys[key];
+  // Little-endian, so the field's bytes are the low bytes of the value
+  uint32_t value = 0;
+  memcpy(&value, (const uint8_t *)&g_app_config + info->offset, info->size);
+  return value;
+}
+
+//! Stores a value in the RAM copy. The value must be within the key's bounds.
+static void prv_put(eAppConfigKey key, int64_t value) {
+  const sAppConfigKeyInfo *info = &s_keys[key];
+  uint8_t *field = (uint8_t *)&g_app_config + info->offset;
+  // Little-endian, so the low bytes of the value are the field's bytes
+  const uint32_t raw = (uint32_t)value;
+  const uint32_t irq_state = Cy_SysLib_EnterCriticalSection();
+  memcpy(field, &raw, info->size);
+  Cy_SysLib_ExitCriticalSection(irq_state);
+}
+
+static bool prv_in_bounds(eAppConfigKey key, int64_t value) {
+  return (value >= s_keys[key].min) && (value <= s_keys[key].max);
+}
+
+static void prv_kvstore_key(eAppConfigKey key, char *buf, size_t buf_len) {
+  snprintf(buf, buf_len, APP_CONFIG_KVSTORE_PREFIX "%s", s_keys[key].name);
+}
+
+static void prv_notify(eAppConfigKey key) {
+  for (size_t i = 0; i < s_num_callbacks; i++) {
+    if (s_callbacks[i].key == key) {
+      s_callbacks[i].callback(key);
+    }
+  }
+}
+
+//! Loads one key, keeping the default if nothing valid is saved
+static void prv_load(eAppConfigKey key) {
+  char kvstore_key[APP_CONFIG_KVSTORE_KEY_MAX_LEN];
+  prv_kvstore_key(key, kvstore_key, sizeof(kvstore_key));
+  if (!app_kvstore_key_exists(kvstore_key)) {
+    return;
+  }
+
+  uint32_t value = 0;
+  uint32_t len = sizeof(value);
+  const cy_rslt_t rv = app_kvstore_read(kvstore_key, (uint8_t *)&value, &len);
+  if ((rv != CY_RSLT_SUCCESS) || (len != sizeof(value)) || !prv_in_bounds(key, value)) {
+    APP_LOG_WARN("Ignoring saved config %s, using the default", s_keys[key].name);
+    return;
+  }
+  prv_put(key, value);
+}
+
+void app_config_init(void) {
+  for (eAppConfigKey key = 0; key < kAppConfigKey_NumKeys; key++) {
+    prv_load(key);
+  }
+}
+
+bool app_config_set(eAppConfigKey key, int64_t value) {
+  if ((key >= kAppConfigKey_NumKeys) || !prv_in_bounds(key, value)) {
+    return false;
+  }
+  char kvstore_key[APP_CONFIG_KVSTORE_KEY_MAX_LEN];
+  prv_kvstore_key(key, kvstore_key, sizeof(kvstore_key));
+  // Saved as 32 bits whatever the field's size, so a key's type can change without a migration
+  const uint32_t saved = (uint32_t)value;
+  if (app_kvstore_write(kvstore_key, (const uint8_t *)&saved, sizeof(saved)) != CY_RSLT_SUCCESS) {
+    return false;
+  }
+  prv_put(key, value);
+  prv_notify(key);
+  return true;
+}
+
+bool app_config_register_callback(eAppConfigKey key, AppConfigChangedCb callback) {
+  if (s_num_callbacks >= MEMFAULT_ARRAY_SIZE(s_callbacks)) {
+    return false;
+  }
+  s_callbacks[s_num_callbacks++] = (sAppConfigCallback){
+    .key = key,
+    .callback = callback,
+  };
+  return true;
+}
+
+static bool prv_find_key(const char *name, eAppConfigKey *key) {
+  for (eAppConfigKey i = 0; i < kAppConfigKey_NumKeys; i++) {
+    if (strcmp(name, s_keys[i].name) == 0) {
+      *key = i;
+      return true;
+    }
+  }
+  MEMFAULT_LOG_ERROR("Unknown config key '%s'", name);
+  return false;
+}
+
+static void prv_print_key(eAppConfigKey key) {
+  const sAppConfigKeyInfo *info = &s_keys[key];
+  MEMFAULT_LOG_INFO("%-24s %10" PRIu32 " %10" PRIu32 " %10" PRIu32 " %10" PRIu32, info->name,
+                    prv_get(key), (uint32_t)info->default_value, (uint32_t)info->min,
+                    (uint32_t)info->max);
+}
+
+static void prv_print_header(void) {
+  MEMFAULT_LOG_INFO("%-24s %10s %10s %10s %10s", "Key", "Value", "Default", "Min", "Max");
+}
+
+int app_config_cli_cmd(int argc, char *argv[]) {
+  if (argc < 2) {
+    prv_print_header();
+    for (eAppConfigKey key = 0; key < kAppConfigKey_NumKeys; key++) {
+      prv_print_key(key);
+    }
+    return 0;
+  }
+
+  eAppConfigKey key;
+  if ((strcmp(argv[1], "get") == 0) && (argc == 3)) {
+    if (!prv_find_key(argv[2], &key)) {
+      return -1;
+    }
+    prv_print_header();
+    prv_print_key(key);
+    return 0;
+  }
+
+  if ((strcmp(argv[1], "set") == 0) && (argc == 4)) {
+    if (!prv_find_key(argv[2], &key)) {
+      return -1;
+    }
+    char *end;
+    const int64_t value = strtoll(argv[3], &end, 0);
+    if ((*end != '\0') || !prv_in_bounds(key, value)) {
+      MEMFAULT_LOG_ERROR("%s must be a number from %" PRIu32 " to %" PRIu32, s_keys[key].name,
+                         (uint32_t)s_keys[key].min, (uint32_t)s_keys[key].max);
+      return -1;
+    }
+    if (!app_config_set(key, value)) {
+      MEMFAULT_LOG_ERROR("Failed to save %s", s_keys[key].name);
+      return -1;
+    }
+    prv_print_header();
+    prv_print_key(key);
+    return 0;
+  }
+
+  if ((strcmp(argv[1], "reset") == 0) && (argc == 3)) {
+    if (!prv_find_key(argv[2], &key)) {
+      return -1;
+    }
+    char kvstore_key[APP_CONFIG_KVSTORE_KEY_MAX_LEN];
+    prv_kvstore_key(key, kvstore_key, sizeof(kvstore_key));
+    if (app_kvstore_key_exists(kvstore_key)) {
+      app_kvstore_delete(kvstore_key);
+    }
+    prv_put(key, s_keys[key].default_value);
+    prv_notify(key);
+    prv_print_header();
+    prv_print_key(key);
+    return 0;
+  }
+
+  MEMFAULT_LOG_ERROR("Usage: config [get <key> | set <key> <value> | reset <key>]");
+  return -1;
+}
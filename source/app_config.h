@@ -0,0 +1,91 @@
+#pragma once
+
+//! @file
+//!
+//! @brief
+//! Runtime configuration for knobs that used to be compile-time constants
+//!
+//! Each key in APP_CONFIG_KEYS has a C type, a default and bounds. app_config_init() loads the
+//! values saved in the kv-store into a RAM copy, and APP_CONFIG_GET() reads that copy, so hot
+//! paths pay for a load and nothing else. `config set` validates a new value against the bounds,
+//! saves it and notifies the callbacks registered for the key. Values which fail validation at
+//! boot, e.g. after the bounds changed, fall back to the default.
+
+#include <FreeRTOS.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "memfault/components.h"
+
+#if !defined(MEMFAULT_POST_SEND_INTERVAL_MS)
+  #define MEMFAULT_POST_SEND_INTERVAL_MS              (60 * 1000)
+#endif
+
+//! Retry interval while a coredump is waiting for upload
+#if !defined(MEMFAULT_CRASH_RETRY_INTERVAL_MS)
+  #define MEMFAULT_CRASH_RETRY_INTERVAL_MS            (5 * 1000)
+#endif
+
+#ifndef APP_CONFIG_MAX_CALLBACKS
+  #define APP_CONFIG_MAX_CALLBACKS (8)
+#endif
+
+//! X(name, unsigned type, default, min, max)
+#define APP_CONFIG_KEYS(X)                                                                     \
+  X(post_interval_ms, uint32_t, MEMFAULT_POST_SEND_INTERVAL_MS, 10 * 1000,                     \
+    24 * 60 * 60 * 1000)                                                                       \
+  X(crash_retry_interval_ms, uint32_t, MEMFAULT_CRASH_RETRY_INTERVAL_MS, 1000, 10 * 60 * 1000) \
+  X(wifi_boot_retries, uint8_t, 2, 1, 20)                                                      \
+  X(wifi_join_retries, uint8_t, 5, 1, 20)                                                      \
+  X(wifi_retry_delay_ms, uint32_t, 5 * 1000, 500, 60 * 1000)                                   \
+  X(http_task_priority, uint8_t, 1, 1, configMAX_PRIORITIES - 1)                               \
+  X(cli_task_priority, uint8_t, 1, 1, configMAX_PRIORITIES - 1)                                \
+  X(log_save_level, uint8_t, kMemfaultPlatformLogLevel_Info, kMemfaultPlatformLogLevel_Debug,  \
+    kMemfaultPlatformLogLevel_Error)                                                           \
+  X(log_dedup, uint8_t, 1, 0, 1)                                                               \
+  X(roam_enabled, uint8_t, 1, 0, 1)                                                            \
+  X(roam_rssi_threshold_neg_dbm, uint8_t, 70, 40, 90)                                          \
+  X(roam_hysteresis_db, uint8_t, 8, 3, 30)                                                     \
+  X(roam_min_bytes_per_s, uint32_t, 512, 0, 1000 * 1000)                                       \
+  X(roam_scan_interval_ms, uint32_t, 5 * 60 * 1000, 30 * 1000, 24 * 60 * 60 * 1000)
+
+typedef enum {
+#define APP_CONFIG_KEY_ENUM(name_, type_, default_, min_, max_) kAppConfigKey_##name_,
+  APP_CONFIG_KEYS(APP_CONFIG_KEY_ENUM)
+#undef APP_CONFIG_KEY_ENUM
+  kAppConfigKey_NumKeys,
+} eAppConfigKey;
+
+typedef struct {
+#define APP_CONFIG_KEY_FIELD(name_, type_, default_, min_, max_) type_ name_;
+  APP_CONFIG_KEYS(APP_CONFIG_KEY_FIELD)
+#undef APP_CONFIG_KEY_FIELD
+} sAppConfig;
+
+//! RAM copy of the configuration, only written by app_config.c
+extern sAppConfig g_app_config;
+
+//! Reads a key, e.g. APP_CONFIG_GET(post_interval_ms)
+#define APP_CONFIG_GET(name_) (g_app_config.name_)
+
+//! Called after a key changed, from the task which changed it
+typedef void (*AppConfigChangedCb)(eAppConfigKey key);
+
+//! Loads the saved configuration. Must be called after app_kvstore_init() and before any task
+//! reads the configuration.
+void app_config_init(void);
+
+//! Validates, saves and applies a new value
+//!
+//! @return false if the value is out of bounds or could not be saved
+bool app_config_set(eAppConfigKey key, int64_t value);
+
+//! Registers a callback for changes to a key
+//!
+//! @return false if all APP_CONFIG_MAX_CALLBACKS slots are taken
+bool app_config_register_callback(eAppConfigKey key, AppConfigChangedCb callback);
+
+//! Shell command to list, read, change and reset configuration keys
+//!
+//! Usage: config [get <key> | set <key> <value> | reset <key>]
+int app_config_cli_cmd(int argc, char *argv[]);
@@ -0,0 +1,310 @@
+//! @file
+//!
+//! Copyright (c) Memfault, Inc.
+//! See License.txt for details
+//!
+//! Selects the memory regions saved in a coredump. Enabled by
+//! MEMFAULT_PLATFORM_COREDUMP_STORAGE_REGIONS_CUSTOM in configs/memfault_platform_config.h.
+//!
+//! Regions are saved in order and the last ones are truncated when coredump storage fills up,
+//! so small, high-value regions go first and bulk captures go last.
+//!
+//! The storage erase/write calls made by the SDK while saving and the final reboot are wrapped at
+//! link time (see the Makefile) to time the capture. Results are kept in no-init RAM and reported
+//! after reboot.
+
+#include "app_coredump.h"
+
+#include <FreeRTOS.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <task.h>
+
+#include "app_coredump_storage.h"
+#include "app_cycles.h"
+#include "app_log.h"
+#include "app_metrics.h"
+#include "app_placement.h"
+#include "app_supervisor.h"
+#include "cy_syslib.h"
+#include "memfault/components.h"
+#include "memfault/ports/freertos_coredump.h"
+
+#ifndef APP_COREDUMP_DEFAULT_MODE
+  #define APP_COREDUMP_DEFAULT_MODE kAppCoredumpMode_Selective
+#endif
+
+// Symbols exported by the linker script
+extern uint32_t __data_start__;
+extern uint32_t __StackTop;
+// FreeRTOS kernel state (task lists, timer lists) grouped by memfault_bss.ld
+extern uint32_t __memfault_capture_bss_start;
+extern uint32_t __memfault_capture_bss_end;
+
+//! Amount of the active stack to capture ahead of everything else, enough to unwind the crash
+#define MEMFAULT_COREDUMP_ACTIVE_STACK_SIZE (512)
+
+//! TCB + stack for every tracked task
+#define MEMFAULT_COREDUMP_MAX_TASK_REGIONS (MEMFAULT_PLATFORM_MAX_TRACKED_TASKS * 2)
+
+//! active stack + registered regions + kernel state + tasks (or all of RAM)
+#define MEMFAULT_COREDUMP_MAX_REGIONS \
+  (1 + APP_COREDUMP_MAX_REGISTERED_REGIONS + 1 + MEMFAULT_COREDUMP_MAX_TASK_REGIONS)
+
+#define APP_COREDUMP_CAPTURE_MAGIC 0x434d4954
+
+//! Default delay of `coredump_stats erase_fault`, well within a sector erase
+#define APP_COREDUMP_ERASE_FAULT_DELAY_MS (100)
+
+typedef struct {
+  uint32_t magic;
+  uint32_t fault_cycles;
+  uint32_t start_cycles;
+  uint32_t end_cycles;
+  uint32_t reboot_cycles;
+  uint32_t stored_bytes;
+  uint32_t write_count;
+  bool storage_pre_erased;
+} sAppCoredumpCaptureRecord;
+
+// Survives the reboot which follows the fault
+CY_NOINIT static sAppCoredumpCaptureRecord s_capture_record;
+
+static sAppCoredumpCaptureStats s_last_capture;
+static bool s_last_capture_valid;
+static bool s_last_capture_reported;
+
+static eAppCoredumpMode s_mode = APP_COREDUMP_DEFAULT_MODE;
+
+static struct {
+  const void *start;
+  size_t size;
+} s_registered_regions[APP_COREDUMP_MAX_REGISTERED_REGIONS];
+static size_t s_num_registered_regions;
+
+void app_coredump_set_mode(eAppCoredumpMode mode) {
+  s_mode = mode;
+}
+
+eAppCoredumpMode app_coredump_get_mode(void) {
+  return s_mode;
+}
+
+bool app_coredump_register_region(const void *start, size_t size) {
+  if (s_num_registered_regions >= APP_COREDUMP_MAX_REGISTERED_REGIONS) {
+    return false;
+  }
+  s_registered_regions[s_num_registered_regions].start = start;
+  s_registered_regions[s_num_registered_regions].size = size;
+  s_num_registered_regions++;
+  return true;
+}
+
+APP_RAMFUNC static size_t prv_clamp_to_ram(const void *start, size_t desired_size) {
+  const uintptr_t ram_start = (uintptr_t)&__data_start__;
+  const uintptr_t ram_end = (uintptr_t)&__StackTop;
+  const uintptr_t addr = (uintptr_t)start;
+  if ((addr < ram_start) || (addr >= ram_end)) {
+    return 0;
+  }
+  return MEMFAULT_MIN(desired_size, ram_end - addr);
+}
+
+APP_RAMFUNC const sMfltCoredumpRegion *memfault_platform_coredump_get_regions(
+  const sCoredumpCrashInfo *crash_info, size_t *num_regions) {
+  static sMfltCoredumpRegion s_coredump_regions[MEMFAULT_COREDUMP_MAX_REGIONS];
+  size_t region_idx = 0;
+
+  s_coredump_regions[region_idx++] = MEMFAULT_COREDUMP_MEMORY_REGION_INIT(
+    crash_info->stack_address,
+    prv_clamp_to_ram(crash_info->stack_address, MEMFAULT_COREDUMP_ACTIVE_STACK_SIZE));
+
+  for (size_t i = 0; i < s_num_registered_regions; i++) {
+    s_coredump_regions[region_idx++] = MEMFAULT_COREDUMP_MEMORY_REGION_INIT(
+      s_registered_regions[i].start, s_registered_regions[i].size);
+  }
+
+  if (s_mode == kAppCoredumpMode_Selective) {
+    const uintptr_t kernel_start = (uintptr_t)&__memfault_capture_bss_start;
+    const uintptr_t kernel_end = (uintptr_t)&__memfault_capture_bss_end;
+    s_coredump_regions[region_idx++] =
+      MEMFAULT_COREDUMP_MEMORY_REGION_INIT((void *)kernel_start, kernel_end - kernel_start);
+
+    // TCBs and the in-use portion of each task stack
+    region_idx += memfault_freertos_get_task_regions(
+      &s_coredump_regions[region_idx], MEMFAULT_ARRAY_SIZE(s_coredump_regions) - region_idx);
+  } else {
+    const uintptr_t ram_start = (uintptr_t)&__data_start__;
+    const uintptr_t ram_end = (uintptr_t)&__StackTop;
+    s_coredump_regions[region_idx++] =
+      MEMFAULT_COREDUMP_MEMORY_REGION_INIT((void *)ram_start, ram_end - ram_start);
+  }
+
+  *num_regions = region_idx;
+  return &s_coredump_regions[0];
+}
+
+//
+// Capture measurements
+//
+
+bool __real_memfault_platform_coredump_storage_erase(uint32_t offset, size_t erase_size);
+bool __real_memfault_platform_coredump_storage_write(uint32_t offset, const void *data,
+                                                     size_t data_len);
+
+void __real_memfault_platform_reboot(void);
+
+APP_RAMFUNC static void prv_start_capture_record(void) {
+  const uint32_t now = app_cycles_get();
+  s_capture_record = (sAppCoredumpCaptureRecord){
+    .magic = APP_COREDUMP_CAPTURE_MAGIC,
+    .fault_cycles = now,
+    .start_cycles = now,
+    .end_cycles = now,
+    .reboot_cycles = now,
+  };
+}
+
+//! Hook called by the SDK on entry to the fault handler
+APP_RAMFUNC void memfault_platform_fault_handler(const sMfltRegState *regs,
+                                                 eMemfaultRebootReason reason) {
+  prv_start_capture_record();
+  // Storage erase and write kick the watchdog again before each sector
+  app_supervisor_kick_watchdog();
+}
+
+APP_RAMFUNC bool __wrap_memfault_platform_coredump_storage_erase(uint32_t offset,
+                                                                 size_t erase_size) {
+  if (s_capture_record.magic != APP_COREDUMP_CAPTURE_MAGIC) {
+    prv_start_capture_record();
+  }
+  // The SDK erases storage right before it starts writing a new coredump
+  s_capture_record.start_cycles = app_cycles_get();
+  s_capture_record.end_cycles = s_capture_record.start_cycles;
+  s_capture_record.storage_pre_erased = app_coredump_storage_is_erased();
+  return __real_memfault_platform_coredump_storage_erase(offset, erase_size);
+}
+
+APP_RAMFUNC bool __wrap_memfault_platform_coredump_storage_write(uint32_t offset,
+                                                                 const void *data,
+                                                                 size_t data_len) {
+  const bool success = __real_memfault_platform_coredump_storage_write(offset, data, data_len);
+  if (s_capture_record.magic == APP_COREDUMP_CAPTURE_MAGIC) {
+    s_capture_record.end_cycles = app_cycles_get();
+    s_capture_record.stored_bytes = MEMFAULT_MAX(s_capture_record.stored_bytes,
+                                                 offset + (uint32_t)data_len);
+    s_capture_record.write_count++;
+  }
+  return success;
+}
+
+APP_RAMFUNC void __wrap_memfault_platform_reboot(void) {
+  if (s_capture_record.magic == APP_COREDUMP_CAPTURE_MAGIC) {
+    s_capture_record.reboot_cycles = app_cycles_get();
+  }
+  __real_memfault_platform_reboot();
+}
+
+static uint32_t prv_bytes_per_ms(uint32_t bytes, uint32_t us) {
+  return (us == 0) ? 0 : (uint32_t)(((uint64_t)bytes * 1000) / us);
+}
+
+void app_coredump_boot(void) {
+  if ((s_capture_record.magic == APP_COREDUMP_CAPTURE_MAGIC) &&
+      memfault_coredump_has_valid_coredump(NULL)) {
+    s_last_capture = (sAppCoredumpCaptureStats){
+      .capture_us = app_cycles_to_us(s_capture_record.end_cycles - s_capture_record.start_cycles),
+      .fault_to_reboot_us =
+        app_cycles_to_us(s_capture_record.reboot_cycles - s_capture_record.fault_cycles),
+      .stored_bytes = s_capture_record.stored_bytes,
+      .write_count = s_capture_record.write_count,
+      .storage_pre_erased = s_capture_record.storage_pre_erased,
+    };
+    s_last_capture.bytes_per_ms =
+      prv_bytes_per_ms(s_last_capture.stored_bytes, s_last_capture.capture_us);
+    s_last_capture_valid = true;
+    APP_LOG_INFO("Coredump captured in %" PRIu32 " us, %" PRIu32 " bytes",
+                 s_last_capture.capture_us, s_last_capture.stored_bytes);
+    APP_LOG_INFO("Fault to reboot: %" PRIu32 " us", s_last_capture.fault_to_reboot_us);
+  }
+  s_capture_record.magic = 0;
+}
+
+bool app_coredump_get_last_capture(sAppCoredumpCaptureStats *stats) {
+  if (s_last_capture_valid) {
+    *stats = s_last_capture;
+  }
+  return s_last_capture_valid;
+}
+
+void app_coredump_collect_metrics(void) {
+  if (!s_last_capture_valid || s_last_capture_reported) {
+    return;
+  }
+  APP_METRIC_SET(coredump_capture_us, s_last_capture.capture_us);
+  APP_METRIC_SET(coredump_stored_bytes, s_last_capture.stored_bytes);
+  APP_METRIC_SET(coredump_fault_to_reboot_us, s_last_capture.fault_to_reboot_us);
+  APP_METRIC_SET(coredump_write_bytes_per_ms, s_last_capture.bytes_per_ms);
+  s_last_capture_reported = true;
+}
+
+static size_t prv_size_required(eAppCoredumpMode mode) {
+  const eAppCoredumpMode saved_mode = s_mode;
+  s_mode = mode;
+  const size_t size = memfault_coredump_storage_compute_size_required();
+  s_mode = saved_mode;
+  return size;
+}
+
+static int prv_erase_fault_test(uint32_t delay_ms) {
+  if (!app_coredump_storage_start_erase_test()) {
+    MEMFAULT_LOG_ERROR("No coredump storage");
+    return -1;
+  }
+  vTaskDelay(pdMS_TO_TICKS(delay_ms));
+  MEMFAULT_LOG_INFO("Asserting, erase %s", app_coredump_storage_is_erased() ? "done" : "in flight");
+  MEMFAULT_ASSERT(0);
+  return 0;
+}
+
+int app_coredump_cli_cmd(int argc, char *argv[]) {
+  if (argc > 1) {
+    if (strcmp(argv[1], "full") == 0) {
+      app_coredump_set_mode(kAppCoredumpMode_Full);
+    } else if (strcmp(argv[1], "selective") == 0) {
+      app_coredump_set_mode(kAppCoredumpMode_Selective);
+    } else if (strcmp(argv[1], "erase_fault") == 0) {
+      return prv_erase_fault_test((argc > 2) ? strtoul(argv[2], NULL, 0)
+                                             : APP_COREDUMP_ERASE_FAULT_DELAY_MS);
+    } else {
+      MEMFAULT_LOG_ERROR("Usage: coredump_stats [full|selective|erase_fault [delay_ms]]");
+      return -1;
+    }
+  }
+
+  sMfltCoredumpStorageInfo storage_info = { 0 };
+  memfault_platform_coredump_storage_get_info(&storage_info);
+
+  MEMFAULT_LOG_INFO("Mode: %s", (s_mode == kAppCoredumpMode_Selective) ? "selective" : "full");
+  sAppCoredumpStorageInfo qspi_info;
+  app_coredump_storage_get_info(&qspi_info);
+
+  MEMFAULT_LOG_INFO("Storage: %" PRIu32 " bytes at QSPI 0x%" PRIx32 ", %" PRIu32 " erased",
+                    (uint32_t)storage_info.size, qspi_info.flash_offset, qspi_info.erased_bytes);
+  MEMFAULT_LOG_INFO("Last background erase: %" PRIu32 " ms", qspi_info.last_erase_ms);
+  MEMFAULT_LOG_INFO("Required, selective: %" PRIu32 " bytes",
+                    (uint32_t)prv_size_required(kAppCoredumpMode_Selective));
+  MEMFAULT_LOG_INFO("Required, full RAM:  %" PRIu32 " bytes",
+                    (uint32_t)prv_size_required(kAppCoredumpMode_Full));
+
+  sAppCoredumpCaptureStats stats;
+  if (app_coredump_get_last_capture(&stats)) {
+    MEMFAULT_LOG_INFO("Last capture: %" PRIu32 " us, %" PRIu32 " bytes in %" PRIu32 " writes",
+                      stats.capture_us, stats.stored_bytes, stats.write_count);
+    MEMFAULT_LOG_INFO("  %" PRIu32 " bytes/ms, storage %s, fault to reboot %" PRIu32 " us",
+                      stats.bytes_per_ms, stats.storage_pre_erased ? "pre-erased" : "not erased",
+                      stats.fault_to_reboot_us);
+  }
+  return 0;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+//! @file
+//!
+//! @brief
+//! Coredump region selection and capture measurements
+//!
+//! In selective mode only the data needed to debug a crash is saved: the active stack, the
+//! registered application regions, the FreeRTOS kernel state and the TCB plus in-use portion of
+//! every task stack. The log buffer is added by the SDK. Full mode saves all of RAM after the
+//! same high-value regions.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef APP_COREDUMP_MAX_REGISTERED_REGIONS
+  #define APP_COREDUMP_MAX_REGISTERED_REGIONS 4
+#endif
+
+typedef enum {
+  kAppCoredumpMode_Full = 0,
+  kAppCoredumpMode_Selective,
+} eAppCoredumpMode;
+
+typedef struct {
+  //! Time from the start of the coredump save (storage erase) to the last storage write
+  uint32_t capture_us;
+  //! Time from entering the fault handler to requesting the reboot
+  uint32_t fault_to_reboot_us;
+  //! Bytes written to coredump storage
+  uint32_t stored_bytes;
+  //! stored_bytes / capture_us, in bytes per millisecond
+  uint32_t bytes_per_ms;
+  //! Number of storage writes issued by the SDK
+  uint32_t write_count;
+  //! Whether the background erase had finished when the fault hit
+  bool storage_pre_erased;
+} sAppCoredumpCaptureStats;
+
+//! Selects which regions are captured on the next crash
+void app_coredump_set_mode(eAppCoredumpMode mode);
+
+eAppCoredumpMode app_coredump_get_mode(void);
+
+//! Adds an application region which is saved in every coredump, in both modes
+//!
+//! @return false if the region table is full
+bool app_coredump_register_region(const void *start, size_t size);
+
+//! Call once on boot to pick up measurements of a capture made before the reboot
+void app_coredump_boot(void);
+
+//! Returns measurements of the coredump captured before the last reboot, if there was one
+bool app_coredump_get_last_capture(sAppCoredumpCaptureStats *stats);
+
+//! Records capture measurements in the first heartbeat after a crash
+void app_coredump_collect_metrics(void);
+
+//! Shell command which reports capture measurements and the storage needed by each mode
+//!
+//! Usage: coredump_stats [full|selective|erase_fault [delay_ms]]
+//!
+//! `erase_fault` restarts the background erase of the whole storage and asserts delay_ms later,
+//! while a sector erase is still in flight. The capture measurements reported after the reboot
+//! show whether the coredump was saved and how long the fault handler waited for the flash.
+int app_coredump_cli_cmd(int argc, char *argv[]);
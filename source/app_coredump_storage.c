@@ -0,0 +1,332 @@
+//! @file
+//!
+//! @brief
+//! Memfault coredump storage backend on the external QSPI NOR flash, see app_coredump_storage.h
+//!
+//! The storage occupies the last sectors of the external flash. The erase task only ever grows
+//! the erased prefix of the storage (s_erased_bytes) one sector at a time, so the fault handler
+//! knows exactly which sectors still need erasing. Flash accesses made from task context are
+//! serialized with a mutex. The fault handler runs as an exception and bypasses it, as the task
+//! holding the mutex will never run again.
+//!
+//! A fault can stop a task in the middle of a flash access. Before its first command, each fault
+//! path entry point resets the SMIF block, waits for a program or erase the flash is still busy
+//! with, and only erases the interrupted sector again if it isn't blank.
+//!
+//! A sector erase takes up to APP_COREDUMP_STORAGE_SECTOR_ERASE_MAX_MS, so the fault handler
+//! paths kick the hardware watchdog before each sector they erase or program. Run
+//! `coredump_stats erase_fault` to crash while the background erase is in flight.
+
+#include "app_coredump_storage.h"
+
+#include <FreeRTOS.h>
+#include <inttypes.h>
+#include <semphr.h>
+#include <task.h>
+
+#include "app_log.h"
+#include "app_memmap.h"
+#include "app_placement.h"
+#include "app_supervisor.h"
+#include "cy_device_headers.h"
+#include "cy_serial_flash_qspi.h"
+#include "cy_smif_memslot.h"
+#include "cy_syslib.h"
+#include "cycfg_qspi_memslot.h"
+#include "memfault/components.h"
+
+#if defined(CY_ENABLE_XIP_PROGRAM) || defined(CY_STORAGE_WIFI_DATA)
+  // The background erase takes the flash out of XIP mode for seconds, so a fetch from the XIP
+  // region by a task preempting it, or by the fault handler, would read a busy flash
+  #error "Code and Wi-Fi firmware can't run from QSPI XIP with the coredump storage on that flash"
+#endif
+
+#if defined(CY_SERIAL_FLASH_QSPI_THREAD_SAFE)
+  // The library mutex would block the fault handler on a task it stopped, like s_flash_lock
+  #error "Coredump storage serializes flash accesses, leave CY_SERIAL_FLASH_QSPI_THREAD_SAFE off"
+#endif
+
+#define APP_COREDUMP_STORAGE_TASK_SIZE (512)
+// Erasing busy-waits on the flash status inside the serial-flash library, so only use idle time
+#define APP_COREDUMP_STORAGE_TASK_PRIORITY (tskIDLE_PRIORITY)
+
+#ifndef APP_COREDUMP_STORAGE_SECTOR_ERASE_MAX_MS
+  // Worst case sector erase time of the S25FL512S fitted to the supported kits
+  #define APP_COREDUMP_STORAGE_SECTOR_ERASE_MAX_MS (2600)
+#endif
+
+#define APP_COREDUMP_STORAGE_BLANK_CHECK_CHUNK (64)
+
+// Bound of a single status register read after the SMIF reset
+#define APP_COREDUMP_STORAGE_SMIF_TIMEOUT_US (1000)
+
+static uint32_t s_flash_offset;
+static uint32_t s_size;
+static uint32_t s_sector_size;
+
+// Written by the erase task, read by the fault handler
+static volatile uint32_t s_erased_bytes;
+static volatile bool s_erase_in_flight;
+// Set while a task holds the flash, read by the fault handler
+static volatile bool s_access_in_flight;
+
+static cy_stc_smif_context_t s_smif_context;
+
+static uint32_t s_last_erase_ms;
+static SemaphoreHandle_t s_flash_lock;
+static StaticSemaphore_t s_flash_lock_storage APP_STATIC(coredump);
+static TaskHandle_t s_erase_task;
+static StackType_t s_erase_task_stack[APP_COREDUMP_STORAGE_TASK_SIZE] APP_STATIC(coredump);
+static StaticTask_t s_erase_task_tcb APP_STATIC(coredump);
+
+APP_RAMFUNC static bool prv_sector_is_blank(uint32_t offset) {
+  uint32_t buf[APP_COREDUMP_STORAGE_BLANK_CHECK_CHUNK / sizeof(uint32_t)];
+  for (uint32_t pos = 0; pos < s_sector_size; pos += sizeof(buf)) {
+    if (cy_serial_flash_qspi_read(s_flash_offset + offset + pos, sizeof(buf), (uint8_t *)buf) !=
+        CY_RSLT_SUCCESS) {
+      return false;
+    }
+    for (size_t i = 0; i < MEMFAULT_ARRAY_SIZE(buf); i++) {
+      if (buf[i] != 0xFFFFFFFF) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+//! Brings the SMIF and the flash back to a known state if the fault stopped a task's access
+APP_RAMFUNC static void prv_recover_interrupted_access(void) {
+  if (!s_access_in_flight) {
+    return;
+  }
+  // The task may have been stopped mid-transfer, e.g in a blank check read. Disabling the block
+  // drops the transfer and its FIFO contents and keeps the configuration.
+  Cy_SMIF_Disable(SMIF0);
+  Cy_SMIF_Enable(SMIF0, &s_smif_context);
+  s_smif_context.timeout = APP_COREDUMP_STORAGE_SMIF_TIMEOUT_US;
+
+  // A program or erase which reached the flash completes on its own, poll WIP until it does
+  const cy_en_smif_mode_t mode = Cy_SMIF_GetMode(SMIF0);
+  Cy_SMIF_SetMode(SMIF0, CY_SMIF_NORMAL);
+  for (uint32_t waited_ms = 0; waited_ms < APP_COREDUMP_STORAGE_SECTOR_ERASE_MAX_MS;
+       waited_ms++) {
+    if (!Cy_SMIF_Memslot_IsBusy(SMIF0, smifMemConfigs[0], &s_smif_context)) {
+      break;
+    }
+    Cy_SysLib_Delay(1);
+  }
+  Cy_SMIF_SetMode(SMIF0, mode);
+
+  // The erase may not have been issued at all, so only a blank sector counts as erased
+  if (s_erase_in_flight && prv_sector_is_blank(s_erased_bytes)) {
+    s_erased_bytes += s_sector_size;
+  }
+  s_erase_in_flight = false;
+  s_access_in_flight = false;
+}
+
+//! The fault handler and interrupts can't wait for the task they stopped to release the flash
+static bool prv_in_exception(void) {
+  return __get_IPSR() != 0;
+}
+
+//! In an exception, takes the flash over from any task access it stopped instead of locking
+APP_RAMFUNC static void prv_lock(void) {
+  if (prv_in_exception()) {
+    prv_recover_interrupted_access();
+    return;
+  }
+  if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING) {
+    xSemaphoreTake(s_flash_lock, portMAX_DELAY);
+  }
+  s_access_in_flight = true;
+}
+
+APP_RAMFUNC static void prv_unlock(void) {
+  if (prv_in_exception()) {
+    return;
+  }
+  s_access_in_flight = false;
+  if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING) {
+    xSemaphoreGive(s_flash_lock);
+  }
+}
+
+//! Erases the next sector which is not known to be erased
+//!
+//! Sectors which are already blank, e.g after a reboot without a crash, are skipped to save
+//! erase time and flash wear.
+static bool prv_erase_next_sector(void) {
+  prv_lock();
+  const uint32_t offset = s_erased_bytes;
+  bool success = true;
+  if (!prv_sector_is_blank(offset)) {
+    s_erase_in_flight = true;
+    success = cy_serial_flash_qspi_erase(s_flash_offset + offset, s_sector_size) ==
+              CY_RSLT_SUCCESS;
+    s_erase_in_flight = false;
+  }
+  if (success) {
+    s_erased_bytes = offset + s_sector_size;
+  }
+  prv_unlock();
+  return success;
+}
+
+static void prv_erase_task(void *arg) {
+  while (1) {
+    // Storage holding a coredump is only erased once the coredump has been uploaded and cleared
+    if ((s_erased_bytes < s_size) && !memfault_coredump_has_valid_coredump(NULL)) {
+      const TickType_t start = xTaskGetTickCount();
+      while (s_erased_bytes < s_size) {
+        if (!prv_erase_next_sector()) {
+          APP_LOG_ERROR("Coredump storage erase failed at 0x%" PRIx32,
+                        s_flash_offset + s_erased_bytes);
+          break;
+        }
+      }
+      s_last_erase_ms = (xTaskGetTickCount() - start) * portTICK_PERIOD_MS;
+    }
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  }
+}
+
+void app_coredump_storage_init(bool flash_ready) {
+  s_flash_lock = xSemaphoreCreateMutexStatic(&s_flash_lock_storage);
+
+  const uint32_t flash_size = flash_ready ? (uint32_t)cy_serial_flash_qspi_get_size() : 0;
+  // The top of the flash uses uniform sectors on all supported parts
+  const uint32_t sector_size =
+    (flash_size != 0) ? (uint32_t)cy_serial_flash_qspi_get_erase_size(flash_size - 1) : 0;
+  const uint32_t size =
+    (sector_size != 0) ? ((APP_COREDUMP_STORAGE_SIZE + sector_size - 1) / sector_size) * sector_size
+                       : 0;
+  if ((size == 0) || (size > flash_size)) {
+    // A storage size of 0 makes the SDK skip coredump capture
+    APP_LOG_ERROR("No QSPI flash for coredump storage, size %" PRIu32 " sector %" PRIu32,
+                  flash_size, sector_size);
+    return;
+  }
+  s_sector_size = sector_size;
+  s_size = size;
+  s_flash_offset = flash_size - size;
+
+  s_erase_task = xTaskCreateStatic(prv_erase_task, "CD Erase", APP_COREDUMP_STORAGE_TASK_SIZE,
+                                   NULL, APP_COREDUMP_STORAGE_TASK_PRIORITY, s_erase_task_stack,
+                                   &s_erase_task_tcb);
+}
+
+bool app_coredump_storage_start_erase_test(void) {
+  if (s_size == 0) {
+    return false;
+  }
+  prv_lock();
+  // Programming a word of each sector to zero invalidates any coredump and makes the erase task
+  // erase every sector again
+  const uint32_t dirty = 0;
+  for (uint32_t pos = 0; pos < s_size; pos += s_sector_size) {
+    cy_serial_flash_qspi_write(s_flash_offset + pos, sizeof(dirty), (const uint8_t *)&dirty);
+  }
+  s_erased_bytes = 0;
+  prv_unlock();
+
+  xTaskNotifyGive(s_erase_task);
+  return true;
+}
+
+bool app_coredump_storage_is_erased(void) {
+  return s_erased_bytes >= s_size;
+}
+
+void app_coredump_storage_get_info(sAppCoredumpStorageInfo *info) {
+  *info = (sAppCoredumpStorageInfo){
+    .flash_offset = s_flash_offset,
+    .size = s_size,
+    .sector_size = s_sector_size,
+    .erased_bytes = s_erased_bytes,
+    .last_erase_ms = s_last_erase_ms,
+  };
+}
+
+//
+// Memfault coredump storage API
+//
+
+void memfault_platform_coredump_storage_get_info(sMfltCoredumpStorageInfo *info) {
+  *info = (sMfltCoredumpStorageInfo){
+    .size = s_size,
+    .sector_size = s_sector_size,
+  };
+}
+
+APP_RAMFUNC bool memfault_platform_coredump_storage_read(uint32_t offset, void *data,
+                                                         size_t read_len) {
+  if ((offset + read_len) > s_size) {
+    return false;
+  }
+  prv_lock();
+  const cy_rslt_t rv = cy_serial_flash_qspi_read(s_flash_offset + offset, read_len, data);
+  prv_unlock();
+  return rv == CY_RSLT_SUCCESS;
+}
+
+//! Called from the fault handler before the coredump is written
+APP_RAMFUNC bool memfault_platform_coredump_storage_erase(uint32_t offset, size_t erase_size) {
+  if ((s_size == 0) || ((offset + erase_size) > s_size)) {
+    return false;
+  }
+  prv_lock();
+  bool success = true;
+  const uint32_t start = MEMFAULT_MAX(offset - (offset % s_sector_size), s_erased_bytes);
+  for (uint32_t pos = start; pos < (offset + erase_size); pos += s_sector_size) {
+    app_supervisor_kick_watchdog();
+    if (cy_serial_flash_qspi_erase(s_flash_offset + pos, s_sector_size) != CY_RSLT_SUCCESS) {
+      success = false;
+      break;
+    }
+  }
+  prv_unlock();
+  return success;
+}
+
+APP_RAMFUNC bool memfault_platform_coredump_storage_write(uint32_t offset, const void *data,
+                                                          size_t data_len) {
+  if ((offset + data_len) > s_size) {
+    return false;
+  }
+  prv_lock();
+  bool success = true;
+  const uint8_t *bytes = data;
+  while (data_len > 0) {
+    // Program up to the next sector boundary between watchdog kicks
+    const size_t len = MEMFAULT_MIN(data_len, s_sector_size - (offset % s_sector_size));
+    app_supervisor_kick_watchdog();
+    if (cy_serial_flash_qspi_write(s_flash_offset + offset, len, bytes) != CY_RSLT_SUCCESS) {
+      success = false;
+      break;
+    }
+    offset += len;
+    bytes += len;
+    data_len -= len;
+  }
+  prv_unlock();
+  return success;
+}
+
+//! Called once the coredump has been read out for upload
+void memfault_platform_coredump_storage_clear(void) {
+  if (s_size == 0) {
+    return;
+  }
+  prv_lock();
+  if (s_erased_bytes == 0) {
+    // Programming the header to zero invalidates the coredump right away. The rest of the
+    // storage is erased in the background.
+    const uint32_t invalidate = 0;
+    cy_serial_flash_qspi_write(s_flash_offset, sizeof(invalidate), (const uint8_t *)&invalidate);
+  }
+  prv_unlock();
+
+  xTaskNotifyGive(s_erase_task);
+}
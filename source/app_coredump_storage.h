@@ -0,0 +1,51 @@
+#pragma once
+
+//! @file
+//!
+//! @brief
+//! Coredump storage on the external QSPI NOR flash
+//!
+//! NOR flash has to be erased before it can be programmed and a sector erase takes hundreds of
+//! milliseconds. Instead of erasing from the fault handler, the storage sectors are erased by a
+//! low priority task after boot and again after every coredump upload, so saving a coredump is
+//! program-only. If a fault hits before the background erase has finished, the remaining
+//! sectors are erased from the fault handler as before.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef APP_COREDUMP_STORAGE_SIZE
+  //! Rounded up to a whole number of erase sectors at the end of the external flash
+  #define APP_COREDUMP_STORAGE_SIZE (64 * 1024)
+#endif
+
+typedef struct {
+  //! Offset of the storage in the external flash
+  uint32_t flash_offset;
+  //! Storage size, a multiple of sector_size
+  uint32_t size;
+  uint32_t sector_size;
+  //! Bytes from the start of the storage which are known to be erased
+  uint32_t erased_bytes;
+  //! Duration of the last complete background erase
+  uint32_t last_erase_ms;
+} sAppCoredumpStorageInfo;
+
+//! Locates the storage and starts the background erase task
+//!
+//! Must be called after cy_serial_flash_qspi_init() and before memfault_platform_boot(). If the
+//! flash didn't come up, the storage size is reported as 0 and no coredump is captured.
+//!
+//! @param flash_ready true if cy_serial_flash_qspi_init() succeeded
+void app_coredump_storage_init(bool flash_ready);
+
+//! Dirties every storage sector and restarts the background erase, to test faults hitting while
+//! an erase is in flight
+//!
+//! @return false if there is no coredump storage
+bool app_coredump_storage_start_erase_test(void);
+
+//! Returns true once the whole storage is erased and ready for a program-only capture
+bool app_coredump_storage_is_erased(void);
+
+void app_coredump_storage_get_info(sAppCoredumpStorageInfo *info);
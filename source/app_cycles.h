@@ -0,0 +1,30 @@
+#pragma once
+
+//! @file
+//!
+//! @brief
+//! Helpers for timing code with the Cortex-M4 DWT cycle counter
+//!
+//! The counter is 32 bits wide and runs at the core clock, so single measurements must be
+//! shorter than 2^32 / SystemCoreClock seconds (~28s at 150MHz). The counter does not advance
+//! while the core is sleeping.
+
+#include <stdint.h>
+
+#include "cy_device_headers.h"
+
+//! Enables the cycle counter. Safe to call more than once.
+static inline void app_cycles_init(void) {
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+//! Returns the current value of the free running cycle counter
+static inline uint32_t app_cycles_get(void) {
+  return DWT->CYCCNT;
+}
+
+//! Converts a cycle count into microseconds at the current core clock
+static inline uint32_t app_cycles_to_us(uint32_t cycles) {
+  return cycles / (SystemCoreClock / 1000000UL);
+}
@@ -0,0 +1,132 @@
+//! @file
+//!
+//! @brief
+//! DNS cache for the chunks endpoint, see app_dns_cache.h
+
+#include "app_dns_cache.h"
+
+#include <FreeRTOS.h>
+#include <string.h>
+#include <task.h>
+
+#include "app_kvstore.h"
+#include "app_log.h"
+#include "app_metrics.h"
+#include "memfault/components.h"
+
+//! Bump when the layout of sAppDnsCacheEntry changes
+#define APP_DNS_CACHE_VERSION 1
+
+//! Entry as saved in the kv-store
+typedef struct {
+  uint32_t version;
+  char host[APP_DNS_CACHE_MAX_HOST_LEN];
+  uint32_t ipv4;
+  //! Duration of the lookup which produced the entry, to estimate the time saved after a reboot
+  uint32_t resolve_ms;
+} sAppDnsCacheEntry;
+
+static sAppDnsCacheEntry s_entry;
+static bool s_valid;
+//! Tick the entry was resolved at. Entries loaded from the kv-store expire relative to boot.
+static TickType_t s_resolved_at;
+static bool s_loaded;
+
+static sAppDnsCacheStats s_stats;
+static uint32_t s_total_resolve_ms;
+static uint32_t s_last_reported_hits;
+static uint32_t s_last_reported_saved_ms;
+
+static void prv_load(void) {
+  s_loaded = true;
+  if (!app_kvstore_key_exists(APP_DNS_CACHE_KVSTORE_KEY)) {
+    return;
+  }
+  uint32_t size = sizeof(s_entry);
+  if ((app_kvstore_read(APP_DNS_CACHE_KVSTORE_KEY, (uint8_t *)&s_entry, &size) !=
+       CY_RSLT_SUCCESS) ||
+      (size != sizeof(s_entry)) || (s_entry.version != APP_DNS_CACHE_VERSION)) {
+    return;
+  }
+  s_entry.host[sizeof(s_entry.host) - 1] = '\0';
+  s_valid = true;
+  s_resolved_at = xTaskGetTickCount();
+}
+
+static bool prv_entry_matches(const char *host) {
+  return s_valid && (strcmp(s_entry.host, host) == 0) &&
+         ((xTaskGetTickCount() - s_resolved_at) < pdMS_TO_TICKS(APP_DNS_CACHE_TTL_MS));
+}
+
+static void prv_store(const char *host, uint32_t ipv4, uint32_t resolve_ms) {
+  const bool changed =
+    !s_valid || (strcmp(s_entry.host, host) != 0) || (s_entry.ipv4 != ipv4);
+
+  s_entry.version = APP_DNS_CACHE_VERSION;
+  strncpy(s_entry.host, host, sizeof(s_entry.host) - 1);
+  s_entry.host[sizeof(s_entry.host) - 1] = '\0';
+  s_entry.ipv4 = ipv4;
+  s_entry.resolve_ms = resolve_ms;
+  s_valid = true;
+  s_resolved_at = xTaskGetTickCount();
+
+  // Only write the flash when the address moved, not on every TTL refresh
+  if (changed) {
+    app_kvstore_write(APP_DNS_CACHE_KVSTORE_KEY, (const uint8_t *)&s_entry, sizeof(s_entry));
+  }
+}
+
+cy_rslt_t app_dns_cache_resolve(const char *host, cy_socket_ip_address_t *address,
+                                bool *from_cache) {
+  if (!s_loaded) {
+    prv_load();
+  }
+
+  if (prv_entry_matches(host)) {
+    *address = (cy_socket_ip_address_t){
+      .version = CY_SOCKET_IP_VER_V4,
+      .ip.v4 = s_entry.ipv4,
+    };
+    *from_cache = true;
+    s_stats.hits++;
+    s_stats.saved_ms += (s_stats.resolves > 0) ? s_stats.mean_resolve_ms : s_entry.resolve_ms;
+    return CY_RSLT_SUCCESS;
+  }
+
+  *from_cache = false;
+  const TickType_t start = xTaskGetTickCount();
+  const cy_rslt_t rv = cy_socket_gethostbyname(host, CY_SOCKET_IP_VER_V4, address);
+  if (rv != CY_RSLT_SUCCESS) {
+    s_stats.resolve_failures++;
+    return rv;
+  }
+  const uint32_t resolve_ms = (uint32_t)((xTaskGetTickCount() - start) * portTICK_PERIOD_MS);
+  s_stats.resolves++;
+  s_total_resolve_ms += resolve_ms;
+  s_stats.mean_resolve_ms = s_total_resolve_ms / s_stats.resolves;
+
+  if (strlen(host) < sizeof(s_entry.host)) {
+    prv_store(host, address->ip.v4, resolve_ms);
+  }
+  return rv;
+}
+
+void app_dns_cache_invalidate(const char *host) {
+  if (!s_valid || (strcmp(s_entry.host, host) != 0)) {
+    return;
+  }
+  s_valid = false;
+  s_stats.invalidations++;
+  APP_LOG_WARN("Dropped cached address of %s", host);
+}
+
+void app_dns_cache_get_stats(sAppDnsCacheStats *stats) {
+  *stats = s_stats;
+}
+
+void app_dns_cache_collect_metrics(void) {
+  APP_METRIC_SET(dns_cache_hit_count, s_stats.hits - s_last_reported_hits);
+  APP_METRIC_SET(dns_saved_ms, s_stats.saved_ms - s_last_reported_saved_ms);
+  s_last_reported_hits = s_stats.hits;
+  s_last_reported_saved_ms = s_stats.saved_ms;
+}
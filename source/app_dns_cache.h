@@ -0,0 +1,52 @@
+#pragma once
+
+//! @file
+//!
+//! @brief
+//! Cache of the last known-good address of the chunks endpoint
+//!
+//! A resolved address is reused for APP_DNS_CACHE_TTL_MS and saved to the kv-store, so the first
+//! upload after boot can connect without a DNS lookup. cy_socket_gethostbyname() does not return
+//! the record's TTL, so a fixed TTL is used. A caller which fails to connect to a cached address
+//! invalidates it and resolves again.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cy_secure_sockets.h"
+
+#ifndef APP_DNS_CACHE_TTL_MS
+  #define APP_DNS_CACHE_TTL_MS (30 * 60 * 1000)
+#endif
+
+#define APP_DNS_CACHE_KVSTORE_KEY "dns_cache"
+#define APP_DNS_CACHE_MAX_HOST_LEN 64
+
+typedef struct {
+  //! Lookups answered from the cache
+  uint32_t hits;
+  //! Lookups which went to the resolver
+  uint32_t resolves;
+  uint32_t resolve_failures;
+  //! Cached addresses which failed to connect and were dropped
+  uint32_t invalidations;
+  //! Mean duration of a successful resolver lookup
+  uint32_t mean_resolve_ms;
+  //! hits * mean_resolve_ms
+  uint32_t saved_ms;
+} sAppDnsCacheStats;
+
+//! Returns the address of a host, from the cache if it holds a valid entry for it
+//!
+//! @param[out] from_cache Set if the address came from the cache
+//! @return The cy_socket_gethostbyname() result on a cache miss, CY_RSLT_SUCCESS on a hit
+cy_rslt_t app_dns_cache_resolve(const char *host, cy_socket_ip_address_t *address,
+                                bool *from_cache);
+
+//! Drops the cached address of a host, so the next lookup goes to the resolver
+void app_dns_cache_invalidate(const char *host);
+
+void app_dns_cache_get_stats(sAppDnsCacheStats *stats);
+
+//! Records cache hits and the lookup time they saved in the heartbeat
+void app_dns_cache_collect_metrics(void);
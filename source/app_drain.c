@@ -0,0 +1,84 @@
+//! @file
+//!
+//! @brief
+//! Prioritized upload of queued Memfault data, see app_drain.h
+
+#include "app_drain.h"
+
+#include <inttypes.h>
+
+#include "app_upload.h"
+#include "memfault/components.h"
+
+typedef struct {
+  const char *name;
+  uint32_t source_mask;
+  uint32_t budget;
+} sAppDrainClass;
+
+typedef struct {
+  uint32_t posted;
+  uint32_t failed;
+  //! Cycles which used up the whole budget, leaving data queued for the next cycle
+  uint32_t budget_exhausted;
+} sAppDrainClassStats;
+
+static const sAppDrainClass s_classes[kAppDrainClass_NumClasses] = {
+#define APP_DRAIN_CLASS_INIT(name_, mask_, budget_) \
+  [kAppDrainClass_##name_] = { .name = #name_, .source_mask = (mask_), .budget = (budget_) },
+  APP_DRAIN_CLASSES(APP_DRAIN_CLASS_INIT)
+#undef APP_DRAIN_CLASS_INIT
+};
+
+static sAppDrainClassStats s_stats[kAppDrainClass_NumClasses];
+
+//! Posts up to the class's budget of messages
+static int prv_drain_class(eAppDrainClass drain_class) {
+  const sAppDrainClass *info = &s_classes[drain_class];
+  sAppDrainClassStats *stats = &s_stats[drain_class];
+
+  memfault_packetizer_set_active_sources(info->source_mask);
+  int result = 1;
+  for (uint32_t i = 0; i < info->budget; i++) {
+    const int rv = app_upload_post_chunk();
+    if (rv == 1) {
+      return result;
+    }
+    if (rv < 0) {
+      stats->failed++;
+      return rv;
+    }
+    stats->posted++;
+    result = 0;
+  }
+  stats->budget_exhausted++;
+  return result;
+}
+
+int app_drain_run(void) {
+  int result = 1;
+  for (eAppDrainClass drain_class = 0; drain_class < kAppDrainClass_NumClasses; drain_class++) {
+    const int rv = prv_drain_class(drain_class);
+    if (rv < 0) {
+      result = rv;
+      break;
+    }
+    if (rv == 0) {
+      result = 0;
+    }
+  }
+  // Leave the packetizer as the SDK's own export paths expect it
+  memfault_packetizer_set_active_sources(kMfltDataSourceMask_All);
+  return result;
+}
+
+int app_drain_cli_cmd(int argc, char *argv[]) {
+  MEMFAULT_LOG_INFO("%-10s %6s %8s %8s %10s", "Class", "Budget", "Posted", "Failed", "Exhausted");
+  for (eAppDrainClass drain_class = 0; drain_class < kAppDrainClass_NumClasses; drain_class++) {
+    const sAppDrainClassStats *stats = &s_stats[drain_class];
+    MEMFAULT_LOG_INFO("%-10s %6" PRIu32 " %8" PRIu32 " %8" PRIu32 " %10" PRIu32,
+                      s_classes[drain_class].name, s_classes[drain_class].budget, stats->posted,
+                      stats->failed, stats->budget_exhausted);
+  }
+  return 0;
+}
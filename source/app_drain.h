@@ -0,0 +1,40 @@
+#pragma once
+
+//! @file
+//!
+//! @brief
+//! Uploads queued Memfault data one data class at a time, in priority order
+//!
+//! Each upload cycle restricts the packetizer to one data source at a time and posts up to that
+//! class's budget of chunk messages before moving on to the next. A coredump is therefore always
+//! posted before the heartbeats and logs recorded since, and a burst of logs cannot hold back
+//! the heartbeats.
+//!
+//! Heartbeats and trace events share the SDK's event storage, so they drain as one class. With
+//! APP_METRICS_COMPACT the application's metrics are a Custom Data Recording and drain right
+//! after them.
+
+#include <stdint.h>
+
+//! X(name, source mask, messages per cycle), highest priority first
+#define APP_DRAIN_CLASSES(X)                   \
+  X(Coredump, kMfltDataSourceMask_Coredump, 2) \
+  X(Events, kMfltDataSourceMask_Event, 4)      \
+  X(Metrics, kMfltDataSourceMask_Cdr, 1)       \
+  X(Logs, kMfltDataSourceMask_Log, 2)
+
+typedef enum {
+#define APP_DRAIN_CLASS_ENUM(name_, mask_, budget_) kAppDrainClass_##name_,
+  APP_DRAIN_CLASSES(APP_DRAIN_CLASS_ENUM)
+#undef APP_DRAIN_CLASS_ENUM
+  kAppDrainClass_NumClasses,
+} eAppDrainClass;
+
+//! Runs one upload cycle
+//!
+//! @return 0 if data was posted, 1 if there was nothing to post, < 0 if a post failed. Data of
+//! lower priority classes stays queued after a failure.
+int app_drain_run(void);
+
+//! Shell command which prints the messages posted per data class
+int app_drain_cli_cmd(int argc, char *argv[]);
@@ -0,0 +1,266 @@
+//! @file
+//!
+//! @brief
+//! Link-time wrappers around the newlib allocator which keep running heap statistics.
+//!
+//! Replaces the one-shot mallinfo() dump that used to live in heap_usage.c. The wrappers only
+//! touch a handful of integers; anything expensive (mallinfo(), sbrk()) is deferred to the
+//! heartbeat collection and the shell command.
+
+#include "app_heap_stats.h"
+
+#include <inttypes.h>
+#include <malloc.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/reent.h>
+#include <unistd.h>
+
+#include "app_alloc_trace.h"
+#include "app_metrics.h"
+#include "app_placement.h"
+#include "cy_syslib.h"
+#include "memfault/components.h"
+
+// Symbols exported by the linker script
+extern uint8_t __HeapBase;
+extern uint8_t __HeapLimit;
+
+// Free list of the newlib-nano allocator (nano-mallocr.c), guarded by __malloc_lock(). Chunk
+// sizes include the chunk header.
+typedef struct AppMallocChunk {
+  long size;
+  struct AppMallocChunk *next;
+} sAppMallocChunk;
+extern sAppMallocChunk *__malloc_free_list;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+static sAppHeapStats s_heap_stats;
+
+// Values at the end of the previous heartbeat so per-interval deltas can be reported
+static uint32_t s_interval_peak_bytes;
+static uint32_t s_last_alloc_count;
+static uint32_t s_last_failed_count;
+static uint32_t s_last_size_histogram[APP_HEAP_STATS_NUM_BUCKETS];
+
+// Peak since the last app_heap_stats_watermark_reset()
+static uint32_t s_watermark_bytes;
+
+APP_RAMFUNC static uint32_t prv_bucket_for_size(size_t size) {
+  if (size <= 32) {
+    return 0;
+  }
+  // 33..64 -> 1, 65..128 -> 2, ...
+  const uint32_t bucket = (32 - __builtin_clz((uint32_t)size - 1)) - 5;
+  return MEMFAULT_MIN(bucket, APP_HEAP_STATS_NUM_BUCKETS - 1);
+}
+
+APP_RAMFUNC static void prv_record_alloc(void *ptr, size_t requested_size) {
+  const uint32_t irq_state = Cy_SysLib_EnterCriticalSection();
+  if (ptr == NULL) {
+    s_heap_stats.failed_count++;
+  } else {
+    s_heap_stats.alloc_count++;
+    s_heap_stats.size_histogram[prv_bucket_for_size(requested_size)]++;
+    const uint32_t usable_size = malloc_usable_size(ptr);
+    s_heap_stats.alloc_bytes += usable_size;
+    s_heap_stats.in_use_bytes += usable_size;
+    s_heap_stats.peak_bytes = MEMFAULT_MAX(s_heap_stats.peak_bytes, s_heap_stats.in_use_bytes);
+    s_interval_peak_bytes = MEMFAULT_MAX(s_interval_peak_bytes, s_heap_stats.in_use_bytes);
+    s_watermark_bytes = MEMFAULT_MAX(s_watermark_bytes, s_heap_stats.in_use_bytes);
+  }
+  Cy_SysLib_ExitCriticalSection(irq_state);
+}
+
+APP_RAMFUNC static void prv_record_free(size_t usable_size) {
+  const uint32_t irq_state = Cy_SysLib_EnterCriticalSection();
+  s_heap_stats.free_count++;
+  s_heap_stats.in_use_bytes -= usable_size;
+  Cy_SysLib_ExitCriticalSection(irq_state);
+}
+
+uint32_t app_heap_stats_watermark_reset(void) {
+  const uint32_t irq_state = Cy_SysLib_EnterCriticalSection();
+  s_watermark_bytes = s_heap_stats.in_use_bytes;
+  Cy_SysLib_ExitCriticalSection(irq_state);
+  return s_watermark_bytes;
+}
+
+uint32_t app_heap_stats_watermark_get(void) {
+  return s_watermark_bytes;
+}
+
+APP_RAMFUNC static void prv_trace_alloc(void *ptr, size_t size, const void *caller) {
+  app_alloc_trace_record((ptr != NULL) ? kAppAllocTraceOp_HeapAlloc
+                                       : kAppAllocTraceOp_HeapAllocFailed,
+                         ptr, size, caller);
+}
+
+APP_RAMFUNC void *app_heap_stats_malloc(size_t size, const void *caller) {
+  void *ptr = __real_malloc(size);
+  prv_record_alloc(ptr, size);
+  prv_trace_alloc(ptr, size, caller);
+  return ptr;
+}
+
+APP_RAMFUNC void *__wrap_malloc(size_t size) {
+  return app_heap_stats_malloc(size, __builtin_return_address(0));
+}
+
+APP_RAMFUNC void *__wrap_calloc(size_t nmemb, size_t size) {
+  void *ptr = __real_calloc(nmemb, size);
+  prv_record_alloc(ptr, nmemb * size);
+  prv_trace_alloc(ptr, nmemb * size, __builtin_return_address(0));
+  return ptr;
+}
+
+APP_RAMFUNC void *__wrap_realloc(void *ptr, size_t size) {
+  const void *caller = __builtin_return_address(0);
+  const size_t old_size = (ptr != NULL) ? malloc_usable_size(ptr) : 0;
+  void *new_ptr = __real_realloc(ptr, size);
+  if (new_ptr == NULL && size != 0) {
+    // the original allocation is left untouched on failure
+    prv_record_alloc(NULL, size);
+    prv_trace_alloc(NULL, size, caller);
+    return NULL;
+  }
+
+  if (ptr != NULL) {
+    prv_record_free(old_size);
+    app_alloc_trace_record(kAppAllocTraceOp_HeapFree, ptr, 0, caller);
+  }
+  if (new_ptr != NULL) {
+    prv_record_alloc(new_ptr, size);
+    prv_trace_alloc(new_ptr, size, caller);
+  }
+  return new_ptr;
+}
+
+APP_RAMFUNC void app_heap_stats_free(void *ptr, const void *caller) {
+  if (ptr == NULL) {
+    return;
+  }
+  // record before releasing so the ring never shows the block re-allocated ahead of this free
+  app_alloc_trace_record(kAppAllocTraceOp_HeapFree, ptr, 0, caller);
+  const size_t usable_size = malloc_usable_size(ptr);
+  __real_free(ptr);
+  prv_record_free(usable_size);
+}
+
+APP_RAMFUNC void __wrap_free(void *ptr) {
+  app_heap_stats_free(ptr, __builtin_return_address(0));
+}
+
+void app_heap_stats_get(sAppHeapStats *stats) {
+  const uint32_t irq_state = Cy_SysLib_EnterCriticalSection();
+  *stats = s_heap_stats;
+  Cy_SysLib_ExitCriticalSection(irq_state);
+}
+
+static uint32_t prv_heap_size(void) {
+  return (uint32_t)(&__HeapLimit - &__HeapBase);
+}
+
+//! Returns the heap past the program break, which malloc has not claimed yet
+static uint32_t prv_unclaimed_bytes(void) {
+  const uint8_t *brk = (const uint8_t *)sbrk(0);
+  if ((brk < &__HeapBase) || (brk > &__HeapLimit)) {
+    return 0;
+  }
+  return (uint32_t)(&__HeapLimit - brk);
+}
+
+uint32_t app_heap_stats_get_largest_free_block(void) {
+  __malloc_lock(_REENT);
+  const uint8_t *brk = (const uint8_t *)sbrk(0);
+  const uint32_t unclaimed = prv_unclaimed_bytes();
+  uint32_t largest = unclaimed;
+  for (const sAppMallocChunk *chunk = __malloc_free_list; chunk != NULL; chunk = chunk->next) {
+    uint32_t size = (uint32_t)chunk->size;
+    // malloc grows a free chunk that ends at the program break instead of starting a new one
+    if (((const uint8_t *)chunk + size) == brk) {
+      size += unclaimed;
+    }
+    largest = MEMFAULT_MAX(largest, size);
+  }
+  __malloc_unlock(_REENT);
+  return largest;
+}
+
+uint32_t app_heap_stats_get_fragmentation_permille(void) {
+  const struct mallinfo mall_info = mallinfo();
+  const uint32_t total_free = (uint32_t)mall_info.fordblks + prv_unclaimed_bytes();
+  if (total_free == 0) {
+    return 0;
+  }
+  const uint32_t largest = MEMFAULT_MIN(app_heap_stats_get_largest_free_block(), total_free);
+  return 1000 - (uint32_t)(((uint64_t)largest * 1000) / total_free);
+}
+
+uint32_t app_heap_stats_bucket_limit(uint32_t bucket) {
+  return 32UL << bucket;
+}
+
+void app_heap_stats_collect_metrics(void) {
+  sAppHeapStats stats;
+  const uint32_t irq_state = Cy_SysLib_EnterCriticalSection();
+  stats = s_heap_stats;
+  const uint32_t interval_peak_bytes = s_interval_peak_bytes;
+  s_interval_peak_bytes = s_heap_stats.in_use_bytes;
+  Cy_SysLib_ExitCriticalSection(irq_state);
+
+  APP_METRIC_SET(heap_in_use_bytes, stats.in_use_bytes);
+  APP_METRIC_SET(heap_peak_bytes, interval_peak_bytes);
+  APP_METRIC_SET(heap_largest_free_bytes, app_heap_stats_get_largest_free_block());
+  APP_METRIC_SET(heap_frag_permille, app_heap_stats_get_fragmentation_permille());
+  APP_METRIC_SET(heap_alloc_count, stats.alloc_count - s_last_alloc_count);
+  APP_METRIC_SET(heap_alloc_failed_count, stats.failed_count - s_last_failed_count);
+
+  const AppMetricId histogram_keys[APP_HEAP_STATS_NUM_BUCKETS] = {
+    APP_METRIC_KEY(heap_alloc_le_32),   APP_METRIC_KEY(heap_alloc_le_64),
+    APP_METRIC_KEY(heap_alloc_le_128),  APP_METRIC_KEY(heap_alloc_le_256),
+    APP_METRIC_KEY(heap_alloc_le_512),  APP_METRIC_KEY(heap_alloc_le_1024),
+    APP_METRIC_KEY(heap_alloc_le_2048), APP_METRIC_KEY(heap_alloc_gt_2048),
+  };
+  for (size_t i = 0; i < APP_HEAP_STATS_NUM_BUCKETS; i++) {
+    app_metrics_set_unsigned(histogram_keys[i], stats.size_histogram[i] - s_last_size_histogram[i]);
+  }
+
+  s_last_alloc_count = stats.alloc_count;
+  s_last_failed_count = stats.failed_count;
+  memcpy(s_last_size_histogram, stats.size_histogram, sizeof(s_last_size_histogram));
+}
+
+int app_heap_stats_cli_cmd(int argc, char *argv[]) {
+  sAppHeapStats stats;
+  app_heap_stats_get(&stats);
+
+  const uint32_t heap_size = prv_heap_size();
+  const uint32_t frag_permille = app_heap_stats_get_fragmentation_permille();
+
+  MEMFAULT_LOG_INFO("Heap size: %" PRIu32 " bytes", heap_size);
+  MEMFAULT_LOG_INFO("In use: %" PRIu32 " bytes, peak: %" PRIu32 " bytes", stats.in_use_bytes,
+                    stats.peak_bytes);
+  MEMFAULT_LOG_INFO("Largest free block: >= %" PRIu32 " bytes",
+                    app_heap_stats_get_largest_free_block());
+  MEMFAULT_LOG_INFO("Fragmentation: %" PRIu32 ".%" PRIu32 "%%", frag_permille / 10,
+                    frag_permille % 10);
+  MEMFAULT_LOG_INFO("Allocs: %" PRIu32 ", frees: %" PRIu32 ", failed: %" PRIu32,
+                    stats.alloc_count, stats.free_count, stats.failed_count);
+
+  for (uint32_t i = 0; i < APP_HEAP_STATS_NUM_BUCKETS; i++) {
+    if (i == APP_HEAP_STATS_NUM_BUCKETS - 1) {
+      MEMFAULT_LOG_INFO("  > %5" PRIu32 ": %" PRIu32, app_heap_stats_bucket_limit(i - 1),
+                        stats.size_histogram[i]);
+    } else {
+      MEMFAULT_LOG_INFO("  <= %4" PRIu32 ": %" PRIu32, app_heap_stats_bucket_limit(i),
+                        stats.size_histogram[i]);
+    }
+  }
+
+  return 0;
+}
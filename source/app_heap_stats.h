@@ -0,0 +1,76 @@
+#pragma once
+
+//! @file
+//!
+//! @brief
+//! Always-on heap telemetry for the newlib allocator backing FreeRTOS heap_3
+//!
+//! malloc/calloc/realloc/free are wrapped at link time (see the --wrap flags in the Makefile)
+//! so every allocation made by FreeRTOS, mbedTLS, lwIP and the application is accounted for.
+//! Counters are integer-only and updated inside a short critical section so the wrappers stay
+//! cheap enough to leave enabled in production builds.
+
+#include <stddef.h>
+#include <stdint.h>
+
+//! Number of buckets in the allocation size histogram. Bucket N counts allocations of at most
+//! (32 << N) bytes, the last bucket counts everything larger.
+#define APP_HEAP_STATS_NUM_BUCKETS 8
+
+typedef struct {
+  //! Bytes currently handed out by the allocator (usable size, including allocator rounding)
+  uint32_t in_use_bytes;
+  //! Highest value of in_use_bytes since boot
+  uint32_t peak_bytes;
+  //! Total number of successful allocations since boot
+  uint32_t alloc_count;
+  //! Total bytes handed out since boot (usable size), wraps at 4 GiB
+  uint32_t alloc_bytes;
+  //! Total number of frees since boot
+  uint32_t free_count;
+  //! Number of allocation requests the allocator could not satisfy
+  uint32_t failed_count;
+  //! Allocation size histogram since boot, see APP_HEAP_STATS_NUM_BUCKETS
+  uint32_t size_histogram[APP_HEAP_STATS_NUM_BUCKETS];
+} sAppHeapStats;
+
+//! malloc() for allocators layered on the heap, which records the allocation against their own
+//! caller rather than the allocator
+void *app_heap_stats_malloc(size_t size, const void *caller);
+
+//! free() counterpart of app_heap_stats_malloc()
+void app_heap_stats_free(void *ptr, const void *caller);
+
+//! Takes a consistent snapshot of the heap counters
+void app_heap_stats_get(sAppHeapStats *stats);
+
+//! Restarts peak tracking for a section of code, e.g a TLS handshake
+//!
+//! @return Bytes in use at the start of the section
+uint32_t app_heap_stats_watermark_reset(void);
+
+//! Returns the highest in_use_bytes since app_heap_stats_watermark_reset()
+uint32_t app_heap_stats_watermark_get(void);
+
+//! Returns the size of the largest free block, chunk header included
+//!
+//! Walks the newlib-nano free list under the malloc lock and compares its chunks with the
+//! region between the program break and the end of the heap.
+uint32_t app_heap_stats_get_largest_free_block(void);
+
+//! Returns the fragmentation of the free heap in permille
+//!
+//! 0 means all free memory is one contiguous block, values close to 1000 mean free memory is
+//! scattered in chunks much smaller than the total free space.
+uint32_t app_heap_stats_get_fragmentation_permille(void);
+
+//! Returns the upper bound, in bytes, of the histogram bucket the provided size falls into
+uint32_t app_heap_stats_bucket_limit(uint32_t bucket);
+
+//! Records heap metrics for the current heartbeat interval
+//!
+//! Called from memfault_metrics_heartbeat_collect_data()
+void app_heap_stats_collect_metrics(void);
+
+//! Shell command which dumps the current heap statistics
+int app_heap_stats_cli_cmd(int argc, char *argv[]);
@@ -0,0 +1,100 @@
+//! @file
+//!
+//! @brief
+//! Half-octave histogram, see app_histogram.h
+
+#include "app_histogram.h"
+
+#include <string.h>
+
+static uint32_t prv_bucket_for_value(uint32_t value) {
+  if (value < 4) {
+    return value;
+  }
+  const uint32_t msb = 31 - (uint32_t)__builtin_clz(value);
+  const uint32_t half = (value >> (msb - 1)) & 1;
+  return (msb * 2) + half;
+}
+
+static uint32_t prv_bucket_midpoint(uint32_t bucket) {
+  if (bucket < 4) {
+    return bucket;
+  }
+  const uint32_t msb = bucket / 2;
+  const uint32_t width = 1UL << (msb - 1);
+  const uint32_t lower = (1UL << msb) + ((bucket % 2) * width);
+  return lower + (width / 2);
+}
+
+void app_histogram_reset(sAppHistogram *histogram) {
+  memset(histogram, 0, sizeof(*histogram));
+  histogram->min = UINT32_MAX;
+}
+
+void app_histogram_add(sAppHistogram *histogram, uint32_t value) {
+  if (value < histogram->min) {
+    histogram->min = value;
+  }
+  if (value > histogram->max) {
+    histogram->max = value;
+  }
+  histogram->sum += value;
+  histogram->count++;
+
+  uint16_t *bucket = &histogram->buckets[prv_bucket_for_value(value)];
+  if (*bucket != UINT16_MAX) {
+    (*bucket)++;
+  }
+}
+
+uint32_t app_histogram_mean(const sAppHistogram *histogram) {
+  if (histogram->count == 0) {
+    return 0;
+  }
+  return (uint32_t)(histogram->sum / histogram->count);
+}
+
+uint32_t app_histogram_percentile(const sAppHistogram *histogram, uint32_t permille) {
+  // Bucket counts saturate, so rank against their sum rather than histogram->count
+  uint32_t total = 0;
+  for (uint32_t i = 0; i < APP_HISTOGRAM_NUM_BUCKETS; i++) {
+    total += histogram->buckets[i];
+  }
+  if (total == 0) {
+    return 0;
+  }
+
+  const uint32_t rank = (uint32_t)((((uint64_t)total * permille) + 999) / 1000);
+  uint32_t seen = 0;
+  uint32_t bucket = 0;
+  for (; bucket < APP_HISTOGRAM_NUM_BUCKETS - 1; bucket++) {
+    seen += histogram->buckets[bucket];
+    if ((seen >= rank) && (seen > 0)) {
+      break;
+    }
+  }
+
+  uint32_t estimate = prv_bucket_midpoint(bucket);
+  if (estimate < histogram->min) {
+    estimate = histogram->min;
+  }
+  if (estimate > histogram->max) {
+    estimate = histogram->max;
+  }
+  return estimate;
+}
+
+void app_histogram_summarize(const sAppHistogram *histogram, sAppHistogramSummary *summary) {
+  if (histogram->count == 0) {
+    *summary = (sAppHistogramSummary){ 0 };
+    return;
+  }
+  *summary = (sAppHistogramSummary){
+    .count = histogram->count,
+    .min = histogram->min,
+    .max = histogram->max,
+    .mean = app_histogram_mean(histogram),
+    .p50 = app_histogram_percentile(histogram, 500),
+    .p95 = app_histogram_percentile(histogram, 950),
+  };
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+//! @file
+//!
+//! @brief
+//! Fixed-size histogram of unsigned samples with min/max/mean and percentile estimates
+//!
+//! Samples are counted in half-octave buckets: every power of two is split in two, so [0, 4)
+//! get a bucket each, then [4, 6), [6, 8), [8, 12), [12, 16), ... up to 2^32. A percentile is
+//! estimated as the midpoint of the bucket it falls in, clamped to the observed min/max, which
+//! keeps the error below ~20% of the value for any distribution without storing samples.
+//!
+//! Not thread safe, callers serialize access.
+
+#include <stdint.h>
+
+//! 2 buckets per power of two over 32 bits
+#define APP_HISTOGRAM_NUM_BUCKETS (64)
+
+typedef struct {
+  uint32_t min;
+  uint32_t max;
+  uint64_t sum;
+  uint32_t count;
+  uint16_t buckets[APP_HISTOGRAM_NUM_BUCKETS];
+} sAppHistogram;
+
+//! The aggregates reported for a histogram, small enough to take under a lock and keep on a
+//! task stack instead of a copy of the histogram
+typedef struct {
+  uint32_t count;
+  uint32_t min;
+  uint32_t max;
+  uint32_t mean;
+  uint32_t p50;
+  uint32_t p95;
+} sAppHistogramSummary;
+
+void app_histogram_reset(sAppHistogram *histogram);
+
+void app_histogram_add(sAppHistogram *histogram, uint32_t value);
+
+//! @return The mean of the samples, 0 if there are none
+uint32_t app_histogram_mean(const sAppHistogram *histogram);
+
+//! Fills the summary, all zero if there are no samples
+void app_histogram_summarize(const sAppHistogram *histogram, sAppHistogramSummary *summary);
+
+//! Estimates a percentile
+//!
+//! @param permille The percentile in tenths of a percent, e.g 950 for p95
+//! @return The estimate, 0 if there are no samples
+uint32_t app_histogram_percentile(const sAppHistogram *histogram, uint32_t permille);
@@ -0,0 +1,341 @@
+//! @file
+//!
+//! @brief
+//! Network impairment for the upload client, see app_impair.h
+
+#include "app_impair.h"
+
+#include <FreeRTOS.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <task.h>
+
+#include "app_log.h"
+#include "app_upload.h"
+#include "cy_syslib.h"
+#include "memfault/components.h"
+
+#if APP_IMPAIR_ENABLED
+
+#define APP_IMPAIR_DEFAULT_LOG_LINES (64)
+// lwIP does not retransmit faster than this, whatever the RTT
+#define APP_IMPAIR_MIN_RTO_MS (1000)
+#define APP_IMPAIR_MAX_RTO_MS (60 * 1000)
+// Flights of the TCP and TLS 1.2 handshakes sent by either side
+#define APP_IMPAIR_HANDSHAKE_SEGMENTS (4)
+#define APP_IMPAIR_HANDSHAKE_ROUND_TRIPS (3)
+// Fixed, so a scenario injects the same faults every run
+#define APP_IMPAIR_SEED (0x2545f491)
+
+typedef enum {
+#define APP_IMPAIR_SCENARIO_ENUM(name_, loss_, rtt_, bandwidth_, reset_, lost_response_) \
+  kAppImpairScenario_##name_,
+  APP_IMPAIR_SCENARIOS(APP_IMPAIR_SCENARIO_ENUM)
+#undef APP_IMPAIR_SCENARIO_ENUM
+  kAppImpairScenario_NumScenarios,
+} eAppImpairScenario;
+
+typedef struct {
+  const char *name;
+  uint32_t loss_pct;
+  uint32_t rtt_ms;
+  uint32_t bandwidth_bytes_per_s;
+  uint32_t reset_within_bytes;
+  uint32_t lost_response_pct;
+} sAppImpairScenario;
+
+typedef struct {
+  eAppImpairScenario scenario;
+  bool active;
+  bool drained;
+  //! When the run was requested, for the timeout
+  TickType_t armed;
+  //! Set by the first connect of the run, when the HTTP task picked it up
+  bool started;
+  TickType_t start;
+  uint32_t drain_ms;
+  uint32_t posts;
+  uint32_t failed_posts;
+  //! Bytes handed to the socket
+  uint32_t socket_bytes;
+  //! Bytes TCP would have sent again for lost segments
+  uint32_t retransmitted_bytes;
+  //! Bytes of failed posts which ended before the end of the chunk, the client sends the chunk
+  //! again in a new post
+  uint32_t reposted_bytes;
+  //! Failed posts which reached the end of the chunk, which is not posted again
+  uint32_t lost_chunks;
+  uint32_t resets;
+  //! Responses dropped after the whole request was sent
+  uint32_t lost_responses;
+  uint32_t injected_delay_ms;
+} sAppImpairRun;
+
+//! State of the connection in progress
+typedef struct {
+  uint32_t bytes;
+  //! Byte offset at which the connection fails, 0 for never
+  uint32_t reset_at;
+  bool awaiting_response;
+} sAppImpairConn;
+
+static const sAppImpairScenario s_scenarios[kAppImpairScenario_NumScenarios] = {
+#define APP_IMPAIR_SCENARIO_INIT(name_, loss_, rtt_, bandwidth_, reset_, lost_response_) \
+  [kAppImpairScenario_##name_] = {                                                       \
+    .name = #name_,                                                                      \
+    .loss_pct = (loss_),                                                                 \
+    .rtt_ms = (rtt_),                                                                    \
+    .bandwidth_bytes_per_s = (bandwidth_),                                               \
+    .reset_within_bytes = (reset_),                                                      \
+    .lost_response_pct = (lost_response_),                                               \
+  },
+  APP_IMPAIR_SCENARIOS(APP_IMPAIR_SCENARIO_INIT)
+#undef APP_IMPAIR_SCENARIO_INIT
+};
+
+static eAppImpairScenario s_scenario = kAppImpairScenario_off;
+static sAppImpairRun s_run;
+static sAppImpairConn s_conn;
+static uint32_t s_rng_state = APP_IMPAIR_SEED;
+
+static uint32_t prv_random(void) {
+  s_rng_state ^= s_rng_state << 13;
+  s_rng_state ^= s_rng_state >> 17;
+  s_rng_state ^= s_rng_state << 5;
+  return s_rng_state;
+}
+
+static bool prv_chance(uint32_t pct) {
+  return (pct != 0) && ((prv_random() % 100) < pct);
+}
+
+static const sAppImpairScenario *prv_scenario(void) {
+  return &s_scenarios[s_scenario];
+}
+
+static void prv_delay_ms(uint32_t delay_ms) {
+  if (delay_ms == 0) {
+    return;
+  }
+  vTaskDelay(pdMS_TO_TICKS(delay_ms));
+  s_run.injected_delay_ms += delay_ms;
+}
+
+//! Delays by the retransmission timeouts of a segment until it gets through
+//!
+//! @return Number of times the segment was lost
+static uint32_t prv_send_segment(void) {
+  const sAppImpairScenario *scenario = prv_scenario();
+  uint32_t rto_ms = MEMFAULT_MAX(APP_IMPAIR_MIN_RTO_MS, 2 * scenario->rtt_ms);
+  uint32_t losses = 0;
+  while (prv_chance(scenario->loss_pct)) {
+    prv_delay_ms(rto_ms);
+    rto_ms = MEMFAULT_MIN(rto_ms * 2, APP_IMPAIR_MAX_RTO_MS);
+    losses++;
+  }
+  return losses;
+}
+
+cy_rslt_t app_impair_connect(cy_socket_t handle, cy_socket_sockaddr_t *address,
+                             uint32_t address_length) {
+  const sAppImpairScenario *scenario = prv_scenario();
+  s_conn = (sAppImpairConn){ 0 };
+  if (s_run.active && !s_run.started) {
+    s_run.started = true;
+    s_run.start = xTaskGetTickCount();
+  }
+  if (s_scenario != kAppImpairScenario_off) {
+    if (scenario->reset_within_bytes != 0) {
+      s_conn.reset_at = 1 + (prv_random() % scenario->reset_within_bytes);
+    }
+    prv_delay_ms(APP_IMPAIR_HANDSHAKE_ROUND_TRIPS * scenario->rtt_ms);
+    for (uint32_t i = 0; i < APP_IMPAIR_HANDSHAKE_SEGMENTS; i++) {
+      prv_send_segment();
+    }
+  }
+  return cy_socket_connect(handle, address, address_length);
+}
+
+cy_rslt_t app_impair_send(cy_socket_t handle, const void *buffer, uint32_t length, int flags,
+                          uint32_t *bytes_sent) {
+  const sAppImpairScenario *scenario = prv_scenario();
+  if (s_scenario != kAppImpairScenario_off) {
+    if ((s_conn.reset_at != 0) && ((s_conn.bytes + length) >= s_conn.reset_at)) {
+      s_run.resets++;
+      return CY_RSLT_MODULE_SECURE_SOCKETS_CLOSED;
+    }
+    if (scenario->bandwidth_bytes_per_s != 0) {
+      prv_delay_ms((uint32_t)(((uint64_t)length * 1000) / scenario->bandwidth_bytes_per_s));
+    }
+    for (uint32_t offset = 0; offset < length; offset += APP_UPLOAD_TCP_MSS) {
+      const uint32_t segment_len = MEMFAULT_MIN(length - offset, APP_UPLOAD_TCP_MSS);
+      s_run.retransmitted_bytes += prv_send_segment() * segment_len;
+    }
+  }
+
+  const cy_rslt_t rv = cy_socket_send(handle, buffer, length, flags, bytes_sent);
+  if (rv == CY_RSLT_SUCCESS) {
+    s_conn.bytes += *bytes_sent;
+    s_conn.awaiting_response = true;
+    s_run.socket_bytes += *bytes_sent;
+  }
+  return rv;
+}
+
+cy_rslt_t app_impair_recv(cy_socket_t handle, void *buffer, uint32_t length, int flags,
+                          uint32_t *bytes_received) {
+  const sAppImpairScenario *scenario = prv_scenario();
+  if ((s_scenario != kAppImpairScenario_off) && s_conn.awaiting_response) {
+    s_conn.awaiting_response = false;
+    prv_delay_ms(scenario->rtt_ms);
+    if (prv_chance(scenario->lost_response_pct)) {
+      s_run.lost_responses++;
+      return CY_RSLT_MODULE_SECURE_SOCKETS_CLOSED;
+    }
+  }
+  return cy_socket_recv(handle, buffer, length, flags, bytes_received);
+}
+
+void app_impair_post_done(bool accepted, bool chunk_read) {
+  if (s_run.active) {
+    s_run.posts++;
+    if (!accepted) {
+      s_run.failed_posts++;
+      if (chunk_read) {
+        s_run.lost_chunks++;
+      } else {
+        s_run.reposted_bytes += s_conn.bytes;
+      }
+    }
+  }
+  s_conn = (sAppImpairConn){ 0 };
+}
+
+static uint32_t prv_ms_since(TickType_t start) {
+  return (uint32_t)((xTaskGetTickCount() - start) * portTICK_PERIOD_MS);
+}
+
+static void prv_print_run(const sAppImpairRun *run) {
+  if (run->active && !run->started) {
+    MEMFAULT_LOG_INFO("Scenario %s: waiting for the next upload cycle",
+                      s_scenarios[run->scenario].name);
+    return;
+  }
+  const char *state = run->active ? "running" : (run->drained ? "drained" : "timed out");
+  MEMFAULT_LOG_INFO("Scenario %s: %s after %" PRIu32 " ms", s_scenarios[run->scenario].name,
+                    state, run->active ? prv_ms_since(run->start) : run->drain_ms);
+  MEMFAULT_LOG_INFO("Posts: %" PRIu32 " (%" PRIu32 " failed, %" PRIu32 " chunks lost), %" PRIu32
+                    " resets, %" PRIu32 " lost responses",
+                    run->posts, run->failed_posts, run->lost_chunks, run->resets,
+                    run->lost_responses);
+  MEMFAULT_LOG_INFO("Bytes: %" PRIu32 " sent, %" PRIu32 " retransmitted by TCP, %" PRIu32
+                    " posted again",
+                    run->socket_bytes, run->retransmitted_bytes, run->reposted_bytes);
+  MEMFAULT_LOG_INFO("Injected delay: %" PRIu32 " ms", run->injected_delay_ms);
+}
+
+static void prv_finish_run(bool drained) {
+  const uint32_t irq_state = Cy_SysLib_EnterCriticalSection();
+  s_run.active = false;
+  s_run.drained = drained;
+  s_run.drain_ms = s_run.started ? prv_ms_since(s_run.start) : 0;
+  s_scenario = kAppImpairScenario_off;
+  Cy_SysLib_ExitCriticalSection(irq_state);
+
+  if (drained) {
+    APP_LOG_INFO("Impairment run drained in %" PRIu32 " ms", s_run.drain_ms);
+  } else {
+    APP_LOG_WARN("Impairment run stopped, not drained after %" PRIu32 " ms", s_run.drain_ms);
+  }
+}
+
+void app_impair_cycle_done(int rv) {
+  if (!s_run.active) {
+    return;
+  }
+  if (rv == 1) {
+    prv_finish_run(true);
+  } else if (prv_ms_since(s_run.armed) > APP_IMPAIR_RUN_TIMEOUT_MS) {
+    prv_finish_run(false);
+  }
+}
+
+bool app_impair_run_active(void) {
+  return s_run.active;
+}
+
+//! Logs test data and makes it uploadable, so the run has something to drain
+static void prv_fill(uint32_t lines) {
+  for (uint32_t i = 0; i < lines; i++) {
+    MEMFAULT_LOG_SAVE(kMemfaultPlatformLogLevel_Info,
+                      "impair fill %" PRIu32 "/%" PRIu32 ": padding to a typical log line", i + 1,
+                      lines);
+  }
+  memfault_log_trigger_collection();
+}
+
+int app_impair_cli_cmd(int argc, char *argv[]) {
+  if (argc < 2) {
+    MEMFAULT_LOG_INFO("%-14s %5s %6s %10s %9s %9s", "Scenario", "Loss%", "RTT ms", "Bytes/s",
+                      "Reset <B", "LostRsp%");
+    for (eAppImpairScenario i = 0; i < kAppImpairScenario_NumScenarios; i++) {
+      const sAppImpairScenario *scenario = &s_scenarios[i];
+      MEMFAULT_LOG_INFO("%-14s %5" PRIu32 " %6" PRIu32 " %10" PRIu32 " %9" PRIu32 " %9" PRIu32
+                        "%s",
+                        scenario->name, scenario->loss_pct, scenario->rtt_ms,
+                        scenario->bandwidth_bytes_per_s, scenario->reset_within_bytes,
+                        scenario->lost_response_pct, (i == s_scenario) ? " *" : "");
+    }
+    const uint32_t irq_state = Cy_SysLib_EnterCriticalSection();
+    const sAppImpairRun run = s_run;
+    Cy_SysLib_ExitCriticalSection(irq_state);
+    if (run.scenario != kAppImpairScenario_off) {
+      prv_print_run(&run);
+    }
+    return 0;
+  }
+
+  eAppImpairScenario scenario = kAppImpairScenario_NumScenarios;
+  for (eAppImpairScenario i = 0; i < kAppImpairScenario_NumScenarios; i++) {
+    if (strcmp(argv[1], s_scenarios[i].name) == 0) {
+      scenario = i;
+    }
+  }
+  if (scenario == kAppImpairScenario_NumScenarios) {
+    MEMFAULT_LOG_ERROR("Unknown scenario '%s'", argv[1]);
+    return -1;
+  }
+  if (scenario == kAppImpairScenario_off) {
+    const uint32_t irq_state = Cy_SysLib_EnterCriticalSection();
+    s_run.active = false;
+    s_scenario = kAppImpairScenario_off;
+    Cy_SysLib_ExitCriticalSection(irq_state);
+    return 0;
+  }
+
+  const uint32_t lines =
+    (argc > 2) ? (uint32_t)strtoul(argv[2], NULL, 0) : APP_IMPAIR_DEFAULT_LOG_LINES;
+  prv_fill(lines);
+
+  const uint32_t irq_state = Cy_SysLib_EnterCriticalSection();
+  s_rng_state = APP_IMPAIR_SEED;
+  s_run = (sAppImpairRun){
+    .scenario = scenario,
+    .active = true,
+    .armed = xTaskGetTickCount(),
+  };
+  s_scenario = scenario;
+  Cy_SysLib_ExitCriticalSection(irq_state);
+  MEMFAULT_LOG_INFO("Running %s from the next upload cycle", s_scenarios[scenario].name);
+  return 0;
+}
+
+#else
+
+int app_impair_cli_cmd(int argc, char *argv[]) {
+  MEMFAULT_LOG_INFO("Impairment disabled, build with DEFINES+=APP_IMPAIR_ENABLED=1");
+  return -1;
+}
+
+#endif /* APP_IMPAIR_ENABLED */
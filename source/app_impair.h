@@ -0,0 +1,92 @@
+#pragma once
+
+//! @file
+//!
+//! @brief
+//! Network impairment for the upload client, to measure retries under field conditions
+//!
+//! app_upload.c calls the socket functions through the wrappers below, so only uploads with
+//! APP_UPLOAD_ZERO_COPY are impaired. A scenario adds delays and failures on the device's side
+//! of the socket:
+//!
+//! - loss: each TCP segment sent is lost with this probability and costs one retransmission
+//!   timeout, doubling for every further loss of the same segment
+//! - RTT: the connect takes 3 round trips (TCP plus TLS 1.2), a response one round trip
+//! - bandwidth: sends are delayed by their serialization time
+//! - resets: the connection fails at a random byte offset within the first N bytes sent
+//! - lost responses: the connection fails after the whole request was sent
+//!
+//! A post that fails before the packetizer reached the end of its chunk is aborted and the
+//! chunk is posted again. Once the end was reached the chunk is marked read and an abort doesn't
+//! rewind it, so a failure in the last record or while waiting for the response loses the chunk.
+//! Those posts are counted as lost chunks. With a lost response the server did get the chunk,
+//! but on a real link the device can't tell that apart from a lost request.
+//!
+//! Data still goes to the real chunks endpoint. `impair
+//! <scenario>` logs test data and starts a run with the HTTP task's next upload cycle. The HTTP
+//! task then drains back to back, backing off after failures as usual, until nothing is left to
+//! post. The time to drain is measured from the first connect of the run.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cy_secure_sockets.h"
+
+//! 1 to build the impairment wrappers, 0 to call the socket functions directly
+#ifndef APP_IMPAIR_ENABLED
+  #define APP_IMPAIR_ENABLED 0
+#endif
+
+//! A run that has not drained by then is stopped
+#ifndef APP_IMPAIR_RUN_TIMEOUT_MS
+  #define APP_IMPAIR_RUN_TIMEOUT_MS (15 * 60 * 1000)
+#endif
+
+//! X(name, loss %, RTT ms, bandwidth bytes/s (0 = unlimited), reset within bytes (0 = never),
+//!   lost response %)
+#define APP_IMPAIR_SCENARIOS(X)         \
+  X(off, 0, 0, 0, 0, 0)                 \
+  X(lossy, 10, 150, 0, 0, 0)            \
+  X(satellite, 1, 700, 0, 0, 0)         \
+  X(slow, 2, 300, 2000, 0, 0)           \
+  X(resets, 0, 100, 0, 3000, 0)         \
+  X(lost_response, 0, 100, 0, 0, 25)
+
+#if APP_IMPAIR_ENABLED
+
+cy_rslt_t app_impair_connect(cy_socket_t handle, cy_socket_sockaddr_t *address,
+                             uint32_t address_length);
+
+cy_rslt_t app_impair_send(cy_socket_t handle, const void *buffer, uint32_t length, int flags,
+                          uint32_t *bytes_sent);
+
+cy_rslt_t app_impair_recv(cy_socket_t handle, void *buffer, uint32_t length, int flags,
+                          uint32_t *bytes_received);
+
+//! Called by the upload client when a post completes
+//!
+//! @param chunk_read true if the packetizer reached the end of the chunk, which is then not
+//! posted again if the post failed
+void app_impair_post_done(bool accepted, bool chunk_read);
+
+//! Called by the HTTP task with the result of each upload cycle, see app_drain_run()
+void app_impair_cycle_done(int rv);
+
+//! Returns true while a run is draining
+bool app_impair_run_active(void);
+
+#else
+
+  #define app_impair_connect cy_socket_connect
+  #define app_impair_send cy_socket_send
+  #define app_impair_recv cy_socket_recv
+  #define app_impair_post_done(accepted_, chunk_read_) ((void)(accepted_), (void)(chunk_read_))
+  #define app_impair_cycle_done(rv_) ((void)(rv_))
+  #define app_impair_run_active() (false)
+
+#endif /* APP_IMPAIR_ENABLED */
+
+//! Shell command which starts a scenario run or prints the results of the last one
+//!
+//! Usage: impair [scenario [log_lines]]
+int app_impair_cli_cmd(int argc, char *argv[]);
@@ -1,3 +1,4 @@
+#include "app_trace.h"
 #include "cyhal.h"
 #include "mtb_kvstore.h"
 
@@ -62,6 +63,13 @@ static mtb_kvstore_bd_t block_device = {
   .context = &flash_obj,
 };
 
+//! A missing key is an expected outcome for the caller to handle, not a kv-store error
+static void prv_trace_error(cy_rslt_t result) {
+  if ((result != CY_RSLT_SUCCESS) && (result != MTB_KVSTORE_ITEM_NOT_FOUND_ERROR)) {
+    APP_TRACE_EVENT(KvStoreError, result);
+  }
+}
+
 void app_kvstore_init(void) {
   cy_rslt_t result = cyhal_flash_init(&flash_obj);
   CY_ASSERT(result == CY_RSLT_SUCCESS);
@@ -78,13 +86,23 @@ void app_kvstore_init(void) {
 }
 
 cy_rslt_t app_kvstore_write(const char* key, const uint8_t* data, uint32_t data_len) {
-  return mtb_kvstore_write(&obj, key, data, data_len);
+  const cy_rslt_t result = mtb_kvstore_write(&obj, key, data, data_len);
+  prv_trace_error(result);
+  return result;
 }
 
 cy_rslt_t app_kvstore_read(const char* key, uint8_t* data, uint32_t* data_len) {
-  return mtb_kvstore_read(&obj, key, data, data_len);
+  const cy_rslt_t result = mtb_kvstore_read(&obj, key, data, data_len);
+  prv_trace_error(result);
+  return result;
 }
 
 bool app_kvstore_key_exists(const char* key) {
   return mtb_kvstore_key_exists(&obj, key) == CY_RSLT_SUCCESS ? true : false;
 }
+
+cy_rslt_t app_kvstore_delete(const char* key) {
+  const cy_rslt_t result = mtb_kvstore_delete(&obj, key);
+  prv_trace_error(result);
+  return result;
+}
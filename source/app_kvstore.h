@@ -39,3 +39,9 @@ cy_rslt_t app_kvstore_read(const char *key, uint8_t *data, uint32_t *data_len);
 //! @param key Key to check for existence in the store
 //! @returns True if key exists, otherwise false
 bool app_kvstore_key_exists(const char *key);
+
+//! Removes a key and its value from the store
+//!
+//! @param key Key to remove
+//! @returns CY_RSLT_SUCCESS if the key was removed, otherwise error number
+cy_rslt_t app_kvstore_delete(const char *key);
@@ -0,0 +1,315 @@
+//! @file
+//!
+//! @brief
+//! Duplicate log collapsing and cost comparison of the logging paths, see app_log.h
+
+#include "app_log.h"
+
+#include <FreeRTOS.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <task.h>
+
+#include "app_config.h"
+#include "app_cycles.h"
+#include "app_metrics.h"
+#include "memfault/components.h"
+
+#define APP_LOG_BENCH_DEFAULT_ITERATIONS (32)
+// Every console log is a full line on the UART, keep that run short
+#define APP_LOG_BENCH_MAX_CONSOLE_ITERATIONS (8)
+
+// A connect_to_wifi_ap() call with the default wifi_join_retries, repeated a few times. Small
+// enough for both runs to fit in the log buffer.
+#define APP_LOG_STORM_DEFAULT_BURSTS (4)
+#define APP_LOG_STORM_DEFAULT_RETRIES (5)
+
+// FNV-1a
+#define APP_LOG_HASH_OFFSET (2166136261u)
+#define APP_LOG_HASH_PRIME (16777619u)
+
+//! The log last saved and the repeats of it dropped since
+typedef struct {
+  bool valid;
+  eMemfaultPlatformLogLevel level;
+  uint32_t fingerprint;
+  uint32_t repeats;
+  //! Uptime of the first and the last repeat
+  uint32_t first_ms;
+  uint32_t last_ms;
+} sAppLogDedupRun;
+
+//! Guarded by memfault_lock()
+static sAppLogDedupRun s_dedup_run;
+//! Set by log_storm to measure the same workload without deduplication
+static bool s_dedup_bypass;
+static uint32_t s_dropped;
+static uint32_t s_last_reported_dropped;
+
+static uint32_t prv_hash(uint32_t hash, const void *data, size_t len) {
+  const uint8_t *bytes = data;
+  for (size_t i = 0; i < len; i++) {
+    hash = (hash ^ bytes[i]) * APP_LOG_HASH_PRIME;
+  }
+  return hash;
+}
+
+//! Hashes the call site and the arguments. compressed_fmt holds the promoted type of each
+//! argument in 2 bits, first argument first, below a leading 1 bit, the encoding the SDK's
+//! compact log serializer walks the same way.
+static uint32_t prv_fingerprint(const void *site, uint32_t compressed_fmt, va_list args) {
+  uint32_t hash = prv_hash(APP_LOG_HASH_OFFSET, &site, sizeof(site));
+  const size_t num_args = (31 - __builtin_clz(compressed_fmt)) / 2;
+  for (size_t i = 0; i < num_args; i++) {
+    const uint32_t type = (compressed_fmt >> ((num_args - i - 1) * 2)) & 0x3;
+    switch (type) {
+      case MEMFAULT_LOG_ARG_PROMOTED_TO_INT32: {
+        const int32_t value = va_arg(args, int32_t);
+        hash = prv_hash(hash, &value, sizeof(value));
+        break;
+      }
+      case MEMFAULT_LOG_ARG_PROMOTED_TO_INT64: {
+        const int64_t value = va_arg(args, int64_t);
+        hash = prv_hash(hash, &value, sizeof(value));
+        break;
+      }
+      case MEMFAULT_LOG_ARG_PROMOTED_TO_DOUBLE: {
+        const double value = va_arg(args, double);
+        hash = prv_hash(hash, &value, sizeof(value));
+        break;
+      }
+      case MEMFAULT_LOG_ARG_PROMOTED_TO_STR:
+      default: {
+        // The contents, the same buffer may be logged with different text
+        const char *value = va_arg(args, const char *);
+        if (value != NULL) {
+          hash = prv_hash(hash, value, strnlen(value, MEMFAULT_LOG_MAX_LINE_SAVE_LEN));
+        }
+        break;
+      }
+    }
+  }
+  return hash;
+}
+
+static void prv_save_run(const sAppLogDedupRun *run) {
+  if (!run->valid || (run->repeats == 0)) {
+    return;
+  }
+  MEMFAULT_LOG_SAVE(run->level,
+                    "Previous log repeated %" PRIu32 " more times, from %" PRIu32 " to %" PRIu32
+                    " ms uptime",
+                    run->repeats, run->first_ms, run->last_ms);
+}
+
+bool app_log_dedup_check(eMemfaultPlatformLogLevel level, const void *site,
+                         uint32_t compressed_fmt, ...) {
+  // Before memfault_platform_boot() the SDK drops saved logs and memfault_lock() isn't set up
+  if (!memfault_log_booted()) {
+    return true;
+  }
+  // Held until app_log_dedup_end(), so the repeat count saved below and the new log stay right
+  // after the run they belong to
+  memfault_lock();
+
+  // Logs below the save level are dropped by the SDK and must not end a run
+  if (s_dedup_bypass || !APP_CONFIG_GET(log_dedup) ||
+      (level < (eMemfaultPlatformLogLevel)APP_CONFIG_GET(log_save_level))) {
+    return true;
+  }
+
+  va_list args;
+  va_start(args, compressed_fmt);
+  const uint32_t fingerprint = prv_fingerprint(site, compressed_fmt, args);
+  va_end(args);
+  const uint32_t now_ms = (uint32_t)(xTaskGetTickCount() * portTICK_PERIOD_MS);
+
+  if (s_dedup_run.valid && (s_dedup_run.fingerprint == fingerprint)) {
+    if (s_dedup_run.repeats == 0) {
+      s_dedup_run.first_ms = now_ms;
+    }
+    s_dedup_run.repeats++;
+    s_dedup_run.last_ms = now_ms;
+    s_dropped++;
+    return false;
+  }
+
+  prv_save_run(&s_dedup_run);
+  s_dedup_run = (sAppLogDedupRun){
+    .valid = true,
+    .level = level,
+    .fingerprint = fingerprint,
+  };
+  return true;
+}
+
+void app_log_dedup_end(void) {
+  if (memfault_log_booted()) {
+    memfault_unlock();
+  }
+}
+
+void app_log_dedup_flush(void) {
+  if (!memfault_log_booted()) {
+    return;
+  }
+  memfault_lock();
+  prv_save_run(&s_dedup_run);
+  s_dedup_run.valid = false;
+  memfault_unlock();
+}
+
+void app_log_collect_metrics(void) {
+  APP_METRIC_SET(log_dedup_dropped_count, s_dropped - s_last_reported_dropped);
+  s_last_reported_dropped = s_dropped;
+}
+
+static void prv_apply_save_level(eAppConfigKey key) {
+  memfault_log_set_min_save_level((eMemfaultPlatformLogLevel)APP_CONFIG_GET(log_save_level));
+}
+
+void app_log_init(void) {
+  prv_apply_save_level(kAppConfigKey_log_save_level);
+  app_config_register_callback(kAppConfigKey_log_save_level, prv_apply_save_level);
+}
+
+typedef enum {
+  kAppLogBenchPath_Deferred = 0,
+  kAppLogBenchPath_Formatted,
+  kAppLogBenchPath_Console,
+} eAppLogBenchPath;
+
+typedef struct {
+  uint32_t cycles;
+  uint32_t buffer_bytes;
+} sAppLogBenchResult;
+
+static void prv_log_once(eAppLogBenchPath path, uint32_t i) {
+  // A typical status log: a string and a couple of integers
+  switch (path) {
+    case kAppLogBenchPath_Deferred:
+      MEMFAULT_LOG_SAVE(kMemfaultPlatformLogLevel_Info, "bench %s: rv=0x%x attempt %d", "wifi",
+                        (int)i, (int)(i % 5));
+      break;
+    case kAppLogBenchPath_Formatted:
+      memfault_log_save(kMemfaultPlatformLogLevel_Info, "bench %s: rv=0x%x attempt %d", "wifi",
+                        (int)i, (int)(i % 5));
+      break;
+    case kAppLogBenchPath_Console:
+      memfault_platform_log(kMemfaultPlatformLogLevel_Info, "bench %s: rv=0x%x attempt %d",
+                            "wifi", (int)i, (int)(i % 5));
+      break;
+  }
+}
+
+static void prv_bench_run(eAppLogBenchPath path, uint32_t iterations, sAppLogBenchResult *result) {
+  const sMfltLogUnsentCount before = memfault_log_get_unsent_count();
+  uint32_t cycles = 0;
+  for (uint32_t i = 0; i < iterations; i++) {
+    const uint32_t start = app_cycles_get();
+    prv_log_once(path, i);
+    cycles += app_cycles_get() - start;
+  }
+  const sMfltLogUnsentCount after = memfault_log_get_unsent_count();
+
+  *result = (sAppLogBenchResult){
+    .cycles = cycles / iterations,
+    .buffer_bytes = (after.bytes > before.bytes) ? (after.bytes - before.bytes) / iterations : 0,
+  };
+}
+
+static void prv_bench_report(const char *name, const sAppLogBenchResult *result) {
+  MEMFAULT_LOG_INFO("%-10s %8" PRIu32 " cycles/call %6" PRIu32 " bytes/entry", name,
+                    result->cycles, result->buffer_bytes);
+}
+
+int app_log_bench_cli_cmd(int argc, char *argv[]) {
+  uint32_t iterations =
+    (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 0) : APP_LOG_BENCH_DEFAULT_ITERATIONS;
+  if (iterations == 0) {
+    iterations = 1;
+  }
+  app_cycles_init();
+
+  sAppLogBenchResult deferred;
+  sAppLogBenchResult formatted;
+  sAppLogBenchResult console;
+  prv_bench_run(kAppLogBenchPath_Deferred, iterations, &deferred);
+  prv_bench_run(kAppLogBenchPath_Formatted, iterations, &formatted);
+  prv_bench_run(kAppLogBenchPath_Console,
+                MEMFAULT_MIN(iterations, APP_LOG_BENCH_MAX_CONSOLE_ITERATIONS), &console);
+
+  prv_bench_report("deferred", &deferred);
+  prv_bench_report("formatted", &formatted);
+  prv_bench_report("console", &console);
+  if (deferred.buffer_bytes != 0) {
+    MEMFAULT_LOG_INFO("Log buffer capacity gain: %" PRIu32 ".%02" PRIu32 "x",
+                      formatted.buffer_bytes / deferred.buffer_bytes,
+                      ((formatted.buffer_bytes % deferred.buffer_bytes) * 100) /
+                        deferred.buffer_bytes);
+  }
+  return 0;
+}
+
+//! Logs what connect_to_wifi_ap() logs when every attempt fails, `bursts` times
+static void prv_storm_run(uint32_t bursts, uint32_t retries) {
+  for (uint32_t burst = 0; burst < bursts; burst++) {
+    for (uint32_t retry = 0; retry < retries; retry++) {
+      APP_LOG_SAVE(kMemfaultPlatformLogLevel_Warning,
+                   "Connection to Wi-Fi network failed with error code. rv=0x%x."
+                   "Retrying in %d ms...",
+                   0x4000403, (int)APP_CONFIG_GET(wifi_retry_delay_ms));
+    }
+    APP_LOG_SAVE(kMemfaultPlatformLogLevel_Error, "Exceeded maximum Wi-Fi connection attempts");
+  }
+  // Counted here, the upload cycle would save it before posting
+  app_log_dedup_flush();
+}
+
+static uint32_t prv_storm_bytes(uint32_t bursts, uint32_t retries) {
+  const sMfltLogUnsentCount before = memfault_log_get_unsent_count();
+  prv_storm_run(bursts, retries);
+  const sMfltLogUnsentCount after = memfault_log_get_unsent_count();
+  return (after.bytes > before.bytes) ? (after.bytes - before.bytes) : 0;
+}
+
+int app_log_storm_cli_cmd(int argc, char *argv[]) {
+  const uint32_t bursts =
+    (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 0) : APP_LOG_STORM_DEFAULT_BURSTS;
+  const uint32_t retries =
+    (argc > 2) ? (uint32_t)strtoul(argv[2], NULL, 0) : APP_LOG_STORM_DEFAULT_RETRIES;
+  if ((bursts == 0) || (retries == 0)) {
+    MEMFAULT_LOG_ERROR("Usage: log_storm [bursts] [retries]");
+    return -1;
+  }
+#if !APP_LOG_DEFERRED || !APP_LOG_DEDUP
+  MEMFAULT_LOG_WARN("Built without APP_LOG_DEDUP, both runs save every line");
+#endif
+  const uint32_t lines = bursts * (retries + 1);
+
+  // Starts both runs without a pending duplicate
+  app_log_dedup_flush();
+  s_dedup_bypass = true;
+  const uint32_t plain_bytes = prv_storm_bytes(bursts, retries);
+  s_dedup_bypass = false;
+  const uint32_t dropped_before = s_dropped;
+  const uint32_t dedup_bytes = prv_storm_bytes(bursts, retries);
+  const uint32_t dropped = s_dropped - dropped_before;
+
+  MEMFAULT_LOG_INFO("Retry storm: %" PRIu32 " bursts of %" PRIu32 " retries, %" PRIu32 " lines",
+                    bursts, retries, lines);
+  if ((plain_bytes == 0) || (dedup_bytes == 0)) {
+    MEMFAULT_LOG_ERROR("No log buffer bytes measured, is log_save_level above warning?");
+    return -1;
+  }
+  // Lines represented per KB of log buffer, the effective capacity
+  MEMFAULT_LOG_INFO("%-8s %6" PRIu32 " bytes %6" PRIu32 " lines/KB", "plain", plain_bytes,
+                    (lines * 1024) / plain_bytes);
+  MEMFAULT_LOG_INFO("%-8s %6" PRIu32 " bytes %6" PRIu32 " lines/KB, %" PRIu32 " dropped",
+                    "dedup", dedup_bytes, (lines * 1024) / dedup_bytes, dropped);
+  MEMFAULT_LOG_INFO("Bytes to upload: -%" PRIu32 "%%",
+                    ((plain_bytes - MEMFAULT_MIN(dedup_bytes, plain_bytes)) * 100) / plain_bytes);
+  return 0;
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+//! @file
+//!
+//! @brief
+//! Application status logging
+//!
+//! With APP_LOG_DEFERRED enabled (the default), a log call stores only the format string's
+//! address and the raw arguments in the Memfault log buffer, using the SDK's compact logs. The
+//! format strings live in the log_fmt section of the ELF, which is not loaded on the device, and
+//! the logs are formatted when Memfault decodes the uploaded data. Warnings and errors are also
+//! printed to the console right away so they remain visible on a serial terminal.
+//!
+//! Use these for status and diagnostic logs. Output which is the response to a shell command
+//! must keep using MEMFAULT_LOG_*, which prints to the console.
+//!
+//! With APP_LOG_DEDUP enabled (the default), a deferred log which repeats the previous one, i.e.
+//! the same call site with the same arguments, is not saved or printed again. It is counted, and
+//! once a different log comes in, or at the start of the next upload cycle, a single entry
+//! records how often it repeated and the uptime of the first and last repeat. Retry loops then
+//! take a few entries of the log buffer instead of one per attempt. Any other log in between ends
+//! the run. The `log_dedup` config key turns it off at runtime.
+//!
+//! The repeat count is saved as its own entry right after the repeated line: compact log entries
+//! hold the arguments of their format string and have no room for a count. The check, the count
+//! and the new log are saved under memfault_lock(), so no other task's log lands in between.
+//!
+//! Deduplicated logs evaluate their arguments twice, once to compare them and once to save them,
+//! so the arguments must not have side effects.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "memfault/components.h"
+
+#ifndef APP_LOG_DEFERRED
+  #define APP_LOG_DEFERRED 1
+#endif
+
+#ifndef APP_LOG_DEDUP
+  #define APP_LOG_DEDUP 1
+#endif
+
+#if APP_LOG_DEFERRED
+
+  //! Passed as print_ for logs which are only saved
+  #define APP_LOG_NO_PRINT(...) \
+    do {                        \
+    } while (0)
+
+  #if APP_LOG_DEDUP
+    //! The address of a byte in this section identifies a call site. The section is not loaded on
+    //! the device, see configs/memfault_compact_log.ld.
+    #define APP_LOG_SITE_SECTION __attribute__((section("app_log_site")))
+
+    //! Saves and then prints the log unless it repeats the previous one. The format string is only
+    //! passed to MEMFAULT_LOG_SAVE and print_, so it stays out of the loaded image unless printed.
+    //! The console print is outside the lock.
+    #define APP_LOG_DEDUP_RUN(print_, level_, fmt_, ...)                                      \
+      do {                                                                                    \
+        static const char s_app_log_site APP_LOG_SITE_SECTION = 0;                            \
+        const bool app_log_new_ = app_log_dedup_check(                                        \
+          (level_), &s_app_log_site, MFLT_GET_COMPRESSED_LOG(fmt_, ##__VA_ARGS__),            \
+          ##__VA_ARGS__);                                                                     \
+        if (app_log_new_) {                                                                   \
+          MEMFAULT_LOG_SAVE((level_), fmt_, ##__VA_ARGS__);                                   \
+        }                                                                                     \
+        app_log_dedup_end();                                                                  \
+        if (app_log_new_) {                                                                   \
+          print_((level_), fmt_, ##__VA_ARGS__);                                              \
+        }                                                                                     \
+      } while (0)
+  #else
+    #define APP_LOG_DEDUP_RUN(print_, level_, ...) \
+      do {                                         \
+        MEMFAULT_LOG_SAVE((level_), __VA_ARGS__);  \
+        print_((level_), __VA_ARGS__);             \
+      } while (0)
+  #endif
+
+  //! Saves a log to the Memfault log buffer without printing it, deduplicated like the others
+  #define APP_LOG_SAVE(level_, ...) APP_LOG_DEDUP_RUN(APP_LOG_NO_PRINT, level_, __VA_ARGS__)
+
+  #define APP_LOG_DEBUG(...) APP_LOG_SAVE(kMemfaultPlatformLogLevel_Debug, __VA_ARGS__)
+  #define APP_LOG_INFO(...) APP_LOG_SAVE(kMemfaultPlatformLogLevel_Info, __VA_ARGS__)
+  #define APP_LOG_WARN(...) \
+    APP_LOG_DEDUP_RUN(memfault_platform_log, kMemfaultPlatformLogLevel_Warning, __VA_ARGS__)
+  #define APP_LOG_ERROR(...) \
+    APP_LOG_DEDUP_RUN(memfault_platform_log, kMemfaultPlatformLogLevel_Error, __VA_ARGS__)
+
+#else
+
+  #define APP_LOG_SAVE(level_, ...) memfault_log_save(level_, __VA_ARGS__)
+  #define APP_LOG_DEBUG(...) MEMFAULT_LOG_DEBUG(__VA_ARGS__)
+  #define APP_LOG_INFO(...) MEMFAULT_LOG_INFO(__VA_ARGS__)
+  #define APP_LOG_WARN(...) MEMFAULT_LOG_WARN(__VA_ARGS__)
+  #define APP_LOG_ERROR(...) MEMFAULT_LOG_ERROR(__VA_ARGS__)
+
+#endif
+
+//! Called by APP_LOG_* with the compact log argument types the SDK computed for the call
+//!
+//! Takes memfault_lock() once the log buffer is booted, and saves the repeat count of the run
+//! this log ends. Must be followed by app_log_dedup_end() after the log is saved.
+//!
+//! @return false if the log repeats the previous one and must be dropped
+bool app_log_dedup_check(eMemfaultPlatformLogLevel level, const void *site,
+                         uint32_t compressed_fmt, ...);
+
+//! Releases the lock taken by app_log_dedup_check()
+void app_log_dedup_end(void);
+
+//! Saves the repeat count of a pending run of duplicates. Called before logs are uploaded.
+void app_log_dedup_flush(void);
+
+//! Records the number of duplicate logs dropped in the heartbeat
+void app_log_collect_metrics(void);
+
+//! Applies the log_save_level config key to the Memfault log buffer and follows its changes
+//!
+//! Must be called after memfault_platform_boot(), which sets the SDK's default level.
+void app_log_init(void);
+
+//! Shell command which compares the cost of the logging paths
+//!
+//! Reports cycles per call and log buffer bytes per entry for a deferred log, a log formatted
+//! into the log buffer and a log printed to the console.
+//!
+//! Usage: log_bench [iterations]
+int app_log_bench_cli_cmd(int argc, char *argv[]);
+
+//! Shell command which logs a Wi-Fi retry storm with and without deduplication and compares the
+//! log buffer bytes, i.e. the bytes to upload, and the lines that fit in 1 KB of log buffer
+//!
+//! Usage: log_storm [bursts] [retries]
+int app_log_storm_cli_cmd(int argc, char *argv[]);
@@ -0,0 +1,144 @@
+//! @file
+//!
+//! @brief
+//! Static RTOS object storage and RAM use per subsystem, see app_memmap.h
+
+#include "app_memmap.h"
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "app_heap_stats.h"
+#include "app_log.h"
+#include "memfault/components.h"
+
+// Symbols exported by the linker script
+extern uint8_t __data_start__;
+extern uint8_t __HeapBase;
+extern uint8_t __HeapLimit;
+// Symbols exported by configs/app_memmap.ld
+extern uint8_t __app_static_start;
+extern uint8_t __app_static_end;
+// Absolute symbol, its address is the value
+extern uint8_t __app_memmap_tls_heap_reserve;
+
+#define APP_MEMMAP_SUBSYSTEM_SYMBOLS(name_)    \
+  extern uint8_t __app_static_##name_##_start; \
+  extern uint8_t __app_static_##name_##_end;
+APP_MEMMAP_SUBSYSTEMS(APP_MEMMAP_SUBSYSTEM_SYMBOLS)
+#undef APP_MEMMAP_SUBSYSTEM_SYMBOLS
+
+typedef struct {
+  const char *name;
+  const uint8_t *start;
+  const uint8_t *end;
+} sAppMemmapSubsystemInfo;
+
+static const sAppMemmapSubsystemInfo s_subsystems[kAppMemmap_NumSubsystems] = {
+#define APP_MEMMAP_SUBSYSTEM_INFO(name_)    \
+  [kAppMemmap_##name_] = {                  \
+    .name = #name_,                         \
+    .start = &__app_static_##name_##_start, \
+    .end = &__app_static_##name_##_end,     \
+  },
+  APP_MEMMAP_SUBSYSTEMS(APP_MEMMAP_SUBSYSTEM_INFO)
+#undef APP_MEMMAP_SUBSYSTEM_INFO
+};
+
+//! Highest heap bytes reported per subsystem
+static uint32_t s_heap_bytes[kAppMemmap_NumSubsystems];
+
+typedef struct {
+  //! .data, .bss and the application's static sections, i.e. everything below the heap
+  uint32_t static_bytes;
+  uint32_t app_static_bytes;
+  uint32_t heap_size;
+  uint32_t heap_in_use;
+  uint32_t heap_peak;
+  uint32_t tls_reserve;
+  //! Free heap above the TLS reserve, negative if the reserve doesn't fit
+  int32_t tls_headroom;
+} sAppMemmapSummary;
+
+void app_memmap_init(void) {
+  memset(&__app_static_start, 0, (size_t)(&__app_static_end - &__app_static_start));
+}
+
+void app_memmap_set_heap(eAppMemmapSubsystem subsystem, uint32_t bytes) {
+  if (bytes > s_heap_bytes[subsystem]) {
+    s_heap_bytes[subsystem] = bytes;
+  }
+}
+
+uint32_t app_memmap_heap_begin(void) {
+  sAppHeapStats heap;
+  app_heap_stats_get(&heap);
+  return heap.in_use_bytes;
+}
+
+void app_memmap_heap_end(eAppMemmapSubsystem subsystem, uint32_t begin) {
+  const uint32_t in_use = app_memmap_heap_begin();
+  if (in_use > begin) {
+    app_memmap_set_heap(subsystem, in_use - begin);
+  }
+}
+
+static uint32_t prv_static_bytes(eAppMemmapSubsystem subsystem) {
+  return (uint32_t)(s_subsystems[subsystem].end - s_subsystems[subsystem].start);
+}
+
+static void prv_get_summary(sAppMemmapSummary *summary) {
+  sAppHeapStats heap;
+  app_heap_stats_get(&heap);
+
+  const uint32_t heap_size = (uint32_t)(&__HeapLimit - &__HeapBase);
+  const uint32_t tls_reserve = (uint32_t)(uintptr_t)&__app_memmap_tls_heap_reserve;
+  *summary = (sAppMemmapSummary){
+    .static_bytes = (uint32_t)(&__HeapBase - &__data_start__),
+    .app_static_bytes = (uint32_t)(&__app_static_end - &__app_static_start),
+    .heap_size = heap_size,
+    .heap_in_use = heap.in_use_bytes,
+    .heap_peak = heap.peak_bytes,
+    .tls_reserve = tls_reserve,
+    .tls_headroom = (int32_t)(heap_size - heap.in_use_bytes) - (int32_t)tls_reserve,
+  };
+}
+
+void app_memmap_boot_report(void) {
+  sAppMemmapSummary summary;
+  prv_get_summary(&summary);
+  APP_LOG_INFO("RAM: %" PRIu32 " bytes static (%" PRIu32 " app RTOS objects), heap %" PRIu32
+               " of %" PRIu32 " bytes in use",
+               summary.static_bytes, summary.app_static_bytes, summary.heap_in_use,
+               summary.heap_size);
+  if (summary.tls_headroom < 0) {
+    APP_LOG_ERROR("Free heap is %" PRId32 " bytes short of the %" PRIu32 " byte TLS reserve",
+                  -summary.tls_headroom, summary.tls_reserve);
+  }
+}
+
+int app_memmap_cli_cmd(int argc, char *argv[]) {
+  sAppMemmapSummary summary;
+  prv_get_summary(&summary);
+
+  MEMFAULT_LOG_INFO("%-12s %8s %8s", "Subsystem", "Static", "Heap");
+  for (eAppMemmapSubsystem subsystem = 0; subsystem < kAppMemmap_NumSubsystems; subsystem++) {
+    MEMFAULT_LOG_INFO("%-12s %8" PRIu32 " %8" PRIu32, s_subsystems[subsystem].name,
+                      prv_static_bytes(subsystem), s_heap_bytes[subsystem]);
+  }
+  // .data and .bss of the application, SDK, WHD, lwIP and mbedTLS
+  MEMFAULT_LOG_INFO("%-12s %8" PRIu32 " %8s", "other",
+                    summary.static_bytes - summary.app_static_bytes, "-");
+
+  MEMFAULT_LOG_INFO("Static RAM: %" PRIu32 " bytes", summary.static_bytes);
+  MEMFAULT_LOG_INFO("Heap: %" PRIu32 " bytes, %" PRIu32 " in use, peak %" PRIu32,
+                    summary.heap_size, summary.heap_in_use, summary.heap_peak);
+  MEMFAULT_LOG_INFO("TLS reserve: %" PRIu32 " bytes, headroom %" PRId32, summary.tls_reserve,
+                    summary.tls_headroom);
+  if (s_heap_bytes[kAppMemmap_tls] > summary.tls_reserve) {
+    MEMFAULT_LOG_WARN("TLS handshakes used up to %" PRIu32 " bytes, more than the reserve",
+                      s_heap_bytes[kAppMemmap_tls]);
+  }
+  return 0;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+//! @file
+//!
+//! @brief
+//! Static storage for the application's RTOS objects, and RAM use per subsystem
+//!
+//! The application creates its tasks, timers, event groups and semaphores with the FreeRTOS
+//! *Static() APIs. APP_STATIC() places their storage in one linker section per subsystem,
+//! see configs/app_memmap.ld. The stacks no longer come out of the newlib heap that mbedTLS
+//! allocates from, and a task that exits can't leave a hole in it.
+//!
+//! `memmap` prints, for each subsystem, the static bytes taken from the linker symbols and the
+//! most heap it was measured holding. It then prints the heap size and the headroom left above
+//! the TLS reserve, which the linker script also checks against the heap size. The report is
+//! logged once at boot before the first TLS handshake. scripts/memory_map.py builds the static
+//! side from the linker map file.
+
+#include <stdint.h>
+
+//! Keep in sync with configs/app_memmap.ld. Subsystems without RTOS objects of their own, e.g.
+//! tls, only report heap bytes.
+#define APP_MEMMAP_SUBSYSTEMS(X) \
+  X(cli)                         \
+  X(http)                        \
+  X(net)                         \
+  X(coredump)                    \
+  X(supervisor)                  \
+  X(sampler)                     \
+  X(wifi)                        \
+  X(tls)
+
+//! Places a variable in the static section of a subsystem, e.g.
+//! static StaticTask_t s_tcb APP_STATIC(cli);
+//!
+//! The startup code doesn't zero these sections, app_memmap_init() does.
+#define APP_STATIC(subsystem_) __attribute__((section(".bss.app_static." #subsystem_)))
+
+typedef enum {
+#define APP_MEMMAP_SUBSYSTEM_ENUM(name_) kAppMemmap_##name_,
+  APP_MEMMAP_SUBSYSTEMS(APP_MEMMAP_SUBSYSTEM_ENUM)
+#undef APP_MEMMAP_SUBSYSTEM_ENUM
+  kAppMemmap_NumSubsystems,
+} eAppMemmapSubsystem;
+
+//! Zeroes the static sections. Must be called first thing in main().
+void app_memmap_init(void);
+
+//! Records the heap bytes a subsystem holds, keeping the highest value reported since boot
+void app_memmap_set_heap(eAppMemmapSubsystem subsystem, uint32_t bytes);
+
+//! Returns the heap in use, to pass to app_memmap_heap_end() once a subsystem is initialized
+uint32_t app_memmap_heap_begin(void);
+
+//! Records the heap the subsystem's init kept, i.e. the growth since app_memmap_heap_begin().
+//! Allocations other tasks made in the meantime are counted too.
+void app_memmap_heap_end(eAppMemmapSubsystem subsystem, uint32_t begin);
+
+//! Logs the report, and an error if the free heap is below the TLS reserve. Called once the
+//! network stack is up, before the first TLS handshake.
+void app_memmap_boot_report(void);
+
+//! Shell command which prints static and heap bytes per subsystem and the TLS heap headroom
+int app_memmap_cli_cmd(int argc, char *argv[]);
@@ -0,0 +1,392 @@
+//! @file
+//!
+//! @brief
+//! Delta encoded heartbeat metrics, see app_metrics.h
+
+#include "app_metrics.h"
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "cy_syslib.h"
+#include "memfault/components.h"
+
+#if APP_METRICS_COMPACT
+
+//! A 32 bit varint
+  #define APP_METRICS_VARINT32_MAX_LEN (5)
+//! Type, sequence number, base sequence number and body length
+  #define APP_METRICS_FRAME_HEADER_MAX_LEN (1 + (3 * APP_METRICS_VARINT32_MAX_LEN))
+//! A delta frame with every key changed: a 2 byte index gap and a 33 bit zigzag difference each
+  #define APP_METRICS_FRAME_MAX_LEN                                    \
+    (APP_METRICS_FRAME_HEADER_MAX_LEN + APP_METRICS_VARINT32_MAX_LEN + \
+     (kAppMetric_NumKeys * (2 + APP_METRICS_VARINT32_MAX_LEN)))
+
+MEMFAULT_STATIC_ASSERT(APP_METRICS_FRAME_MAX_LEN <= APP_METRICS_BUFFER_SIZE,
+                       "The frame buffer must hold the largest frame");
+
+typedef struct {
+  uint32_t values[kAppMetric_NumKeys];
+  uint32_t set[(kAppMetric_NumKeys + 31) / 32];
+} sAppMetricsValues;
+
+typedef struct {
+  uint32_t keyframes;
+  uint32_t deltas;
+  //! Times frames were dropped because the buffer was full of frames waiting for upload
+  uint32_t overflows;
+  uint32_t frame_bytes;
+  //! What the SDK heartbeat would have taken for the same values
+  uint32_t sdk_bytes;
+  uint32_t last_frame_bytes;
+  uint32_t last_sdk_bytes;
+  uint32_t acked;
+  uint32_t retried;
+} sAppMetricsStats;
+
+static const char *s_names[kAppMetric_NumKeys] = {
+  #define MEMFAULT_METRICS_KEY_DEFINE(key_name, value_type) [kAppMetric_##key_name] = #key_name,
+  #include "app_metrics_config.def"
+  #undef MEMFAULT_METRICS_KEY_DEFINE
+};
+
+// Only touched by the timer task, which sets and collects the metrics
+static sAppMetricsValues s_current;
+//! Values of the last acknowledged frame, which delta frames are taken against
+static sAppMetricsValues s_base;
+static uint32_t s_base_seq;
+static bool s_has_base;
+//! Values of the last frame encoded
+static sAppMetricsValues s_latest;
+static uint32_t s_latest_seq;
+static uint32_t s_next_seq;
+static uint32_t s_since_keyframe;
+static uint8_t s_frame[APP_METRICS_FRAME_MAX_LEN];
+
+// Frames waiting for upload. The timer task appends, the task posting chunks reads and removes
+// them from the front. Lengths are updated in critical sections.
+static uint8_t s_buf[APP_METRICS_BUFFER_SIZE];
+static size_t s_len;
+static uint32_t s_queued_frames;
+static uint32_t s_queued_seq;
+//! Bytes and frames of the recording the packetizer is reading, and the last frame in it
+static size_t s_offered_len;
+static uint32_t s_offered_frames;
+static uint32_t s_offered_seq;
+//! The recording read by the packetizer, waiting for the result of the post
+static size_t s_inflight_len;
+static uint32_t s_inflight_frames;
+static uint32_t s_inflight_seq;
+//! Last frame acknowledged since the timer task looked
+static bool s_ack_pending;
+static uint32_t s_acked_seq;
+
+static sAppMetricsStats s_stats;
+
+static const char *s_mimetypes[] = { "application/octet-stream" };
+
+void app_metrics_set_unsigned(AppMetricId key, uint32_t value) {
+  if (key >= kAppMetric_NumKeys) {
+    return;
+  }
+  s_current.values[key] = value;
+  s_current.set[key / 32] |= (1UL << (key % 32));
+}
+
+//! The value as encoded: 0 if unset, value + 1 otherwise
+static uint64_t prv_encoded(const sAppMetricsValues *values, size_t key) {
+  if ((values->set[key / 32] & (1UL << (key % 32))) == 0) {
+    return 0;
+  }
+  return (uint64_t)values->values[key] + 1;
+}
+
+static size_t prv_varint_len(uint64_t value) {
+  size_t len = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    len++;
+  }
+  return len;
+}
+
+static size_t prv_put_varint(uint8_t *buf, uint64_t value) {
+  size_t len = 0;
+  while (value >= 0x80) {
+    buf[len++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  buf[len++] = (uint8_t)value;
+  return len;
+}
+
+//! Size of the value in the SDK heartbeat: a CBOR unsigned integer, or a CBOR null if unset
+static size_t prv_cbor_len(uint64_t encoded) {
+  if (encoded == 0) {
+    return 1;
+  }
+  const uint64_t value = encoded - 1;
+  return (value < 24) ? 1 : (value <= UINT8_MAX) ? 2 : (value <= UINT16_MAX) ? 3 : 5;
+}
+
+static size_t prv_encode_keyframe(uint8_t *body) {
+  size_t len = prv_put_varint(body, kAppMetric_NumKeys);
+  for (size_t key = 0; key < kAppMetric_NumKeys; key++) {
+    len += prv_put_varint(&body[len], prv_encoded(&s_current, key));
+  }
+  return len;
+}
+
+static size_t prv_encode_delta(uint8_t *body) {
+  size_t len = 0;
+  size_t next_key = 0;
+  for (size_t key = 0; key < kAppMetric_NumKeys; key++) {
+    const uint64_t value = prv_encoded(&s_current, key);
+    const uint64_t base = prv_encoded(&s_base, key);
+    if (value == base) {
+      continue;
+    }
+    const int64_t diff = (int64_t)(value - base);
+    len += prv_put_varint(&body[len], key - next_key);
+    len += prv_put_varint(&body[len], ((uint64_t)diff << 1) ^ (uint64_t)(diff >> 63));
+    next_key = key + 1;
+  }
+  return len;
+}
+
+static size_t prv_keyframe_body_len(void) {
+  size_t len = prv_varint_len(kAppMetric_NumKeys);
+  for (size_t key = 0; key < kAppMetric_NumKeys; key++) {
+    len += prv_varint_len(prv_encoded(&s_current, key));
+  }
+  return len;
+}
+
+//! Encodes the current values, returns the frame length
+//!
+//! @param[in,out] keyframe Set if a keyframe is due, and on return if one was encoded
+static size_t prv_encode_frame(bool *keyframe, uint32_t seq) {
+  // The body goes behind the largest header, then moves up behind the actual one
+  uint8_t *body = &s_frame[APP_METRICS_FRAME_HEADER_MAX_LEN];
+  size_t body_len = 0;
+  if (!*keyframe) {
+    body_len = prv_encode_delta(body);
+    // When most keys changed, e.g. right after boot, a keyframe is smaller and also resyncs
+    *keyframe = (body_len >= prv_keyframe_body_len());
+  }
+  if (*keyframe) {
+    body_len = prv_encode_keyframe(body);
+  }
+
+  size_t len = 0;
+  s_frame[len++] = *keyframe ? APP_METRICS_FRAME_KEYFRAME : APP_METRICS_FRAME_DELTA;
+  len += prv_put_varint(&s_frame[len], seq);
+  if (!*keyframe) {
+    len += prv_put_varint(&s_frame[len], s_base_seq);
+  }
+  len += prv_put_varint(&s_frame[len], body_len);
+  memmove(&s_frame[len], body, body_len);
+  return len + body_len;
+}
+
+//! Moves the base to the last frame encoded if that is the one acknowledged. An older frame
+//! can only be acknowledged when a heartbeat ends while a post is in progress, its values are
+//! gone by then and deltas stay on the previous base.
+static void prv_apply_ack(void) {
+  const uint32_t irq_state = Cy_SysLib_EnterCriticalSection();
+  const bool ack_pending = s_ack_pending;
+  const uint32_t acked_seq = s_acked_seq;
+  s_ack_pending = false;
+  Cy_SysLib_ExitCriticalSection(irq_state);
+
+  if (ack_pending && (acked_seq == s_latest_seq)) {
+    s_base = s_latest;
+    s_base_seq = s_latest_seq;
+    s_has_base = true;
+  }
+}
+
+//! Queues a frame, dropping the frames not yet offered for upload if there is no room
+static void prv_queue(const uint8_t *frame, size_t len, uint32_t seq) {
+  const uint32_t irq_state = Cy_SysLib_EnterCriticalSection();
+  if ((s_len + len) > sizeof(s_buf)) {
+    // Deltas are taken against an acknowledged frame, so the ones left still decode
+    if (s_offered_len >= s_inflight_len) {
+      s_len = s_offered_len;
+      s_queued_frames = s_offered_frames;
+      s_queued_seq = s_offered_seq;
+    } else {
+      s_len = s_inflight_len;
+      s_queued_frames = s_inflight_frames;
+      s_queued_seq = s_inflight_seq;
+    }
+    s_stats.overflows++;
+  }
+  if ((s_len + len) <= sizeof(s_buf)) {
+    memcpy(&s_buf[s_len], frame, len);
+    s_len += len;
+    s_queued_frames++;
+    s_queued_seq = seq;
+  }
+  Cy_SysLib_ExitCriticalSection(irq_state);
+}
+
+void app_metrics_collect(void) {
+  prv_apply_ack();
+
+  bool keyframe = !s_has_base || (s_since_keyframe >= APP_METRICS_KEYFRAME_INTERVAL);
+  const uint32_t seq = s_next_seq++;
+  const size_t len = prv_encode_frame(&keyframe, seq);
+  prv_queue(s_frame, len, seq);
+
+  size_t sdk_len = (kAppMetric_NumKeys < 24) ? 1 : 2;
+  for (size_t key = 0; key < kAppMetric_NumKeys; key++) {
+    sdk_len += prv_cbor_len(prv_encoded(&s_current, key));
+  }
+  if (keyframe) {
+    s_stats.keyframes++;
+    s_since_keyframe = 0;
+  } else {
+    s_stats.deltas++;
+  }
+  s_since_keyframe++;
+  s_stats.frame_bytes += len;
+  s_stats.sdk_bytes += sdk_len;
+  s_stats.last_frame_bytes = len;
+  s_stats.last_sdk_bytes = sdk_len;
+
+  // Like the SDK's metrics, every key starts the next interval unset
+  s_latest = s_current;
+  s_latest_seq = seq;
+  memset(&s_current, 0, sizeof(s_current));
+}
+
+static void prv_ack_inflight(void) {
+  const uint32_t irq_state = Cy_SysLib_EnterCriticalSection();
+  memmove(s_buf, &s_buf[s_inflight_len], s_len - s_inflight_len);
+  s_len -= s_inflight_len;
+  s_queued_frames -= s_inflight_frames;
+  s_inflight_len = 0;
+  s_acked_seq = s_inflight_seq;
+  s_ack_pending = true;
+  Cy_SysLib_ExitCriticalSection(irq_state);
+  s_stats.acked++;
+}
+
+void app_metrics_post_done(bool accepted) {
+  if (s_inflight_len == 0) {
+    return;
+  }
+  if (accepted) {
+    prv_ack_inflight();
+  } else {
+    // Offered again with the next post, the server may see a frame twice
+    s_inflight_len = 0;
+    s_stats.retried++;
+  }
+}
+
+static bool prv_has_cdr(sMemfaultCdrMetadata *metadata) {
+  if (s_inflight_len != 0) {
+    // Read by something other than the upload client, e.g. `export`, which has no result
+    prv_ack_inflight();
+  }
+
+  const uint32_t irq_state = Cy_SysLib_EnterCriticalSection();
+  const bool ready = (s_stats.acked == 0) || (s_queued_frames >= APP_METRICS_BATCH_FRAMES) ||
+                     (s_len >= (sizeof(s_buf) / 2));
+  s_offered_len = ready ? s_len : 0;
+  s_offered_frames = ready ? s_queued_frames : 0;
+  s_offered_seq = s_queued_seq;
+  Cy_SysLib_ExitCriticalSection(irq_state);
+  if (s_offered_len == 0) {
+    return false;
+  }
+
+  *metadata = (sMemfaultCdrMetadata){
+    .start_time.type = kMemfaultCurrentTimeType_Unknown,
+    .mimetypes = s_mimetypes,
+    .num_mimetypes = MEMFAULT_ARRAY_SIZE(s_mimetypes),
+    .data_size_bytes = s_offered_len,
+    .duration_ms = 0,
+    .collection_reason = MEMFAULT_TRACE_REASON(MetricsFrames),
+  };
+  return true;
+}
+
+static bool prv_read_data(uint32_t offset, void *buf, size_t buf_len) {
+  if ((offset + buf_len) > s_offered_len) {
+    return false;
+  }
+  // The timer task only appends behind the offered bytes
+  memcpy(buf, &s_buf[offset], buf_len);
+  return true;
+}
+
+static void prv_mark_read(void) {
+  s_inflight_len = s_offered_len;
+  s_inflight_frames = s_offered_frames;
+  s_inflight_seq = s_offered_seq;
+  s_offered_len = 0;
+}
+
+static const sMemfaultCdrSourceImpl s_cdr_source = {
+  .has_cdr_cb = prv_has_cdr,
+  .read_data_cb = prv_read_data,
+  .mark_cdr_read_cb = prv_mark_read,
+};
+
+void app_metrics_init(void) {
+  memfault_cdr_register_source(&s_cdr_source);
+}
+
+int app_metrics_cli_cmd(int argc, char *argv[]) {
+  const sAppMetricsStats stats = s_stats;
+  const uint32_t frames = stats.keyframes + stats.deltas;
+
+  MEMFAULT_LOG_INFO("Mode: compact, %u keys, keyframe every %u heartbeats",
+                    (unsigned int)kAppMetric_NumKeys, (unsigned int)APP_METRICS_KEYFRAME_INTERVAL);
+  MEMFAULT_LOG_INFO("Frames: %" PRIu32 " (%" PRIu32 " keyframes, %" PRIu32 " deltas), %" PRIu32
+                    " buffer overflows",
+                    frames, stats.keyframes, stats.deltas, stats.overflows);
+  MEMFAULT_LOG_INFO("Uploads: %" PRIu32 " acknowledged, %" PRIu32 " retried, %" PRIu32
+                    " frames (%u bytes) queued",
+                    stats.acked, stats.retried, s_queued_frames, (unsigned int)s_len);
+  if (frames == 0) {
+    return 0;
+  }
+  MEMFAULT_LOG_INFO("Last heartbeat: %" PRIu32 " bytes, %" PRIu32 " in the SDK heartbeat",
+                    stats.last_frame_bytes, stats.last_sdk_bytes);
+  const uint32_t saved_pct =
+    (stats.frame_bytes >= stats.sdk_bytes) ?
+      0 :
+      (uint32_t)(((uint64_t)(stats.sdk_bytes - stats.frame_bytes) * 100) / stats.sdk_bytes);
+  MEMFAULT_LOG_INFO("Mean per heartbeat: %" PRIu32 " bytes, %" PRIu32
+                    " in the SDK heartbeat, %" PRIu32 "%% less",
+                    stats.frame_bytes / frames, stats.sdk_bytes / frames, saved_pct);
+
+  if ((argc > 1) && (strcmp(argv[1], "keys") == 0)) {
+    // The values reported in the last frame
+    for (size_t key = 0; key < kAppMetric_NumKeys; key++) {
+      const uint64_t value = prv_encoded(&s_latest, key);
+      if (value == 0) {
+        MEMFAULT_LOG_INFO("%3u %-32s -", (unsigned int)key, s_names[key]);
+      } else {
+        MEMFAULT_LOG_INFO("%3u %-32s %" PRIu32, (unsigned int)key, s_names[key],
+                          (uint32_t)(value - 1));
+      }
+    }
+  }
+  return 0;
+}
+
+#else
+
+int app_metrics_cli_cmd(int argc, char *argv[]) {
+  MEMFAULT_LOG_INFO("Metrics are reported in the SDK heartbeat. Build with "
+                    "DEFINES+=APP_METRICS_COMPACT=1 for delta encoded frames.");
+  return 0;
+}
+
+#endif /* APP_METRICS_COMPACT */
@@ -0,0 +1,98 @@
+#pragma once
+
+//! @file
+//!
+//! @brief
+//! Application heartbeat metrics, reported in full or as delta encoded frames
+//!
+//! Modules set the metrics in configs/app_metrics_config.def with APP_METRIC_SET() from their
+//! collect functions. By default that is memfault_metrics_heartbeat_set_unsigned() and the
+//! metrics go out in the SDK heartbeat, which carries every key every interval.
+//!
+//! With APP_METRICS_COMPACT the keys are left out of the SDK heartbeat. At the end of each
+//! interval app_metrics_collect() encodes the values into a frame instead:
+//!
+//! - a delta frame lists only the keys whose value differs from the last acknowledged frame,
+//!   as a varint index gap and a zigzag varint difference each
+//! - a keyframe lists every key as a varint. It is sent until a frame is acknowledged after
+//!   boot, every APP_METRICS_KEYFRAME_INTERVAL heartbeats so a decoder which missed frames
+//!   resyncs, and whenever it is smaller than the delta frame
+//!
+//! Frames are uploaded in batches as a Custom Data Recording in their own drain class. A frame is
+//! acknowledged once the post that carried it is accepted, see app_metrics_post_done(). Until
+//! then it stays queued and deltas are still taken against the previous acknowledged frame.
+//! scripts/decode_metrics.py rebuilds the full values.
+//!
+//! Unset metrics are encoded as 0 and a value v as v + 1, so the decoder can tell them apart
+//! like the SDK heartbeat does.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "memfault/components.h"
+
+//! Heartbeats between keyframes
+#ifndef APP_METRICS_KEYFRAME_INTERVAL
+  #define APP_METRICS_KEYFRAME_INTERVAL (24)
+#endif
+
+//! Room for frames waiting for upload
+#ifndef APP_METRICS_BUFFER_SIZE
+  #define APP_METRICS_BUFFER_SIZE (2048)
+#endif
+
+//! Frames uploaded together. Each recording carries its own metadata, so one frame per
+//! recording would cost more than the delta encoding saves. Recordings go out sooner once half
+//! the buffer is used, and the first one after boot goes out right away.
+#ifndef APP_METRICS_BATCH_FRAMES
+  #define APP_METRICS_BATCH_FRAMES (4)
+#endif
+
+//! Frame types, also the first byte of each frame
+#define APP_METRICS_FRAME_KEYFRAME (0x4b)
+#define APP_METRICS_FRAME_DELTA (0x44)
+
+#if APP_METRICS_COMPACT
+
+typedef enum {
+  #define MEMFAULT_METRICS_KEY_DEFINE(key_name, value_type) kAppMetric_##key_name,
+  #include "app_metrics_config.def"
+  #undef MEMFAULT_METRICS_KEY_DEFINE
+  kAppMetric_NumKeys,
+} eAppMetricKey;
+
+typedef eAppMetricKey AppMetricId;
+
+  #define APP_METRIC_KEY(key_) (kAppMetric_##key_)
+
+void app_metrics_set_unsigned(AppMetricId key, uint32_t value);
+
+//! Registers the Custom Data Recording source the frames are uploaded from
+void app_metrics_init(void);
+
+//! Encodes the interval's values into a frame. Called last from
+//! memfault_metrics_heartbeat_collect_data().
+void app_metrics_collect(void);
+
+//! Called by the upload client when a post completes
+void app_metrics_post_done(bool accepted);
+
+#else
+
+typedef MemfaultMetricId AppMetricId;
+
+  #define APP_METRIC_KEY(key_) MEMFAULT_METRICS_KEY(key_)
+  #define app_metrics_set_unsigned(key_, value_) \
+    ((void)memfault_metrics_heartbeat_set_unsigned((key_), (value_)))
+  #define app_metrics_init()
+  #define app_metrics_collect()
+  #define app_metrics_post_done(accepted_) ((void)(accepted_))
+
+#endif /* APP_METRICS_COMPACT */
+
+//! Sets a metric of configs/app_metrics_config.def, e.g. APP_METRIC_SET(upload_bytes, bytes)
+#define APP_METRIC_SET(key_, value_) app_metrics_set_unsigned(APP_METRIC_KEY(key_), (value_))
+
+//! Shell command which prints the frames encoded and the bytes per heartbeat, compared with the
+//! SDK heartbeat encoding of the same values
+int app_metrics_cli_cmd(int argc, char *argv[]);
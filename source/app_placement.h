@@ -0,0 +1,36 @@
+#pragma once
+
+//! @file
+//!
+//! @brief
+//! Placement of hot code in SRAM
+//!
+//! APP_RAMFUNC marks code on the fault capture and upload hot paths: the coredump region list,
+//! storage writes and capture timing, the heap wrappers, the allocation trace, the pool allocator
+//! and the chunk send loop. It goes in .cy_ramfunc, which the startup code copies to SRAM with
+//! .data, so it runs without flash wait states. It costs SRAM and stays in internal flash as the
+//! load image. A static helper inlined into its callers runs wherever they do.
+//!
+//! Only the SRAM half of the hot/cold split is implemented. Cold code and data (shell commands,
+//! help strings, root certificates) stay in internal flash, and no internal flash is freed. The
+//! QSPI flash holds the coredump storage, whose background erase takes it out of XIP mode for
+//! seconds at a time. Any task preempting the erase could fetch from the XIP region and would
+//! read a flash busy in command mode, and guarding against that means suspending every such
+//! task for the whole erase. app_coredump_storage.c fails the build if code or Wi-Fi firmware is
+//! placed in XIP.
+//!
+//! scripts/memory_map.py reports the bytes placed in SRAM. Build with
+//! DEFINES+=APP_CODE_PLACEMENT=0 to leave everything in internal flash, and compare `bench` and
+//! `coredump_stats` between the two builds.
+
+#include "cy_utils.h"
+
+#ifndef APP_CODE_PLACEMENT
+  #define APP_CODE_PLACEMENT 1
+#endif
+
+#if APP_CODE_PLACEMENT
+  #define APP_RAMFUNC CY_SECTION(".cy_ramfunc")
+#else
+  #define APP_RAMFUNC
+#endif
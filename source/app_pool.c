@@ -0,0 +1,392 @@
+//! @file
+//!
+//! @brief
+//! Fixed-block pool allocator. Each size class is a contiguous array of equally sized blocks
+//! with an intrusive free list, so alloc and free are O(1) and never split or coalesce memory.
+
+#include "app_pool.h"
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "app_alloc_trace.h"
+#include "app_cycles.h"
+#include "app_heap_stats.h"
+#include "app_metrics.h"
+#include "app_placement.h"
+#include "app_upload.h"
+#include "cy_device_headers.h"
+#include "cy_syslib.h"
+#include "mbedtls/platform.h"
+#include "memfault/components.h"
+
+//! Size classes, as (block size, number of blocks). Block sizes must be multiples of 4 and
+//! sorted in ascending order. The defaults cover the X.509 and handshake structures mbedTLS
+//! allocates during each connection; the 16 KiB record buffers always come from the heap.
+#ifndef APP_POOL_CLASSES
+  #define APP_POOL_CLASSES(X) \
+    X(64, 32)                 \
+    X(256, 16)                \
+    X(1024, 6)                \
+    X(4096, 2)
+#endif
+
+#define APP_POOL_DEFINE_STORAGE(size_, count_) \
+  static uint32_t s_pool_storage_##size_[((size_) * (count_)) / sizeof(uint32_t)];
+APP_POOL_CLASSES(APP_POOL_DEFINE_STORAGE)
+
+typedef struct sAppPoolBlock {
+  struct sAppPoolBlock *next;
+} sAppPoolBlock;
+
+typedef struct {
+  uint8_t *start;
+  uint8_t *end;
+  sAppPoolBlock *free_list;
+  sAppPoolStats stats;
+} sAppPool;
+
+#define APP_POOL_INIT_ENTRY(size_, count_)                                       \
+  {                                                                              \
+    .start = (uint8_t *)s_pool_storage_##size_,                                  \
+    .end = (uint8_t *)s_pool_storage_##size_ + sizeof(s_pool_storage_##size_),   \
+    .stats = { .block_size = (size_), .num_blocks = (count_) },                  \
+  },
+
+static sAppPool s_pools[] = { APP_POOL_CLASSES(APP_POOL_INIT_ENTRY) };
+
+static uint32_t s_fallback_count;
+static uint32_t s_last_fallback_count;
+
+//! Builds the free list of a pool whose storage and size are set
+static void prv_pool_reset(sAppPool *pool) {
+  pool->free_list = NULL;
+  // push in reverse so blocks are handed out in address order
+  for (uint32_t block_idx = pool->stats.num_blocks; block_idx > 0; block_idx--) {
+    sAppPoolBlock *block =
+      (sAppPoolBlock *)(pool->start + ((block_idx - 1) * pool->stats.block_size));
+    block->next = pool->free_list;
+    pool->free_list = block;
+  }
+}
+
+void app_pool_init(void) {
+  for (size_t i = 0; i < MEMFAULT_ARRAY_SIZE(s_pools); i++) {
+    prv_pool_reset(&s_pools[i]);
+  }
+
+#if defined(MBEDTLS_PLATFORM_MEMORY)
+  mbedtls_platform_set_calloc_free(app_pool_calloc, app_pool_free);
+#endif
+}
+
+APP_RAMFUNC static sAppPool *prv_find_owner(sAppPool *pools, size_t num_pools,
+                                             const void *ptr) {
+  const uint8_t *p = (const uint8_t *)ptr;
+  for (size_t i = 0; i < num_pools; i++) {
+    if ((p >= pools[i].start) && (p < pools[i].end)) {
+      return &pools[i];
+    }
+  }
+  return NULL;
+}
+
+//! Serves size from the smallest class of pools that fits, or from the heap, counting heap
+//! fallbacks in fallback_count
+APP_RAMFUNC static void *prv_pool_alloc(sAppPool *pools, size_t num_pools,
+                                        uint32_t *fallback_count, size_t size,
+                                        const void *caller) {
+  for (size_t i = 0; i < num_pools; i++) {
+    sAppPool *pool = &pools[i];
+    if (size > pool->stats.block_size) {
+      continue;
+    }
+
+    const uint32_t irq_state = Cy_SysLib_EnterCriticalSection();
+    sAppPoolBlock *block = pool->free_list;
+    if (block != NULL) {
+      pool->free_list = block->next;
+      pool->stats.in_use++;
+      pool->stats.alloc_count++;
+      pool->stats.peak_in_use = MEMFAULT_MAX(pool->stats.peak_in_use, pool->stats.in_use);
+    } else {
+      pool->stats.exhausted_count++;
+    }
+    Cy_SysLib_ExitCriticalSection(irq_state);
+
+    if (block != NULL) {
+      app_alloc_trace_record(kAppAllocTraceOp_PoolAlloc, block, size, caller);
+      return block;
+    }
+    // Only try the smallest class that fits so one busy class can't drain the larger ones
+    break;
+  }
+
+  if (__get_IPSR() != 0) {
+    // The heap is not usable from interrupts
+    return NULL;
+  }
+  const uint32_t irq_state = Cy_SysLib_EnterCriticalSection();
+  (*fallback_count)++;
+  Cy_SysLib_ExitCriticalSection(irq_state);
+  return app_heap_stats_malloc(size, caller);
+}
+
+APP_RAMFUNC static void prv_pool_free(sAppPool *pools, size_t num_pools, void *ptr,
+                                      const void *caller) {
+  if (ptr == NULL) {
+    return;
+  }
+
+  sAppPool *pool = prv_find_owner(pools, num_pools, ptr);
+  if (pool == NULL) {
+    app_heap_stats_free(ptr, caller);
+    return;
+  }
+
+  app_alloc_trace_record(kAppAllocTraceOp_PoolFree, ptr, 0, caller);
+
+  sAppPoolBlock *block = (sAppPoolBlock *)ptr;
+  const uint32_t irq_state = Cy_SysLib_EnterCriticalSection();
+  block->next = pool->free_list;
+  pool->free_list = block;
+  pool->stats.in_use--;
+  Cy_SysLib_ExitCriticalSection(irq_state);
+}
+
+APP_RAMFUNC void *app_pool_alloc(size_t size) {
+  return prv_pool_alloc(s_pools, MEMFAULT_ARRAY_SIZE(s_pools), &s_fallback_count, size,
+                        __builtin_return_address(0));
+}
+
+APP_RAMFUNC void *app_pool_calloc(size_t nmemb, size_t size) {
+  if ((size != 0) && (nmemb > (SIZE_MAX / size))) {
+    return NULL;
+  }
+  const size_t total_size = nmemb * size;
+  void *ptr = prv_pool_alloc(s_pools, MEMFAULT_ARRAY_SIZE(s_pools), &s_fallback_count,
+                             total_size, __builtin_return_address(0));
+  if (ptr != NULL) {
+    memset(ptr, 0, total_size);
+  }
+  return ptr;
+}
+
+APP_RAMFUNC void app_pool_free(void *ptr) {
+  prv_pool_free(s_pools, MEMFAULT_ARRAY_SIZE(s_pools), ptr, __builtin_return_address(0));
+}
+
+size_t app_pool_get_num_pools(void) {
+  return MEMFAULT_ARRAY_SIZE(s_pools);
+}
+
+void app_pool_get_stats(size_t pool_idx, sAppPoolStats *stats) {
+  if (pool_idx >= MEMFAULT_ARRAY_SIZE(s_pools)) {
+    *stats = (sAppPoolStats){ 0 };
+    return;
+  }
+  const uint32_t irq_state = Cy_SysLib_EnterCriticalSection();
+  *stats = s_pools[pool_idx].stats;
+  Cy_SysLib_ExitCriticalSection(irq_state);
+}
+
+uint32_t app_pool_get_fallback_count(void) {
+  return s_fallback_count;
+}
+
+void app_pool_collect_metrics(void) {
+  // Peak occupancy in percent of each pool, smallest class first
+  const AppMetricId peak_keys[] = {
+    APP_METRIC_KEY(pool_0_peak_pct),
+    APP_METRIC_KEY(pool_1_peak_pct),
+    APP_METRIC_KEY(pool_2_peak_pct),
+    APP_METRIC_KEY(pool_3_peak_pct),
+  };
+
+  const size_t num_pools =
+    MEMFAULT_MIN(MEMFAULT_ARRAY_SIZE(s_pools), MEMFAULT_ARRAY_SIZE(peak_keys));
+  for (size_t i = 0; i < num_pools; i++) {
+    sAppPool *pool = &s_pools[i];
+    const uint32_t irq_state = Cy_SysLib_EnterCriticalSection();
+    const uint32_t peak = pool->stats.peak_in_use;
+    // restart peak tracking for the next interval
+    pool->stats.peak_in_use = pool->stats.in_use;
+    Cy_SysLib_ExitCriticalSection(irq_state);
+
+    app_metrics_set_unsigned(peak_keys[i], (peak * 100) / pool->stats.num_blocks);
+  }
+
+  const uint32_t fallback_count = s_fallback_count;
+  APP_METRIC_SET(pool_fallback_count, fallback_count - s_last_fallback_count);
+  s_last_fallback_count = fallback_count;
+}
+
+int app_pool_cli_cmd(int argc, char *argv[]) {
+  for (size_t i = 0; i < MEMFAULT_ARRAY_SIZE(s_pools); i++) {
+    sAppPoolStats stats;
+    app_pool_get_stats(i, &stats);
+    MEMFAULT_LOG_INFO("Pool %4" PRIu32 "B: %" PRIu32 "/%" PRIu32 " in use, peak %" PRIu32
+                      ", allocs %" PRIu32 ", exhausted %" PRIu32,
+                      stats.block_size, stats.in_use, stats.num_blocks, stats.peak_in_use,
+                      stats.alloc_count, stats.exhausted_count);
+  }
+  MEMFAULT_LOG_INFO("Heap fallbacks: %" PRIu32, s_fallback_count);
+  return 0;
+}
+
+//
+// Soak benchmark
+//
+
+#define APP_POOL_SOAK_SLOTS (16)
+#define APP_POOL_SOAK_DEFAULT_ITERATIONS (2000)
+#define APP_POOL_SOAK_UPLOAD_WAIT_MS (5 * 1000)
+
+#define APP_POOL_ADD_STORAGE_SIZE(size_, count_) +((size_) * (count_))
+#define APP_POOL_STORAGE_SIZE (0 APP_POOL_CLASSES(APP_POOL_ADD_STORAGE_SIZE))
+
+//! Pools with the size classes of s_pools, carved from one heap block while a soak runs, so the
+//! soak never holds the blocks a TLS session needs
+static sAppPool s_soak_pools[MEMFAULT_ARRAY_SIZE(s_pools)];
+static uint32_t s_soak_fallback_count;
+
+typedef struct {
+  void *(*alloc)(size_t size);
+  void (*free)(void *ptr);
+} sAppPoolSoakAllocator;
+
+typedef struct {
+  uint32_t alloc_count;
+  uint32_t failed_count;
+  uint64_t total_cycles;
+  uint32_t max_cycles;
+  //! Heap fragmentation before the allocations still held at the end are freed
+  uint32_t frag_permille;
+} sAppPoolSoakResult;
+
+//! Deterministic xorshift so both allocators see the exact same request sequence
+static uint32_t prv_soak_rand(uint32_t *state) {
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x;
+}
+
+//! Mix of request sizes seen while a TLS session is set up and torn down
+static size_t prv_soak_size(uint32_t rand) {
+  static const uint16_t s_sizes[] = { 24, 40, 64, 100, 180, 256, 300, 520, 900, 1400, 2400, 3600 };
+  return s_sizes[rand % MEMFAULT_ARRAY_SIZE(s_sizes)];
+}
+
+static void prv_soak_pools_init(uint8_t *storage) {
+  for (size_t i = 0; i < MEMFAULT_ARRAY_SIZE(s_soak_pools); i++) {
+    const sAppPoolStats *stats = &s_pools[i].stats;
+    s_soak_pools[i] = (sAppPool){
+      .start = storage,
+      .end = storage + (stats->block_size * stats->num_blocks),
+      .stats = { .block_size = stats->block_size, .num_blocks = stats->num_blocks },
+    };
+    prv_pool_reset(&s_soak_pools[i]);
+    storage = s_soak_pools[i].end;
+  }
+}
+
+static void *prv_soak_pool_alloc(size_t size) {
+  return prv_pool_alloc(s_soak_pools, MEMFAULT_ARRAY_SIZE(s_soak_pools), &s_soak_fallback_count,
+                        size, __builtin_return_address(0));
+}
+
+static void prv_soak_pool_free(void *ptr) {
+  prv_pool_free(s_soak_pools, MEMFAULT_ARRAY_SIZE(s_soak_pools), ptr,
+                __builtin_return_address(0));
+}
+
+static void prv_soak_run(const sAppPoolSoakAllocator *allocator, uint32_t iterations,
+                         sAppPoolSoakResult *result) {
+  void *slots[APP_POOL_SOAK_SLOTS] = { 0 };
+  uint32_t seed = 0x1234567;
+  *result = (sAppPoolSoakResult){ 0 };
+
+  for (uint32_t i = 0; i < iterations; i++) {
+    const uint32_t rand = prv_soak_rand(&seed);
+    void **slot = &slots[rand % APP_POOL_SOAK_SLOTS];
+    if (*slot != NULL) {
+      allocator->free(*slot);
+      *slot = NULL;
+      continue;
+    }
+
+    const size_t size = prv_soak_size(rand >> 8);
+    const uint32_t start = app_cycles_get();
+    *slot = allocator->alloc(size);
+    const uint32_t cycles = app_cycles_get() - start;
+
+    if (*slot == NULL) {
+      result->failed_count++;
+      continue;
+    }
+    result->alloc_count++;
+    result->total_cycles += cycles;
+    result->max_cycles = MEMFAULT_MAX(result->max_cycles, cycles);
+  }
+
+  result->frag_permille = app_heap_stats_get_fragmentation_permille();
+  for (size_t i = 0; i < APP_POOL_SOAK_SLOTS; i++) {
+    allocator->free(slots[i]);
+  }
+}
+
+static void prv_soak_report(const char *name, const sAppPoolSoakResult *result) {
+  const uint32_t avg_cycles =
+    (result->alloc_count != 0) ? (uint32_t)(result->total_cycles / result->alloc_count) : 0;
+  MEMFAULT_LOG_INFO("%-5s: %" PRIu32 " allocs, %" PRIu32 " failed, avg %" PRIu32
+                    " cycles, max %" PRIu32 " cycles",
+                    name, result->alloc_count, result->failed_count, avg_cycles,
+                    result->max_cycles);
+}
+
+int app_pool_soak_cli_cmd(int argc, char *argv[]) {
+  const uint32_t iterations =
+    (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 0) : APP_POOL_SOAK_DEFAULT_ITERATIONS;
+  app_cycles_init();
+
+  // Both runs hold heap memory a TLS session may need, so posts are held off until the end
+  if (!app_upload_pause(APP_POOL_SOAK_UPLOAD_WAIT_MS)) {
+    MEMFAULT_LOG_ERROR("Upload in progress, try again later");
+    return -1;
+  }
+  uint8_t *soak_storage = malloc(APP_POOL_STORAGE_SIZE);
+  if (soak_storage == NULL) {
+    MEMFAULT_LOG_ERROR("No heap for the %d byte soak pools", (int)APP_POOL_STORAGE_SIZE);
+    app_upload_resume();
+    return -1;
+  }
+  prv_soak_pools_init(soak_storage);
+
+  const sAppPoolSoakAllocator heap = { .alloc = malloc, .free = free };
+  const sAppPoolSoakAllocator pool = { .alloc = prv_soak_pool_alloc,
+                                       .free = prv_soak_pool_free };
+  sAppPoolSoakResult result;
+
+  const uint32_t frag_before = app_heap_stats_get_fragmentation_permille();
+  prv_soak_run(&heap, iterations, &result);
+  const uint32_t frag_heap = result.frag_permille;
+  prv_soak_report("heap", &result);
+
+  s_soak_fallback_count = 0;
+  prv_soak_run(&pool, iterations, &result);
+  const uint32_t frag_pool = result.frag_permille;
+  prv_soak_report("pool", &result);
+
+  free(soak_storage);
+  app_upload_resume();
+
+  MEMFAULT_LOG_INFO("Heap fragmentation (permille): before %" PRIu32 ", end of heap run %" PRIu32
+                    ", end of pool run %" PRIu32,
+                    frag_before, frag_heap, frag_pool);
+  MEMFAULT_LOG_INFO("Pool run heap fallbacks: %" PRIu32, s_soak_fallback_count);
+  return 0;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+//! @file
+//!
+//! @brief
+//! Size-class pool allocator for the short-lived TLS and network buffers
+//!
+//! Every TLS handshake and upload allocates and frees the same handful of object sizes. Serving
+//! those from fixed-size blocks keeps them out of the general purpose newlib heap so it does not
+//! fragment over days of uptime. Requests that do not fit any size class, or arrive while the
+//! matching class is exhausted, fall back to malloc().
+//!
+//! Pool blocks can be allocated and freed from tasks and interrupts. The heap fallback takes the
+//! malloc lock, so in interrupts an allocation that no pool can serve returns NULL, and memory
+//! from the fallback must be freed by a task.
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+  //! Size of each block in this pool
+  uint32_t block_size;
+  //! Total number of blocks in this pool
+  uint32_t num_blocks;
+  //! Blocks currently allocated
+  uint32_t in_use;
+  //! Highest value of in_use in the current heartbeat interval, app_pool_collect_metrics()
+  //! restarts it
+  uint32_t peak_in_use;
+  //! Number of allocations served by this pool since boot
+  uint32_t alloc_count;
+  //! Number of requests for this size class that fell back to the heap because it was full
+  uint32_t exhausted_count;
+} sAppPoolStats;
+
+//! Initializes the pools and routes mbedTLS allocations to them
+//!
+//! Must be called before the first TLS allocation, i.e before cy_socket_init()
+void app_pool_init(void);
+
+//! Allocates a block of at least size bytes
+void *app_pool_alloc(size_t size);
+
+//! Allocates zeroed memory for nmemb elements of size bytes, calloc() semantics
+void *app_pool_calloc(size_t nmemb, size_t size);
+
+//! Releases memory returned by app_pool_alloc() or app_pool_calloc()
+void app_pool_free(void *ptr);
+
+//! Returns the number of size classes
+size_t app_pool_get_num_pools(void);
+
+//! Fills stats for the pool at the provided index
+void app_pool_get_stats(size_t pool_idx, sAppPoolStats *stats);
+
+//! Returns the number of allocations that were routed to the heap since boot
+uint32_t app_pool_get_fallback_count(void);
+
+//! Records pool occupancy metrics for the current heartbeat interval
+void app_pool_collect_metrics(void);
+
+//! Shell command which dumps per-pool occupancy
+int app_pool_cli_cmd(int argc, char *argv[]);
+
+//! Shell command which runs an allocation soak comparing the pools against the heap. Heap
+//! fragmentation is sampled at the end of each run, while its allocations are still held.
+//!
+//! The pool run uses its own pools with the same size classes, carved from the heap for the
+//! duration of the command. Chunk posts are held off until it is done, so a TLS session never
+//! finds the live pools or the heap drained by the soak.
+//!
+//! Usage: pool_soak [iterations]
+int app_pool_soak_cli_cmd(int argc, char *argv[]);
@@ -0,0 +1,373 @@
+//! @file
+//!
+//! @brief
+//! Roaming between the APs of a network, see app_roam.h
+
+#include "app_roam.h"
+
+#include <FreeRTOS.h>
+#include <inttypes.h>
+#include <semphr.h>
+#include <stdio.h>
+#include <string.h>
+#include <task.h>
+
+#include "ap.h"
+#include "app_config.h"
+#include "app_impair.h"
+#include "app_log.h"
+#include "app_memmap.h"
+#include "app_metrics.h"
+#include "app_trace.h"
+#include "cy_syslib.h"
+#include "cy_wcm.h"
+#include "cy_wcm_error.h"
+#include "memfault/components.h"
+
+//! "aa:bb:cc:dd:ee:ff" and the terminator
+#define APP_ROAM_BSSID_STR_LEN (18)
+
+typedef struct {
+  uint32_t scans;
+  //! Scans which found no AP stronger by the hysteresis
+  uint32_t no_candidate;
+  uint32_t roams;
+  //! Joins of the new BSSID which failed, the device then joined the SSID again
+  uint32_t failures;
+  //! Disconnect to IP address of the last roam
+  uint32_t last_roam_ms;
+  uint32_t max_roam_ms;
+  cy_wcm_mac_t from_bssid;
+  cy_wcm_mac_t to_bssid;
+  int16_t from_rssi;
+  int16_t to_rssi;
+  //! Upload throughput of the last cycle before the roam and of the first cycle after it, 0 if
+  //! there was no post
+  uint32_t bytes_per_s_before;
+  uint32_t bytes_per_s_after;
+} sAppRoamStats;
+
+static SemaphoreHandle_t s_scan_done;
+static StaticSemaphore_t s_scan_done_storage APP_STATIC(wifi);
+
+//! Strongest other AP of the scan in progress, written from the WCM worker thread
+static struct {
+  cy_wcm_mac_t current_bssid;
+  cy_wcm_mac_t bssid;
+  int16_t rssi;
+  bool found;
+} s_candidate;
+//! Passed to the scan callback as user_data. Bumped when a scan starts and when it times out, so
+//! results WCM delivers after cy_wcm_stop_scan() don't touch s_candidate.
+static uint32_t s_scan_generation;
+
+//! Last RSSI read from the radio, until the sampler takes it
+static int16_t s_latest_rssi;
+static bool s_latest_rssi_new;
+
+static int16_t s_rssi_samples[APP_ROAM_RSSI_SAMPLES];
+//! Samples taken on the current AP, s_rssi_samples is a ring indexed by this modulo its size
+static uint32_t s_num_rssi_samples;
+
+//! Sent by the posts of the current upload cycle
+static uint32_t s_cycle_bytes;
+static uint32_t s_cycle_ms;
+//! Throughput of the last upload cycle which sent enough to measure, 0 before the first one
+static uint32_t s_last_bytes_per_s;
+
+static TickType_t s_last_scan;
+static bool s_scanned;
+static volatile bool s_scan_requested;
+//! Set by a roam until an upload cycle after it posted
+static bool s_awaiting_after;
+//! Set if a roam left the device disconnected, it then rejoins on the next check
+static bool s_rejoin_pending;
+
+static sAppRoamStats s_stats;
+static uint32_t s_last_reported_scans;
+static uint32_t s_last_reported_roams;
+static uint32_t s_last_reported_failures;
+static uint32_t s_heartbeat_max_roam_ms;
+//! Set once the throughput after a roam was measured, until the next heartbeat reports it
+static bool s_report_throughput;
+
+static void prv_format_bssid(const cy_wcm_mac_t bssid, char *buf) {
+  snprintf(buf, APP_ROAM_BSSID_STR_LEN, "%02x:%02x:%02x:%02x:%02x:%02x", bssid[0], bssid[1],
+           bssid[2], bssid[3], bssid[4], bssid[5]);
+}
+
+static uint32_t prv_ms_since(TickType_t start) {
+  return (uint32_t)((xTaskGetTickCount() - start) * portTICK_PERIOD_MS);
+}
+
+//! Called for each AP of the scan, then once with CY_WCM_SCAN_COMPLETE
+static void prv_scan_cb(cy_wcm_scan_result_t *result, void *user_data,
+                        cy_wcm_scan_status_t status) {
+  const uint32_t irq_state = Cy_SysLib_EnterCriticalSection();
+  const bool current = ((uint32_t)(uintptr_t)user_data == s_scan_generation);
+  if (current && (status == CY_WCM_SCAN_INCOMPLETE) &&
+      (memcmp(result->BSSID, s_candidate.current_bssid, sizeof(cy_wcm_mac_t)) != 0) &&
+      (!s_candidate.found || (result->signal_strength > s_candidate.rssi))) {
+    memcpy(s_candidate.bssid, result->BSSID, sizeof(cy_wcm_mac_t));
+    s_candidate.rssi = result->signal_strength;
+    s_candidate.found = true;
+  }
+  Cy_SysLib_ExitCriticalSection(irq_state);
+
+  if (current && (status == CY_WCM_SCAN_COMPLETE)) {
+    xSemaphoreGive(s_scan_done);
+  }
+}
+
+//! Scans for the other APs of the network the device is associated with
+//!
+//! @return true if an AP at least roam_hysteresis_db stronger was found, in s_candidate
+static bool prv_scan(const cy_wcm_associated_ap_info_t *ap_info) {
+  uint32_t irq_state = Cy_SysLib_EnterCriticalSection();
+  const uint32_t generation = ++s_scan_generation;
+  memset(&s_candidate, 0, sizeof(s_candidate));
+  memcpy(s_candidate.current_bssid, ap_info->BSSID, sizeof(cy_wcm_mac_t));
+  Cy_SysLib_ExitCriticalSection(irq_state);
+  cy_wcm_scan_filter_t filter = {
+    .mode = CY_WCM_SCAN_FILTER_TYPE_SSID,
+  };
+  memcpy(filter.param.SSID, ap_info->SSID, sizeof(filter.param.SSID));
+
+  // Drop the completion of a scan which timed out earlier
+  xSemaphoreTake(s_scan_done, 0);
+  s_last_scan = xTaskGetTickCount();
+  s_scanned = true;
+  const cy_rslt_t rv = cy_wcm_start_scan(prv_scan_cb, (void *)(uintptr_t)generation, &filter);
+  if (rv == CY_RSLT_WCM_SCAN_IN_PROGRESS) {
+    // `wifi_scan` is running, try again after the next cycle
+    s_scanned = false;
+    return false;
+  }
+  if (rv != CY_RSLT_SUCCESS) {
+    APP_TRACE_EVENT(WifiScanFailure, rv);
+    return false;
+  }
+  s_stats.scans++;
+  if (xSemaphoreTake(s_scan_done, pdMS_TO_TICKS(APP_ROAM_SCAN_TIMEOUT_MS)) != pdTRUE) {
+    APP_LOG_WARN("Roam scan did not complete in %d ms", (int)APP_ROAM_SCAN_TIMEOUT_MS);
+    cy_wcm_stop_scan();
+    irq_state = Cy_SysLib_EnterCriticalSection();
+    s_scan_generation++;
+    Cy_SysLib_ExitCriticalSection(irq_state);
+    return false;
+  }
+
+  if (!s_candidate.found ||
+      (s_candidate.rssi < ap_info->signal_strength + APP_CONFIG_GET(roam_hysteresis_db))) {
+    s_stats.no_candidate++;
+    return false;
+  }
+  return true;
+}
+
+//! Returns the throughput of the upload cycle that just ended, 0 if it sent less than
+//! APP_ROAM_MIN_CYCLE_BYTES
+static uint32_t prv_cycle_bytes_per_s(void) {
+  uint32_t bytes_per_s = 0;
+  if (s_cycle_bytes >= APP_ROAM_MIN_CYCLE_BYTES) {
+    bytes_per_s = (uint32_t)(((uint64_t)s_cycle_bytes * 1000) / MEMFAULT_MAX(s_cycle_ms, 1));
+    s_last_bytes_per_s = bytes_per_s;
+  }
+  s_cycle_bytes = 0;
+  s_cycle_ms = 0;
+  return bytes_per_s;
+}
+
+static void prv_publish_rssi(int16_t rssi) {
+  const uint32_t irq_state = Cy_SysLib_EnterCriticalSection();
+  s_latest_rssi = rssi;
+  s_latest_rssi_new = true;
+  Cy_SysLib_ExitCriticalSection(irq_state);
+}
+
+//! Adds an RSSI sample and returns the mean, or 0 until APP_ROAM_RSSI_SAMPLES were taken
+static int32_t prv_add_rssi_sample(int16_t rssi) {
+  s_rssi_samples[s_num_rssi_samples % APP_ROAM_RSSI_SAMPLES] = rssi;
+  s_num_rssi_samples++;
+  if (s_num_rssi_samples < APP_ROAM_RSSI_SAMPLES) {
+    return 0;
+  }
+  int32_t sum = 0;
+  for (size_t i = 0; i < APP_ROAM_RSSI_SAMPLES; i++) {
+    sum += s_rssi_samples[i];
+  }
+  return sum / APP_ROAM_RSSI_SAMPLES;
+}
+
+static bool prv_should_scan(int32_t mean_rssi, uint32_t bytes_per_s) {
+  if (s_scan_requested) {
+    s_scan_requested = false;
+    return true;
+  }
+  const TickType_t scan_interval = pdMS_TO_TICKS(APP_CONFIG_GET(roam_scan_interval_ms));
+  if (s_scanned && ((xTaskGetTickCount() - s_last_scan) < scan_interval)) {
+    return false;
+  }
+  const bool weak = (mean_rssi != 0) &&
+                    (mean_rssi < -(int32_t)APP_CONFIG_GET(roam_rssi_threshold_neg_dbm));
+  const bool slow = (bytes_per_s != 0) && (bytes_per_s < APP_CONFIG_GET(roam_min_bytes_per_s));
+  return weak || slow;
+}
+
+static bool prv_roam(const cy_wcm_associated_ap_info_t *ap_info) {
+  char from[APP_ROAM_BSSID_STR_LEN];
+  char to[APP_ROAM_BSSID_STR_LEN];
+  prv_format_bssid(ap_info->BSSID, from);
+  prv_format_bssid(s_candidate.bssid, to);
+
+  const TickType_t start = xTaskGetTickCount();
+  cy_rslt_t rv = ap_join_bssid(s_candidate.bssid);
+  if (rv != CY_RSLT_SUCCESS) {
+    s_stats.failures++;
+    APP_TRACE_EVENT(RoamFailure, rv);
+    APP_LOG_WARN("Failed to join %s, rv=0x%x. Joining '%s' again", to, (int)rv,
+                 (const char *)ap_info->SSID);
+    rv = ap_rejoin(APP_CONFIG_GET(wifi_join_retries));
+    s_rejoin_pending = (rv != CY_RSLT_SUCCESS);
+    return false;
+  }
+  const uint32_t roam_ms = prv_ms_since(start);
+
+  s_stats.roams++;
+  s_stats.last_roam_ms = roam_ms;
+  s_stats.max_roam_ms = MEMFAULT_MAX(s_stats.max_roam_ms, roam_ms);
+  s_heartbeat_max_roam_ms = MEMFAULT_MAX(s_heartbeat_max_roam_ms, roam_ms);
+  memcpy(s_stats.from_bssid, ap_info->BSSID, sizeof(cy_wcm_mac_t));
+  memcpy(s_stats.to_bssid, s_candidate.bssid, sizeof(cy_wcm_mac_t));
+  s_stats.from_rssi = ap_info->signal_strength;
+  s_stats.to_rssi = s_candidate.rssi;
+  s_stats.bytes_per_s_before = s_last_bytes_per_s;
+  s_stats.bytes_per_s_after = 0;
+  s_awaiting_after = true;
+  s_num_rssi_samples = 0;
+  APP_LOG_INFO("Roamed from %s (%d dBm) to %s (%d dBm) in %" PRIu32 " ms", from,
+               (int)ap_info->signal_strength, to, (int)s_candidate.rssi, roam_ms);
+  return true;
+}
+
+void app_roam_init(void) {
+  s_scan_done = xSemaphoreCreateBinaryStatic(&s_scan_done_storage);
+}
+
+void app_roam_read_rssi(void) {
+  cy_wcm_associated_ap_info_t ap_info;
+  if (cy_wcm_is_connected_to_ap() &&
+      (cy_wcm_get_associated_ap_info(&ap_info) == CY_RSLT_SUCCESS)) {
+    prv_publish_rssi(ap_info.signal_strength);
+  }
+}
+
+bool app_roam_take_rssi(int16_t *rssi) {
+  const uint32_t irq_state = Cy_SysLib_EnterCriticalSection();
+  const bool taken = s_latest_rssi_new;
+  *rssi = s_latest_rssi;
+  s_latest_rssi_new = false;
+  Cy_SysLib_ExitCriticalSection(irq_state);
+  return taken;
+}
+
+void app_roam_post_done(uint32_t bytes, uint32_t send_ms) {
+  s_cycle_bytes += bytes;
+  s_cycle_ms += send_ms;
+}
+
+bool app_roam_check(void) {
+  const uint32_t bytes_per_s = prv_cycle_bytes_per_s();
+  // The impairment makes the link look bad on purpose
+  if (app_impair_run_active()) {
+    return false;
+  }
+  if ((bytes_per_s != 0) && s_awaiting_after) {
+    s_stats.bytes_per_s_after = bytes_per_s;
+    s_awaiting_after = false;
+    s_report_throughput = true;
+  }
+
+  if (s_rejoin_pending) {
+    s_rejoin_pending = (ap_rejoin(APP_CONFIG_GET(wifi_join_retries)) != CY_RSLT_SUCCESS);
+    return false;
+  }
+  if (!APP_CONFIG_GET(roam_enabled) || !cy_wcm_is_connected_to_ap()) {
+    return false;
+  }
+  cy_wcm_associated_ap_info_t ap_info;
+  if (cy_wcm_get_associated_ap_info(&ap_info) != CY_RSLT_SUCCESS) {
+    return false;
+  }
+  prv_publish_rssi(ap_info.signal_strength);
+  const int32_t mean_rssi = prv_add_rssi_sample(ap_info.signal_strength);
+  if (!prv_should_scan(mean_rssi, bytes_per_s) || !prv_scan(&ap_info)) {
+    return false;
+  }
+  return prv_roam(&ap_info);
+}
+
+void app_roam_collect_metrics(void) {
+  APP_METRIC_SET(wifi_roam_scan_count, s_stats.scans - s_last_reported_scans);
+  APP_METRIC_SET(wifi_roam_count, s_stats.roams - s_last_reported_roams);
+  APP_METRIC_SET(wifi_roam_fail_count, s_stats.failures - s_last_reported_failures);
+  s_last_reported_scans = s_stats.scans;
+  s_last_reported_roams = s_stats.roams;
+  s_last_reported_failures = s_stats.failures;
+
+  if (s_heartbeat_max_roam_ms != 0) {
+    APP_METRIC_SET(wifi_roam_max_ms, s_heartbeat_max_roam_ms);
+    s_heartbeat_max_roam_ms = 0;
+  }
+  // Reported together, in the heartbeat of the first upload cycle after the roam
+  if (s_report_throughput) {
+    APP_METRIC_SET(wifi_roam_bytes_per_s_before, s_stats.bytes_per_s_before);
+    APP_METRIC_SET(wifi_roam_bytes_per_s_after, s_stats.bytes_per_s_after);
+    s_report_throughput = false;
+  }
+}
+
+int app_roam_cli_cmd(int argc, char *argv[]) {
+  if ((argc > 1) && (strcmp(argv[1], "scan") == 0)) {
+    s_scan_requested = true;
+    MEMFAULT_LOG_INFO("Scanning after the next upload cycle");
+    return 0;
+  }
+
+  char bssid[APP_ROAM_BSSID_STR_LEN];
+  cy_wcm_associated_ap_info_t ap_info;
+  if (cy_wcm_is_connected_to_ap() &&
+      (cy_wcm_get_associated_ap_info(&ap_info) == CY_RSLT_SUCCESS)) {
+    prv_format_bssid(ap_info.BSSID, bssid);
+    MEMFAULT_LOG_INFO("AP: %s, channel %d, %d dBm", bssid, (int)ap_info.channel,
+                      (int)ap_info.signal_strength);
+  } else {
+    MEMFAULT_LOG_INFO("AP: not connected");
+  }
+  MEMFAULT_LOG_INFO("Roaming %s below -%d dBm or %" PRIu32 " B/s, to APs %d dB stronger",
+                    APP_CONFIG_GET(roam_enabled) ? "enabled" : "disabled",
+                    (int)APP_CONFIG_GET(roam_rssi_threshold_neg_dbm),
+                    APP_CONFIG_GET(roam_min_bytes_per_s), (int)APP_CONFIG_GET(roam_hysteresis_db));
+  MEMFAULT_LOG_INFO("Last upload cycle: %" PRIu32 " B/s", s_last_bytes_per_s);
+  MEMFAULT_LOG_INFO("Scans: %" PRIu32 ", no better AP: %" PRIu32 ", roams: %" PRIu32
+                    ", failed: %" PRIu32,
+                    s_stats.scans, s_stats.no_candidate, s_stats.roams, s_stats.failures);
+  if (s_stats.roams == 0) {
+    return 0;
+  }
+
+  char to[APP_ROAM_BSSID_STR_LEN];
+  prv_format_bssid(s_stats.from_bssid, bssid);
+  prv_format_bssid(s_stats.to_bssid, to);
+  MEMFAULT_LOG_INFO("Last roam: %s (%d dBm) -> %s (%d dBm), %" PRIu32 " ms, max %" PRIu32 " ms",
+                    bssid, (int)s_stats.from_rssi, to, (int)s_stats.to_rssi,
+                    s_stats.last_roam_ms, s_stats.max_roam_ms);
+  if (s_awaiting_after) {
+    MEMFAULT_LOG_INFO("Throughput: %" PRIu32 " B/s before, waiting for a post after",
+                      s_stats.bytes_per_s_before);
+  } else {
+    MEMFAULT_LOG_INFO("Throughput: %" PRIu32 " B/s before, %" PRIu32 " B/s after",
+                      s_stats.bytes_per_s_before, s_stats.bytes_per_s_after);
+  }
+  return 0;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+//! @file
+//!
+//! @brief
+//! Roaming to a stronger AP of the same network when the link degrades
+//!
+//! The HTTP task calls app_roam_check() after each upload cycle. It reads the RSSI of the
+//! associated AP and the throughput of the cycle's posts, timed from the first byte of each
+//! request to the last without the wait for the response. Once the RSSI averaged over the last
+//! APP_ROAM_RSSI_SAMPLES checks is below `roam_rssi_threshold_neg_dbm`, or the throughput is
+//! below `roam_min_bytes_per_s`, it scans for the SSID it is associated with. The device stays
+//! associated during the scan. If an AP with another BSSID is at least `roam_hysteresis_db`
+//! stronger, it joins that BSSID with the credentials of the last successful join. Scans are at
+//! least `roam_scan_interval_ms` apart, so a device with no better AP in range doesn't keep the
+//! radio off channel.
+//!
+//! WCM has no reassociation API, so a roam is a disconnect and a join of the new BSSID. The
+//! time from the disconnect to an IP address is reported as the roam time. If the new BSSID
+//! can't be joined, the device joins the SSID again and lets WCM pick the AP.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//! Checks averaged for the RSSI trigger, so a single weak reading doesn't start a scan
+#ifndef APP_ROAM_RSSI_SAMPLES
+  #define APP_ROAM_RSSI_SAMPLES (3)
+#endif
+
+//! Cycles which sent less are not used for the throughput trigger. Their requests fit in the TCP
+//! send buffer, so how long sending them took says little about the link.
+#ifndef APP_ROAM_MIN_CYCLE_BYTES
+  #define APP_ROAM_MIN_CYCLE_BYTES (4096)
+#endif
+
+//! A scan which hasn't completed by then is stopped
+#ifndef APP_ROAM_SCAN_TIMEOUT_MS
+  #define APP_ROAM_SCAN_TIMEOUT_MS (10 * 1000)
+#endif
+
+//! Creates the scan completion semaphore
+void app_roam_init(void);
+
+//! Reads the RSSI of the associated AP for app_roam_take_rssi(). Called by the HTTP task while it
+//! waits between upload cycles: the read is a blocking ioctl to the radio, too slow for the
+//! timer task the sampler runs in.
+void app_roam_read_rssi(void);
+
+//! Returns the RSSI read last by the HTTP task, in dBm
+//!
+//! @return false if there was no new reading since the last call
+bool app_roam_take_rssi(int16_t *rssi);
+
+//! Called by the upload client after each post with the bytes sent and the time it took to send
+//! them, excluding the wait for the response
+void app_roam_post_done(uint32_t bytes, uint32_t send_ms);
+
+//! Called by the HTTP task after each upload cycle. Scans and roams if the link is degraded.
+//!
+//! @return true if the device roamed to another AP
+bool app_roam_check(void);
+
+//! Records roams, scans, failed roams, the longest roam time and the upload throughput before
+//! and after the last roam in the heartbeat
+void app_roam_collect_metrics(void);
+
+//! Shell command which prints the link quality, the roam counters and the last roam. `roam
+//! scan` scans after the next upload cycle regardless of the link quality.
+int app_roam_cli_cmd(int argc, char *argv[]);
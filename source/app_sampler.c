@@ -0,0 +1,247 @@
+//! @file
+//!
+//! @brief
+//! Probe sampling engine, see app_sampler.h
+
+#include "app_sampler.h"
+
+#include <FreeRTOS.h>
+#include <inttypes.h>
+#include <string.h>
+#include <task.h>
+#include <timers.h>
+
+#include "app_cycles.h"
+#include "app_heap_stats.h"
+#include "app_histogram.h"
+#include "app_memmap.h"
+#include "app_metrics.h"
+#include "app_roam.h"
+#include "cy_syslib.h"
+
+#define APP_SAMPLER_BENCH_ITERATIONS (1000)
+
+typedef struct {
+  const char *name;
+  AppSamplerProbeFn fn;
+  uint32_t every;
+  sAppSamplerMetricKeys keys;
+  sAppHistogram histogram;
+} sAppSamplerProbe;
+
+static sAppSamplerProbe s_probes[APP_SAMPLER_MAX_PROBES];
+static size_t s_num_probes;
+static uint32_t s_period_count;
+
+static StaticTimer_t s_timer_storage APP_STATIC(sampler);
+static TimerHandle_t s_timer;
+
+// Previous readings for the CPU idle probe
+static uint32_t s_last_idle_run_time;
+static uint32_t s_last_run_time;
+static TickType_t s_last_ticks;
+static bool s_cpu_idle_primed;
+
+//
+// Built-in probes
+//
+
+static bool prv_sample_heap_in_use(uint32_t *value) {
+  sAppHeapStats stats;
+  app_heap_stats_get(&stats);
+  *value = stats.in_use_bytes;
+  return true;
+}
+
+//! Percentage of the elapsed time the CPU was idle or asleep
+//!
+//! The run time counter is the cycle counter, which stops while the core sleeps. Busy time is
+//! therefore measured in cycles and the elapsed time with the RTOS tick.
+static bool prv_sample_cpu_idle(uint32_t *value) {
+  const uint32_t idle_run_time = ulTaskGetIdleRunTimeCounter();
+  const uint32_t run_time = portGET_RUN_TIME_COUNTER_VALUE();
+  const TickType_t ticks = xTaskGetTickCount();
+
+  const uint32_t busy_cycles = (run_time - s_last_run_time) -
+                               (idle_run_time - s_last_idle_run_time);
+  const uint64_t elapsed_cycles =
+    (uint64_t)(ticks - s_last_ticks) * (SystemCoreClock / configTICK_RATE_HZ);
+  const bool primed = s_cpu_idle_primed;
+
+  s_last_idle_run_time = idle_run_time;
+  s_last_run_time = run_time;
+  s_last_ticks = ticks;
+  s_cpu_idle_primed = true;
+  if (!primed || (elapsed_cycles == 0)) {
+    return false;
+  }
+
+  const uint32_t busy_pct = (uint32_t)MEMFAULT_MIN(((uint64_t)busy_cycles * 100) / elapsed_cycles,
+                                                   100);
+  *value = 100 - busy_pct;
+  return true;
+}
+
+//! Signal strength of the associated AP as a positive number, in -dBm
+//!
+//! The HTTP task reads it from the radio, see app_roam_read_rssi(). Each reading is sampled once.
+static bool prv_sample_wifi_rssi(uint32_t *value) {
+  int16_t rssi;
+  if (!app_roam_take_rssi(&rssi) || (rssi >= 0)) {
+    return false;
+  }
+  *value = (uint32_t)(-rssi);
+  return true;
+}
+
+//! Bytes of events (heartbeats, reboots, trace events) queued for upload
+static bool prv_sample_event_storage(uint32_t *value) {
+  *value = (uint32_t)memfault_event_storage_bytes_used();
+  return true;
+}
+
+//! Bytes of logs not yet uploaded
+static bool prv_sample_log_unsent(uint32_t *value) {
+  *value = memfault_log_get_unsent_count().bytes;
+  return true;
+}
+
+//
+// Engine
+//
+
+bool app_sampler_register(const char *name, AppSamplerProbeFn fn, uint32_t every,
+                          sAppSamplerMetricKeys keys) {
+  if (s_num_probes >= APP_SAMPLER_MAX_PROBES) {
+    return false;
+  }
+  sAppSamplerProbe *probe = &s_probes[s_num_probes];
+  *probe = (sAppSamplerProbe){
+    .name = name,
+    .fn = fn,
+    .every = MEMFAULT_MAX(every, 1),
+    .keys = keys,
+  };
+  app_histogram_reset(&probe->histogram);
+
+  const uint32_t irq_state = Cy_SysLib_EnterCriticalSection();
+  s_num_probes++;
+  Cy_SysLib_ExitCriticalSection(irq_state);
+  return true;
+}
+
+static void prv_sample_probe(sAppSamplerProbe *probe) {
+  uint32_t value;
+  if (!probe->fn(&value)) {
+    return;
+  }
+  const uint32_t irq_state = Cy_SysLib_EnterCriticalSection();
+  app_histogram_add(&probe->histogram, value);
+  Cy_SysLib_ExitCriticalSection(irq_state);
+}
+
+static void prv_timer_callback(TimerHandle_t timer) {
+  s_period_count++;
+  for (size_t i = 0; i < s_num_probes; i++) {
+    if ((s_period_count % s_probes[i].every) == 0) {
+      prv_sample_probe(&s_probes[i]);
+    }
+  }
+}
+
+void app_sampler_init(void) {
+  app_sampler_register("heap_in_use", prv_sample_heap_in_use, 1,
+                       APP_SAMPLER_METRIC_KEYS(sample_heap_in_use));
+  app_sampler_register("cpu_idle_pct", prv_sample_cpu_idle, 1,
+                       APP_SAMPLER_METRIC_KEYS(sample_cpu_idle_pct));
+  app_sampler_register("wifi_rssi_neg_dbm", prv_sample_wifi_rssi, 1,
+                       APP_SAMPLER_METRIC_KEYS(sample_wifi_rssi_neg_dbm));
+  app_sampler_register("event_queue_bytes", prv_sample_event_storage, 1,
+                       APP_SAMPLER_METRIC_KEYS(sample_event_queue_bytes));
+  app_sampler_register("log_queue_bytes", prv_sample_log_unsent, 1,
+                       APP_SAMPLER_METRIC_KEYS(sample_log_queue_bytes));
+
+  s_timer = xTimerCreateStatic("Sampler", pdMS_TO_TICKS(APP_SAMPLER_PERIOD_MS), pdTRUE, NULL,
+                               prv_timer_callback, &s_timer_storage);
+  xTimerStart(s_timer, 0);
+}
+
+void app_sampler_collect_metrics(void) {
+  for (size_t i = 0; i < s_num_probes; i++) {
+    sAppSamplerProbe *probe = &s_probes[i];
+
+    // Summarized under the lock rather than copied, this runs on the timer task's small stack
+    sAppHistogramSummary summary;
+    const uint32_t irq_state = Cy_SysLib_EnterCriticalSection();
+    app_histogram_summarize(&probe->histogram, &summary);
+    app_histogram_reset(&probe->histogram);
+    Cy_SysLib_ExitCriticalSection(irq_state);
+
+    if (summary.count == 0) {
+      continue;
+    }
+    app_metrics_set_unsigned(probe->keys.min, summary.min);
+    app_metrics_set_unsigned(probe->keys.max, summary.max);
+    app_metrics_set_unsigned(probe->keys.mean, summary.mean);
+    app_metrics_set_unsigned(probe->keys.p50, summary.p50);
+    app_metrics_set_unsigned(probe->keys.p95, summary.p95);
+  }
+}
+
+static void prv_bench(void) {
+  app_cycles_init();
+
+  // A throwaway histogram so the heartbeat aggregates are not disturbed
+  static sAppHistogram s_bench_histogram;
+  app_histogram_reset(&s_bench_histogram);
+  uint32_t value = 0x1234;
+  const uint32_t start = app_cycles_get();
+  for (uint32_t i = 0; i < APP_SAMPLER_BENCH_ITERATIONS; i++) {
+    value ^= value << 13;
+    value ^= value >> 17;
+    value ^= value << 5;
+    app_histogram_add(&s_bench_histogram, value);
+  }
+  const uint32_t add_cycles = (app_cycles_get() - start) / APP_SAMPLER_BENCH_ITERATIONS;
+  MEMFAULT_LOG_INFO("histogram add: %" PRIu32 " cycles (incl. xorshift)", add_cycles);
+
+  const uint32_t pct_start = app_cycles_get();
+  (void)app_histogram_percentile(&s_bench_histogram, 950);
+  MEMFAULT_LOG_INFO("percentile estimate: %" PRIu32 " cycles", app_cycles_get() - pct_start);
+
+  for (size_t i = 0; i < s_num_probes; i++) {
+    uint32_t sample;
+    const uint32_t read_start = app_cycles_get();
+    const bool valid = s_probes[i].fn(&sample);
+    const uint32_t read_cycles = app_cycles_get() - read_start;
+    MEMFAULT_LOG_INFO("probe %-18s read: %6" PRIu32 " cycles%s", s_probes[i].name, read_cycles,
+                      valid ? "" : " (no sample)");
+  }
+  MEMFAULT_LOG_INFO("RAM per probe: %u bytes", (unsigned int)sizeof(sAppSamplerProbe));
+}
+
+int app_sampler_cli_cmd(int argc, char *argv[]) {
+  if ((argc > 1) && (strcmp(argv[1], "bench") == 0)) {
+    prv_bench();
+    return 0;
+  }
+
+  MEMFAULT_LOG_INFO("%-18s %6s %10s %10s %10s %10s %10s", "Probe", "Count", "Min", "Max", "Mean",
+                    "p50", "p95");
+  for (size_t i = 0; i < s_num_probes; i++) {
+    sAppHistogramSummary summary;
+    const uint32_t irq_state = Cy_SysLib_EnterCriticalSection();
+    app_histogram_summarize(&s_probes[i].histogram, &summary);
+    Cy_SysLib_ExitCriticalSection(irq_state);
+
+    if (summary.count == 0) {
+      MEMFAULT_LOG_INFO("%-18s %6d", s_probes[i].name, 0);
+      continue;
+    }
+    MEMFAULT_LOG_INFO("%-18s %6" PRIu32 " %10" PRIu32 " %10" PRIu32 " %10" PRIu32 " %10" PRIu32
+                      " %10" PRIu32,
+                      s_probes[i].name, summary.count, summary.min, summary.max, summary.mean,
+                      summary.p50, summary.p95);
+  }
+  return 0;
+}
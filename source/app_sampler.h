@@ -0,0 +1,72 @@
+#pragma once
+
+//! @file
+//!
+//! @brief
+//! Periodic sampling of registered probes into per-heartbeat histograms
+//!
+//! A static FreeRTOS software timer samples every probe each APP_SAMPLER_PERIOD_MS (or every
+//! Nth period for probes which are more expensive to read). Each probe aggregates into its own
+//! app_histogram, and at the end of the heartbeat interval min/max/mean/p50/p95 are written to
+//! the probe's heartbeat metrics and the histogram restarts. Nothing is allocated after boot.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "app_metrics.h"
+#include "memfault/components.h"
+
+#ifndef APP_SAMPLER_PERIOD_MS
+  #define APP_SAMPLER_PERIOD_MS (1000)
+#endif
+
+#ifndef APP_SAMPLER_MAX_PROBES
+  #define APP_SAMPLER_MAX_PROBES (8)
+#endif
+
+//! Reads a probe
+//!
+//! Runs in the timer service task and must return quickly.
+//!
+//! @param[out] value The sample
+//! @return false if there is no sample this period, e.g RSSI while disconnected
+typedef bool (*AppSamplerProbeFn)(uint32_t *value);
+
+typedef struct {
+  AppMetricId min;
+  AppMetricId max;
+  AppMetricId mean;
+  AppMetricId p50;
+  AppMetricId p95;
+} sAppSamplerMetricKeys;
+
+//! Expands to the sAppSamplerMetricKeys for metrics named prefix_min, prefix_max, ...
+#define APP_SAMPLER_METRIC_KEYS(prefix_)    \
+  (sAppSamplerMetricKeys) {                 \
+    .min = APP_METRIC_KEY(prefix_##_min),   \
+    .max = APP_METRIC_KEY(prefix_##_max),   \
+    .mean = APP_METRIC_KEY(prefix_##_mean), \
+    .p50 = APP_METRIC_KEY(prefix_##_p50),   \
+    .p95 = APP_METRIC_KEY(prefix_##_p95),   \
+  }
+
+//! Registers a probe
+//!
+//! @param name Name shown by the sampler shell command
+//! @param fn Reads the probe
+//! @param every Sample every Nth period, 1 for every period
+//! @param keys Heartbeat metrics the aggregates are written to
+//! @return false if the probe table is full
+bool app_sampler_register(const char *name, AppSamplerProbeFn fn, uint32_t every,
+                          sAppSamplerMetricKeys keys);
+
+//! Registers the built-in probes and starts sampling
+void app_sampler_init(void);
+
+//! Writes the aggregates of the interval to the heartbeat and restarts aggregation
+void app_sampler_collect_metrics(void);
+
+//! Shell command which prints the current interval's aggregates, or measures sampling cost
+//!
+//! Usage: sampler [bench]
+int app_sampler_cli_cmd(int argc, char *argv[]);
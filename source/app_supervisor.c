@@ -0,0 +1,218 @@
+//! @file
+//!
+//! @brief
+//! Task liveness supervisor, see app_supervisor.h
+
+#include "app_supervisor.h"
+
+#include <FreeRTOS.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <task.h>
+#include <timers.h>
+
+#include "app_log.h"
+#include "app_memmap.h"
+#include "app_metrics.h"
+#include "app_trace.h"
+#include "cy_syslib.h"
+#include "cyhal.h"
+#include "memfault/components.h"
+
+typedef struct {
+  const char *name;
+  uint32_t deadline_ms;
+} sAppSupervisorTaskInfo;
+
+typedef struct {
+  bool started;
+  bool stalled;
+  //! Task which checked in last, for app_supervisor_checkin_current()
+  TaskHandle_t handle;
+  TickType_t last_checkin;
+  //! Longest gap between check-ins this heartbeat interval
+  uint32_t interval_max_gap_ms;
+  //! Longest gap between check-ins since boot
+  uint32_t max_gap_ms;
+  uint32_t stall_count;
+} sAppSupervisorTaskState;
+
+static const sAppSupervisorTaskInfo s_task_info[kAppSupervisorTask_NumTasks] = {
+#define APP_SUPERVISOR_TASK_INIT(name_, key_, deadline_ms_) \
+  [kAppSupervisorTask_##name_] = { .name = #name_, .deadline_ms = (deadline_ms_) },
+  APP_SUPERVISOR_TASKS(APP_SUPERVISOR_TASK_INIT)
+#undef APP_SUPERVISOR_TASK_INIT
+};
+
+static sAppSupervisorTaskState s_tasks[kAppSupervisorTask_NumTasks];
+static uint32_t s_last_reported_stalls;
+
+static StaticTimer_t s_timer_storage APP_STATIC(supervisor);
+static TimerHandle_t s_timer;
+
+#if APP_SUPERVISOR_HW_WATCHDOG
+static cyhal_wdt_t s_wdt;
+#endif
+
+static uint32_t prv_ticks_to_ms(TickType_t ticks) {
+  return (uint32_t)(ticks * portTICK_PERIOD_MS);
+}
+
+void app_supervisor_checkin(eAppSupervisorTask task) {
+  if (task >= kAppSupervisorTask_NumTasks) {
+    return;
+  }
+  sAppSupervisorTaskState *state = &s_tasks[task];
+  const TickType_t now = xTaskGetTickCount();
+
+  const uint32_t irq_state = Cy_SysLib_EnterCriticalSection();
+  if (state->started) {
+    const uint32_t gap_ms = prv_ticks_to_ms(now - state->last_checkin);
+    state->interval_max_gap_ms = MEMFAULT_MAX(state->interval_max_gap_ms, gap_ms);
+    state->max_gap_ms = MEMFAULT_MAX(state->max_gap_ms, gap_ms);
+  }
+  state->started = true;
+  state->stalled = false;
+  state->handle = xTaskGetCurrentTaskHandle();
+  state->last_checkin = now;
+  Cy_SysLib_ExitCriticalSection(irq_state);
+}
+
+void app_supervisor_checkin_current(void) {
+  const TaskHandle_t current = xTaskGetCurrentTaskHandle();
+  for (eAppSupervisorTask task = 0; task < kAppSupervisorTask_NumTasks; task++) {
+    if (s_tasks[task].started && (s_tasks[task].handle == current)) {
+      app_supervisor_checkin(task);
+      return;
+    }
+  }
+}
+
+void app_supervisor_delay_ms(uint32_t delay_ms) {
+  while (delay_ms > 0) {
+    const uint32_t step_ms = MEMFAULT_MIN(delay_ms, APP_SUPERVISOR_CHECK_PERIOD_MS);
+    vTaskDelay(pdMS_TO_TICKS(step_ms));
+    delay_ms -= step_ms;
+    app_supervisor_checkin_current();
+  }
+}
+
+//! Returns the time since the task's last check-in, 0 for a task which is not supervised yet
+static uint32_t prv_current_gap_ms(const sAppSupervisorTaskState *state, TickType_t now) {
+  return state->started ? prv_ticks_to_ms(now - state->last_checkin) : 0;
+}
+
+static void prv_report_stall(eAppSupervisorTask task, uint32_t gap_ms) {
+  APP_LOG_ERROR("Task %s stalled, no check-in for %" PRIu32 " ms", s_task_info[task].name,
+                gap_ms);
+  APP_TRACE_EVENT(TaskStall, task);
+#if APP_SUPERVISOR_COREDUMP_ON_STALL
+  MEMFAULT_SOFTWARE_WATCHDOG();
+#endif
+}
+
+static void prv_timer_callback(TimerHandle_t timer) {
+  const TickType_t now = xTaskGetTickCount();
+  bool healthy = true;
+
+  for (eAppSupervisorTask task = 0; task < kAppSupervisorTask_NumTasks; task++) {
+    sAppSupervisorTaskState *state = &s_tasks[task];
+    const uint32_t gap_ms = prv_current_gap_ms(state, now);
+    if (gap_ms <= s_task_info[task].deadline_ms) {
+      continue;
+    }
+    healthy = false;
+
+    const uint32_t irq_state = Cy_SysLib_EnterCriticalSection();
+    const bool new_stall = !state->stalled;
+    state->stalled = true;
+    if (new_stall) {
+      state->stall_count++;
+    }
+    Cy_SysLib_ExitCriticalSection(irq_state);
+
+    if (new_stall) {
+      prv_report_stall(task, gap_ms);
+    }
+  }
+
+#if APP_SUPERVISOR_HW_WATCHDOG
+  if (healthy) {
+    cyhal_wdt_kick(&s_wdt);
+  }
+#else
+  (void)healthy;
+#endif
+}
+
+void app_supervisor_init(void) {
+#if APP_SUPERVISOR_HW_WATCHDOG
+  const cy_rslt_t rv = cyhal_wdt_init(&s_wdt, APP_SUPERVISOR_WDT_TIMEOUT_MS);
+  if (rv != CY_RSLT_SUCCESS) {
+    APP_LOG_ERROR("Watchdog init failed, rv=0x%x", (int)rv);
+  }
+#endif
+
+  s_timer = xTimerCreateStatic("Supervisor", pdMS_TO_TICKS(APP_SUPERVISOR_CHECK_PERIOD_MS),
+                               pdTRUE, NULL, prv_timer_callback, &s_timer_storage);
+  xTimerStart(s_timer, 0);
+}
+
+void app_supervisor_kick_watchdog(void) {
+#if APP_SUPERVISOR_HW_WATCHDOG
+  cyhal_wdt_kick(&s_wdt);
+#endif
+}
+
+void app_supervisor_collect_metrics(void) {
+  const AppMetricId gap_keys[kAppSupervisorTask_NumTasks] = {
+#define APP_SUPERVISOR_TASK_KEY(name_, key_, deadline_ms_) \
+  [kAppSupervisorTask_##name_] = APP_METRIC_KEY(supervisor_##key_##_max_gap_ms),
+    APP_SUPERVISOR_TASKS(APP_SUPERVISOR_TASK_KEY)
+#undef APP_SUPERVISOR_TASK_KEY
+  };
+
+  const TickType_t now = xTaskGetTickCount();
+  uint32_t stalls = 0;
+  for (eAppSupervisorTask task = 0; task < kAppSupervisorTask_NumTasks; task++) {
+    sAppSupervisorTaskState *state = &s_tasks[task];
+
+    const uint32_t irq_state = Cy_SysLib_EnterCriticalSection();
+    // Include the gap in progress, so a task that stopped checking in still shows up
+    const uint32_t max_gap_ms =
+      MEMFAULT_MAX(state->interval_max_gap_ms, prv_current_gap_ms(state, now));
+    state->interval_max_gap_ms = 0;
+    stalls += state->stall_count;
+    Cy_SysLib_ExitCriticalSection(irq_state);
+
+    if (state->started) {
+      app_metrics_set_unsigned(gap_keys[task], max_gap_ms);
+    }
+  }
+  APP_METRIC_SET(supervisor_stall_count, stalls - s_last_reported_stalls);
+  s_last_reported_stalls = stalls;
+  // The heartbeat is collected in the timer task, so this is its high-water mark since boot
+  APP_METRIC_SET(timer_task_stack_free_words, uxTaskGetStackHighWaterMark(NULL));
+}
+
+int app_supervisor_cli_cmd(int argc, char *argv[]) {
+  const TickType_t now = xTaskGetTickCount();
+  MEMFAULT_LOG_INFO("%-6s %10s %10s %10s %7s", "Task", "Deadline", "Since", "Max gap", "Stalls");
+  for (eAppSupervisorTask task = 0; task < kAppSupervisorTask_NumTasks; task++) {
+    const uint32_t irq_state = Cy_SysLib_EnterCriticalSection();
+    const sAppSupervisorTaskState state = s_tasks[task];
+    Cy_SysLib_ExitCriticalSection(irq_state);
+
+    if (!state.started) {
+      MEMFAULT_LOG_INFO("%-6s %10" PRIu32 " %10s", s_task_info[task].name,
+                        s_task_info[task].deadline_ms, "-");
+      continue;
+    }
+    MEMFAULT_LOG_INFO("%-6s %10" PRIu32 " %10" PRIu32 " %10" PRIu32 " %7" PRIu32 "%s",
+                      s_task_info[task].name, s_task_info[task].deadline_ms,
+                      prv_current_gap_ms(&state, now), state.max_gap_ms, state.stall_count,
+                      state.stalled ? " STALLED" : "");
+  }
+  MEMFAULT_LOG_INFO("Hardware watchdog: %s", APP_SUPERVISOR_HW_WATCHDOG ? "on" : "off");
+  return 0;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+//! @file
+//!
+//! @brief
+//! Task liveness supervisor
+//!
+//! Supervised tasks check in from their main loop. A static software timer checks every
+//! APP_SUPERVISOR_CHECK_PERIOD_MS that each task checked in within its deadline and only then
+//! kicks the hardware watchdog. A task that misses its deadline is reported with a TaskStall
+//! trace event; the watchdog is then left to reset the device, after saving a coredump first if
+//! APP_SUPERVISOR_COREDUMP_ON_STALL is set. The longest gap between check-ins of each task is
+//! reported in every heartbeat.
+//!
+//! A task is only supervised from its first check-in on, so blocking boot steps such as the
+//! Wi-Fi connection are not covered. Code shared between tasks, e.g. the Wi-Fi connection
+//! retries, checks in on behalf of whichever supervised task runs it.
+
+#include <stdint.h>
+
+//! X(name, metric name, deadline in ms)
+//!
+//! The HTTP task checks in at least every 10 s while it waits between posts, but an upload can
+//! take several socket timeouts. The CLI task polls the UART every 10 ms, but benchmark commands
+//! run for a few seconds.
+#define APP_SUPERVISOR_TASKS(X) \
+  X(Http, http, 3 * 60 * 1000)  \
+  X(Cli, cli, 30 * 1000)
+
+typedef enum {
+#define APP_SUPERVISOR_TASK_ENUM(name_, key_, deadline_ms_) kAppSupervisorTask_##name_,
+  APP_SUPERVISOR_TASKS(APP_SUPERVISOR_TASK_ENUM)
+#undef APP_SUPERVISOR_TASK_ENUM
+  kAppSupervisorTask_NumTasks,
+} eAppSupervisorTask;
+
+#ifndef APP_SUPERVISOR_CHECK_PERIOD_MS
+  #define APP_SUPERVISOR_CHECK_PERIOD_MS (1000)
+#endif
+
+//! 1 to feed the hardware watchdog while all tasks are healthy, 0 to only report stalls, e.g
+//! while debugging
+#ifndef APP_SUPERVISOR_HW_WATCHDOG
+  #define APP_SUPERVISOR_HW_WATCHDOG 1
+#endif
+
+//! Must be longer than APP_SUPERVISOR_CHECK_PERIOD_MS and within the WDT's range
+#ifndef APP_SUPERVISOR_WDT_TIMEOUT_MS
+  #define APP_SUPERVISOR_WDT_TIMEOUT_MS (4000)
+#endif
+
+//! 1 to save a coredump (MEMFAULT_SOFTWARE_WATCHDOG) as soon as a deadline is missed
+#ifndef APP_SUPERVISOR_COREDUMP_ON_STALL
+  #define APP_SUPERVISOR_COREDUMP_ON_STALL 0
+#endif
+
+//! Starts the hardware watchdog and the check timer. Call before the scheduler starts.
+void app_supervisor_init(void);
+
+//! Records progress of a task
+void app_supervisor_checkin(eAppSupervisorTask task);
+
+//! Records progress of the calling task if it is supervised, does nothing otherwise
+void app_supervisor_checkin_current(void);
+
+//! Blocks for delay_ms like vTaskDelay(), checking in the calling task every
+//! APP_SUPERVISOR_CHECK_PERIOD_MS, for waits which can be longer than its deadline
+void app_supervisor_delay_ms(uint32_t delay_ms);
+
+//! Feeds the hardware watchdog regardless of task health
+//!
+//! Only for the fault handler: the supervisor timer no longer runs while a coredump is saved.
+void app_supervisor_kick_watchdog(void);
+
+//! Records the longest check-in gap of each task and the stalls of the interval
+void app_supervisor_collect_metrics(void);
+
+//! Shell command which prints check-in gaps and stalls per task
+int app_supervisor_cli_cmd(int argc, char *argv[]);
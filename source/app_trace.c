@@ -0,0 +1,125 @@
+//! @file
+//!
+//! @brief
+//! Per-reason token buckets for trace events, see app_trace.h
+
+#include "app_trace.h"
+
+#include <FreeRTOS.h>
+#include <inttypes.h>
+#include <task.h>
+
+#include "app_metrics.h"
+#include "cy_syslib.h"
+
+typedef struct {
+  uint32_t tokens;
+  //! Tick of the last refill, only advanced by whole refill intervals
+  TickType_t last_refill;
+  //! Occurrences dropped since the last captured event
+  uint32_t pending_suppressed;
+  uint32_t total_count;
+  uint32_t captured_count;
+  uint32_t suppressed_count;
+} sAppTraceBucket;
+
+static sAppTraceBucket s_buckets[kMfltTraceReasonUser_NumReasons];
+static bool s_buckets_initialized;
+//! Set once memfault_platform_boot() has set up event storage
+static bool s_sdk_booted;
+
+static uint32_t s_last_captured_count;
+static uint32_t s_last_suppressed_count;
+
+static const char *const s_reason_names[kMfltTraceReasonUser_NumReasons] = {
+#define MEMFAULT_TRACE_REASON_DEFINE(name_) [MEMFAULT_TRACE_REASON(name_)] = #name_,
+#include "memfault_trace_reason_user_config.def"
+#undef MEMFAULT_TRACE_REASON_DEFINE
+};
+
+static void prv_init_buckets(TickType_t now) {
+  for (size_t i = 0; i < MEMFAULT_ARRAY_SIZE(s_buckets); i++) {
+    s_buckets[i] = (sAppTraceBucket){
+      .tokens = APP_TRACE_BURST,
+      .last_refill = now,
+    };
+  }
+  s_buckets_initialized = true;
+}
+
+static void prv_refill(sAppTraceBucket *bucket, TickType_t now) {
+  const TickType_t interval = pdMS_TO_TICKS(APP_TRACE_REFILL_INTERVAL_MS);
+  const uint32_t refills = (uint32_t)((now - bucket->last_refill) / interval);
+  if (refills == 0) {
+    return;
+  }
+  bucket->tokens = MEMFAULT_MIN(bucket->tokens + refills, APP_TRACE_BURST);
+  bucket->last_refill += refills * interval;
+}
+
+void app_trace_boot(void) {
+  s_sdk_booted = true;
+}
+
+bool app_trace_should_capture(uint32_t reason, uint32_t *suppressed) {
+  if (reason >= MEMFAULT_ARRAY_SIZE(s_buckets)) {
+    return false;
+  }
+  const TickType_t now = xTaskGetTickCount();
+
+  const uint32_t irq_state = Cy_SysLib_EnterCriticalSection();
+  if (!s_buckets_initialized) {
+    prv_init_buckets(now);
+  }
+  sAppTraceBucket *bucket = &s_buckets[reason];
+  prv_refill(bucket, now);
+  bucket->total_count++;
+
+  const bool capture = s_sdk_booted && (bucket->tokens > 0);
+  if (capture) {
+    bucket->tokens--;
+    bucket->captured_count++;
+    *suppressed = bucket->pending_suppressed;
+    bucket->pending_suppressed = 0;
+  } else {
+    bucket->suppressed_count++;
+    bucket->pending_suppressed++;
+  }
+  Cy_SysLib_ExitCriticalSection(irq_state);
+  return capture;
+}
+
+void app_trace_collect_metrics(void) {
+  uint32_t captured = 0;
+  uint32_t suppressed = 0;
+  const uint32_t irq_state = Cy_SysLib_EnterCriticalSection();
+  for (size_t i = 0; i < MEMFAULT_ARRAY_SIZE(s_buckets); i++) {
+    captured += s_buckets[i].captured_count;
+    suppressed += s_buckets[i].suppressed_count;
+  }
+  Cy_SysLib_ExitCriticalSection(irq_state);
+
+  APP_METRIC_SET(trace_captured_count, captured - s_last_captured_count);
+  APP_METRIC_SET(trace_suppressed_count, suppressed - s_last_suppressed_count);
+  s_last_captured_count = captured;
+  s_last_suppressed_count = suppressed;
+}
+
+int app_trace_cli_cmd(int argc, char *argv[]) {
+  MEMFAULT_LOG_INFO("%-20s %8s %8s %10s %6s", "Reason", "Total", "Captured", "Suppressed",
+                    "Tokens");
+  for (size_t i = 0; i < MEMFAULT_ARRAY_SIZE(s_buckets); i++) {
+    if (s_reason_names[i] == NULL) {
+      continue;
+    }
+    const uint32_t irq_state = Cy_SysLib_EnterCriticalSection();
+    const sAppTraceBucket bucket = s_buckets[i];
+    Cy_SysLib_ExitCriticalSection(irq_state);
+
+    MEMFAULT_LOG_INFO("%-20s %8" PRIu32 " %8" PRIu32 " %10" PRIu32 " %6" PRIu32,
+                      s_reason_names[i], bucket.total_count, bucket.captured_count,
+                      bucket.suppressed_count,
+                      s_buckets_initialized ? bucket.tokens : (uint32_t)APP_TRACE_BURST);
+  }
+  return 0;
+}
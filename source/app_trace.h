@@ -0,0 +1,57 @@
+#pragma once
+
+//! @file
+//!
+//! @brief
+//! Rate limited trace events for the reasons in configs/memfault_trace_reason_user_config.def
+//!
+//! Every reason has its own token bucket. While a condition flaps (Wi-Fi drops, failing uploads),
+//! the first APP_TRACE_BURST occurrences are captured and after that one per
+//! APP_TRACE_REFILL_INTERVAL_MS. Occurrences which are not captured are counted, and the count
+//! is attached to the next captured event of that reason, so event storage and upload bandwidth
+//! stay bounded without losing how often the condition happened.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "memfault/components.h"
+
+#ifndef APP_TRACE_BURST
+  #define APP_TRACE_BURST 3
+#endif
+
+#ifndef APP_TRACE_REFILL_INTERVAL_MS
+  #define APP_TRACE_REFILL_INTERVAL_MS (10 * 60 * 1000)
+#endif
+
+//! Records an occurrence of reason_ and captures a trace event if its bucket allows it
+//!
+//! The event is captured at the call site, with the given status code and the number of
+//! occurrences suppressed since the previous captured event. Call from task context.
+#define APP_TRACE_EVENT(reason_, status_)                                                   \
+  do {                                                                                      \
+    uint32_t suppressed_;                                                                   \
+    if (app_trace_should_capture(MEMFAULT_TRACE_REASON(reason_), &suppressed_)) {           \
+      MEMFAULT_TRACE_EVENT_WITH_LOG(reason_, "status=%d suppressed=%d", (int)(status_),     \
+                                    (int)suppressed_);                                      \
+    }                                                                                       \
+  } while (0)
+
+//! Starts capturing events, call after memfault_platform_boot()
+//!
+//! Occurrences before that, e.g. a kv-store error while the config is loaded, are counted as
+//! suppressed and reported with the next captured event of their reason.
+void app_trace_boot(void);
+
+//! Takes a token from the bucket of a reason
+//!
+//! @param reason The trace reason, MEMFAULT_TRACE_REASON(name)
+//! @param[out] suppressed Occurrences dropped since the last capture, valid if true is returned
+//! @return true if an event should be captured for this occurrence
+bool app_trace_should_capture(uint32_t reason, uint32_t *suppressed);
+
+//! Records the number of captured and suppressed events in the heartbeat
+void app_trace_collect_metrics(void);
+
+//! Shell command which prints the per-reason counters
+int app_trace_cli_cmd(int argc, char *argv[]);
@@ -0,0 +1,552 @@
+//! @file
+//!
+//! @brief
+//! Chunk upload over a TLS socket, see app_upload.h
+
+#include "app_upload.h"
+
+#include <FreeRTOS.h>
+#include <inttypes.h>
+#include <semphr.h>
+#include <stdbool.h>
+#include <string.h>
+#include <task.h>
+
+#include "app_dns_cache.h"
+#include "app_histogram.h"
+#include "app_heap_stats.h"
+#include "app_impair.h"
+#include "app_log.h"
+#include "app_memmap.h"
+#include "app_metrics.h"
+#include "app_placement.h"
+#include "app_roam.h"
+#include "app_sampler.h"
+#include "cy_secure_sockets.h"
+#include "cy_syslib.h"
+#include "mbedtls/ssl.h"
+#include "memfault/components.h"
+
+#define APP_UPLOAD_RECV_TIMEOUT_MS (10 * 1000)
+#define APP_UPLOAD_SEND_TIMEOUT_MS (10 * 1000)
+
+MEMFAULT_STATIC_ASSERT((APP_UPLOAD_TLS_MFL == 0) ||
+                         (APP_UPLOAD_RECORD_PAYLOAD_SIZE <= APP_UPLOAD_TLS_MFL),
+                       "A record buffer must fit in one TLS fragment");
+MEMFAULT_STATIC_ASSERT(APP_UPLOAD_RECORD_PAYLOAD_SIZE <= MBEDTLS_SSL_OUT_CONTENT_LEN,
+                       "A record buffer must fit in the mbedTLS output buffer");
+
+//! The packetizer needs room for a chunk header, it reports no data for smaller buffers
+#define APP_UPLOAD_MIN_PACKETIZER_SPACE (9)
+
+typedef enum {
+#define APP_UPLOAD_FAILURE_ENUM(name_) kAppUploadFailure_##name_,
+  APP_UPLOAD_FAILURES(APP_UPLOAD_FAILURE_ENUM)
+#undef APP_UPLOAD_FAILURE_ENUM
+  kAppUploadFailure_NumReasons,
+} eAppUploadFailure;
+
+static const char *const s_failure_names[kAppUploadFailure_NumReasons] = {
+#define APP_UPLOAD_FAILURE_NAME(name_) [kAppUploadFailure_##name_] = #name_,
+  APP_UPLOAD_FAILURES(APP_UPLOAD_FAILURE_NAME)
+#undef APP_UPLOAD_FAILURE_NAME
+};
+
+//! Latency of the phases of a post. Connect includes the DNS lookup and the handshake.
+typedef struct {
+  sAppHistogram connect_ms;
+  sAppHistogram handshake_ms;
+  sAppHistogram transfer_ms;
+} sAppUploadLatency;
+
+typedef struct {
+  uint32_t posts;
+  uint32_t failures;
+  //! Bytes handed to the socket, HTTP header included
+  uint32_t socket_bytes;
+  //! Chunk bytes the packetizer wrote into the record buffer
+  uint32_t body_bytes;
+  //! Bytes this client copied itself. Only the HTTP header, chunk data is not copied.
+  uint32_t copied_bytes;
+  //! cy_socket_send() calls, each is one TLS record
+  uint32_t records;
+  uint32_t last_connect_ms;
+  //! Duration of the TCP connect and TLS handshake
+  uint32_t last_handshake_ms;
+  //! Heap allocated during the handshake, above what was in use before it
+  uint32_t last_handshake_heap_bytes;
+  uint32_t last_transfer_ms;
+  uint32_t last_bytes_per_s;
+  //! Sum of the transfer times, for the mean throughput
+  uint64_t transfer_ms;
+  uint32_t failure_counts[kAppUploadFailure_NumReasons];
+  //! Age of the oldest pending data when it was posted, the most seen
+  uint32_t max_sent_age_ms;
+  //! Fewest free words left on the uploading task's stack after a post
+  uint32_t min_stack_free_words;
+} sAppUploadStats;
+
+typedef struct {
+  cy_socket_t socket;
+  size_t fill;
+} sAppUploadConn;
+
+static uint8_t s_record[APP_UPLOAD_RECORD_PAYLOAD_SIZE];
+
+static sAppUploadStats s_stats = {
+  .min_stack_free_words = UINT32_MAX,
+};
+static uint32_t s_last_reported_bytes;
+static uint32_t s_last_reported_posts;
+static uint32_t s_last_reported_failures[kAppUploadFailure_NumReasons];
+static uint32_t s_last_sampled_bytes;
+
+//! Since boot for `upload_stats`, and since the last heartbeat for the metrics
+static sAppUploadLatency s_latency;
+static sAppUploadLatency s_heartbeat_latency;
+//! Heartbeat maximum of max_sent_age_ms
+static uint32_t s_heartbeat_max_sent_age_ms;
+
+//! Why the post in progress failed. A post can fail more than once, e.g. a cached address
+//! that doesn't connect before a fresh lookup fails too, only the last reason is counted.
+static eAppUploadFailure s_failure;
+
+//! Set once the packetizer returned the end of the chunk of the post in progress. The chunk is
+//! then marked read and memfault_packetizer_abort() doesn't rewind it.
+static bool s_chunk_read;
+
+//! When the HTTP task last found nothing left to post. Anything pending was queued since, so the
+//! time since then bounds the age of the oldest pending data. 0, i.e. boot, until then.
+static TickType_t s_empty_since;
+
+//! Held for the whole of a post, the packetizer keeps the message in progress between calls
+static SemaphoreHandle_t s_post_lock;
+static StaticSemaphore_t s_post_lock_storage APP_STATIC(http);
+
+static uint32_t prv_ms_since(TickType_t start) {
+  return (uint32_t)((xTaskGetTickCount() - start) * portTICK_PERIOD_MS);
+}
+
+static bool prv_sample_upload_bytes(uint32_t *value) {
+  const uint32_t bytes = s_stats.socket_bytes;
+  *value = bytes - s_last_sampled_bytes;
+  s_last_sampled_bytes = bytes;
+  return true;
+}
+
+void app_upload_init(void) {
+  s_post_lock = xSemaphoreCreateMutexStatic(&s_post_lock_storage);
+  app_sampler_register("upload_bytes", prv_sample_upload_bytes, 1,
+                       APP_SAMPLER_METRIC_KEYS(sample_upload_bytes));
+}
+
+#if APP_UPLOAD_ZERO_COPY
+
+//! Adds a sample to the boot and heartbeat histograms. The heartbeat ones are read and reset by
+//! the timer task.
+static void prv_add_latency(sAppHistogram *boot, sAppHistogram *heartbeat, uint32_t value_ms) {
+  app_histogram_add(boot, value_ms);
+  const uint32_t irq_state = Cy_SysLib_EnterCriticalSection();
+  app_histogram_add(heartbeat, value_ms);
+  Cy_SysLib_ExitCriticalSection(irq_state);
+}
+
+#define APP_UPLOAD_ADD_LATENCY(field_, value_ms_) \
+  prv_add_latency(&s_latency.field_, &s_heartbeat_latency.field_, (value_ms_))
+
+//! Sends the record buffer as one TLS record
+APP_RAMFUNC static bool prv_flush(sAppUploadConn *conn) {
+  size_t offset = 0;
+  while (offset < conn->fill) {
+    uint32_t sent = 0;
+    const cy_rslt_t rv = app_impair_send(conn->socket, &s_record[offset], conn->fill - offset,
+                                         CY_SOCKET_FLAGS_NONE, &sent);
+    if (rv != CY_RSLT_SUCCESS) {
+      APP_LOG_ERROR("Chunk send failed, rv=0x%x", (int)rv);
+      s_failure = kAppUploadFailure_send;
+      return false;
+    }
+    offset += sent;
+  }
+  s_stats.records++;
+  s_stats.socket_bytes += conn->fill;
+  conn->fill = 0;
+  return true;
+}
+
+//! MfltHttpClientSendCb for the HTTP request header
+static bool prv_send_header(const void *data, size_t data_len, void *ctx) {
+  sAppUploadConn *conn = ctx;
+  const uint8_t *bytes = data;
+  while (data_len > 0) {
+    if ((conn->fill == sizeof(s_record)) && !prv_flush(conn)) {
+      return false;
+    }
+    const size_t len = MEMFAULT_MIN(data_len, sizeof(s_record) - conn->fill);
+    memcpy(&s_record[conn->fill], bytes, len);
+    conn->fill += len;
+    s_stats.copied_bytes += len;
+    bytes += len;
+    data_len -= len;
+  }
+  return true;
+}
+
+//! Lets the packetizer fill the record buffer behind the header until the chunk ends
+APP_RAMFUNC static bool prv_send_body(sAppUploadConn *conn) {
+  while (1) {
+    if ((sizeof(s_record) - conn->fill) < APP_UPLOAD_MIN_PACKETIZER_SPACE) {
+      if (!prv_flush(conn)) {
+        return false;
+      }
+    }
+    size_t buf_len = sizeof(s_record) - conn->fill;
+    const eMemfaultPacketizerStatus status =
+      memfault_packetizer_get_next(&s_record[conn->fill], &buf_len);
+    if (status == kMemfaultPacketizerStatus_NoMoreData) {
+      break;
+    }
+    conn->fill += buf_len;
+    s_stats.body_bytes += buf_len;
+    if (status == kMemfaultPacketizerStatus_EndOfChunk) {
+      s_chunk_read = true;
+      break;
+    }
+  }
+  return (conn->fill == 0) || prv_flush(conn);
+}
+
+static bool prv_read_response(sAppUploadConn *conn) {
+  sMemfaultHttpResponseContext response = { 0 };
+  while (1) {
+    uint8_t buf[128];
+    uint32_t received = 0;
+    const cy_rslt_t rv =
+      app_impair_recv(conn->socket, buf, sizeof(buf), CY_SOCKET_FLAGS_NONE, &received);
+    if ((rv != CY_RSLT_SUCCESS) || (received == 0)) {
+      APP_LOG_ERROR("No response to chunk post, rv=0x%x", (int)rv);
+      s_failure = kAppUploadFailure_no_response;
+      return false;
+    }
+    if (memfault_http_parse_response(&response, buf, received)) {
+      break;
+    }
+  }
+  if (response.parse_error || (response.http_status_code < 200) ||
+      (response.http_status_code >= 300)) {
+    APP_LOG_ERROR("Chunk post rejected, status=%d parse_error=%d", response.http_status_code,
+                  response.parse_error);
+    s_failure = kAppUploadFailure_rejected;
+    return false;
+  }
+  return true;
+}
+
+static bool prv_connect_to(sAppUploadConn *conn, const char *host,
+                           const cy_socket_ip_address_t *ip_address) {
+  cy_rslt_t rv = cy_socket_create(CY_SOCKET_DOMAIN_AF_INET, CY_SOCKET_TYPE_STREAM,
+                                  CY_SOCKET_IPPROTO_TLS, &conn->socket);
+  if (rv != CY_RSLT_SUCCESS) {
+    APP_LOG_ERROR("Socket create failed, rv=0x%x", (int)rv);
+    s_failure = kAppUploadFailure_socket;
+    return false;
+  }
+
+  const cy_socket_tls_auth_mode_t auth_mode = CY_SOCKET_TLS_VERIFY_REQUIRED;
+  const uint32_t recv_timeout_ms = APP_UPLOAD_RECV_TIMEOUT_MS;
+  const uint32_t send_timeout_ms = APP_UPLOAD_SEND_TIMEOUT_MS;
+  cy_socket_setsockopt(conn->socket, CY_SOCKET_SOL_TLS, CY_SOCKET_SO_TLS_AUTH_MODE, &auth_mode,
+                       sizeof(auth_mode));
+  cy_socket_setsockopt(conn->socket, CY_SOCKET_SOL_TLS, CY_SOCKET_SO_SERVER_NAME_INDICATION, host,
+                       strlen(host));
+  cy_socket_setsockopt(conn->socket, CY_SOCKET_SOL_SOCKET, CY_SOCKET_SO_RCVTIMEO,
+                       &recv_timeout_ms, sizeof(recv_timeout_ms));
+  cy_socket_setsockopt(conn->socket, CY_SOCKET_SOL_SOCKET, CY_SOCKET_SO_SNDTIMEO,
+                       &send_timeout_ms, sizeof(send_timeout_ms));
+#if APP_UPLOAD_TLS_MFL
+  const uint32_t mfl = APP_UPLOAD_TLS_MFL;
+  cy_socket_setsockopt(conn->socket, CY_SOCKET_SOL_TLS, CY_SOCKET_SO_TLS_MFL, &mfl, sizeof(mfl));
+#endif
+
+  cy_socket_sockaddr_t address = {
+    .ip_address = *ip_address,
+    .port = MEMFAULT_HTTP_GET_CHUNKS_API_PORT(),
+  };
+  const TickType_t handshake_start = xTaskGetTickCount();
+  const uint32_t heap_before = app_heap_stats_watermark_reset();
+  rv = app_impair_connect(conn->socket, &address, sizeof(address));
+  s_stats.last_handshake_ms = prv_ms_since(handshake_start);
+  s_stats.last_handshake_heap_bytes = app_heap_stats_watermark_get() - heap_before;
+  app_memmap_set_heap(kAppMemmap_tls, s_stats.last_handshake_heap_bytes);
+  // Failed handshakes too, a timeout is the tail that matters
+  APP_UPLOAD_ADD_LATENCY(handshake_ms, s_stats.last_handshake_ms);
+  if (rv != CY_RSLT_SUCCESS) {
+    APP_LOG_ERROR("Connect to %s failed, rv=0x%x", host, (int)rv);
+    s_failure = kAppUploadFailure_connect;
+    cy_socket_delete(conn->socket);
+    return false;
+  }
+  return true;
+}
+
+//! Connects to the chunks endpoint, resolving the host again if its cached address fails
+static bool prv_connect(sAppUploadConn *conn) {
+  const char *host = MEMFAULT_HTTP_GET_CHUNKS_API_HOST();
+  cy_socket_ip_address_t ip_address;
+  bool from_cache;
+  cy_rslt_t rv = app_dns_cache_resolve(host, &ip_address, &from_cache);
+  if (rv != CY_RSLT_SUCCESS) {
+    APP_LOG_ERROR("DNS lookup of %s failed, rv=0x%x", host, (int)rv);
+    s_failure = kAppUploadFailure_dns;
+    return false;
+  }
+  if (prv_connect_to(conn, host, &ip_address)) {
+    return true;
+  }
+  if (!from_cache) {
+    return false;
+  }
+
+  app_dns_cache_invalidate(host);
+  rv = app_dns_cache_resolve(host, &ip_address, &from_cache);
+  if (rv != CY_RSLT_SUCCESS) {
+    APP_LOG_ERROR("DNS lookup of %s failed, rv=0x%x", host, (int)rv);
+    s_failure = kAppUploadFailure_dns;
+    return false;
+  }
+  return prv_connect_to(conn, host, &ip_address);
+}
+
+static int prv_post_chunk(void) {
+  const sPacketizerConfig packetizer_config = {
+    .enable_multi_packet_chunk = true,
+  };
+  sPacketizerMetadata metadata;
+  if (!memfault_packetizer_begin(&packetizer_config, &metadata)) {
+    return 1;
+  }
+
+  const TickType_t connect_start = xTaskGetTickCount();
+  sAppUploadConn conn = { 0 };
+  if (!prv_connect(&conn)) {
+    memfault_packetizer_abort();
+    return -1;
+  }
+  s_stats.last_connect_ms = prv_ms_since(connect_start);
+  APP_UPLOAD_ADD_LATENCY(connect_ms, s_stats.last_connect_ms);
+
+  const TickType_t transfer_start = xTaskGetTickCount();
+  const uint32_t start_bytes = s_stats.socket_bytes;
+  const bool sent =
+    memfault_http_start_chunk_post(prv_send_header, &conn, metadata.single_chunk_message_length) &&
+    prv_send_body(&conn);
+  if (!sent) {
+    memfault_packetizer_abort();
+  }
+  const uint32_t send_ms = prv_ms_since(transfer_start);
+  const bool accepted = sent && prv_read_response(&conn);
+
+  const uint32_t transfer_ms = prv_ms_since(transfer_start);
+  const uint32_t transfer_bytes = s_stats.socket_bytes - start_bytes;
+  s_stats.last_transfer_ms = transfer_ms;
+  s_stats.last_bytes_per_s =
+    (uint32_t)(((uint64_t)transfer_bytes * 1000) / MEMFAULT_MAX(transfer_ms, 1));
+  s_stats.transfer_ms += transfer_ms;
+  APP_UPLOAD_ADD_LATENCY(transfer_ms, transfer_ms);
+  app_roam_post_done(transfer_bytes, send_ms);
+
+  cy_socket_disconnect(conn.socket, 0);
+  cy_socket_delete(conn.socket);
+  return accepted ? 0 : -1;
+}
+
+#else
+
+static int prv_post_chunk(void) {
+  return memfault_http_client_post_chunk();
+}
+
+#endif /* APP_UPLOAD_ZERO_COPY */
+
+int app_upload_post_chunk(void) {
+  // The port's client doesn't say why a post failed
+  s_failure = kAppUploadFailure_other;
+  s_chunk_read = false;
+  xSemaphoreTake(s_post_lock, portMAX_DELAY);
+  const int rv = prv_post_chunk();
+  xSemaphoreGive(s_post_lock);
+  if (rv == 1) {
+    return rv;
+  }
+
+  s_stats.posts++;
+  if (rv < 0) {
+    s_stats.failures++;
+    s_stats.failure_counts[s_failure]++;
+  } else {
+    const uint32_t age_ms = prv_ms_since(s_empty_since);
+    s_stats.max_sent_age_ms = MEMFAULT_MAX(s_stats.max_sent_age_ms, age_ms);
+    s_heartbeat_max_sent_age_ms = MEMFAULT_MAX(s_heartbeat_max_sent_age_ms, age_ms);
+  }
+  app_impair_post_done(rv == 0, s_chunk_read);
+  app_metrics_post_done(rv == 0);
+  s_stats.min_stack_free_words =
+    MEMFAULT_MIN(s_stats.min_stack_free_words, (uint32_t)uxTaskGetStackHighWaterMark(NULL));
+  return rv;
+}
+
+bool app_upload_pause(uint32_t timeout_ms) {
+  return xSemaphoreTake(s_post_lock, pdMS_TO_TICKS(timeout_ms)) == pdTRUE;
+}
+
+void app_upload_resume(void) {
+  xSemaphoreGive(s_post_lock);
+}
+
+void app_upload_cycle_done(void) {
+  if (!memfault_packetizer_data_available()) {
+    s_empty_since = xTaskGetTickCount();
+  }
+}
+
+static void prv_set_percentiles(const sAppHistogramSummary *summary, AppMetricId p50_key,
+                                AppMetricId p95_key) {
+  if (summary->count == 0) {
+    return;
+  }
+  app_metrics_set_unsigned(p50_key, summary->p50);
+  app_metrics_set_unsigned(p95_key, summary->p95);
+}
+
+void app_upload_collect_metrics(void) {
+  const uint32_t bytes = s_stats.socket_bytes;
+  APP_METRIC_SET(upload_bytes, bytes - s_last_reported_bytes);
+  s_last_reported_bytes = bytes;
+  const uint32_t posts = s_stats.posts;
+  APP_METRIC_SET(upload_posts_count, posts - s_last_reported_posts);
+  s_last_reported_posts = posts;
+  const AppMetricId failure_keys[kAppUploadFailure_NumReasons] = {
+#define APP_UPLOAD_FAILURE_KEY(name_) \
+  [kAppUploadFailure_##name_] = APP_METRIC_KEY(upload_fail_##name_##_count),
+    APP_UPLOAD_FAILURES(APP_UPLOAD_FAILURE_KEY)
+#undef APP_UPLOAD_FAILURE_KEY
+  };
+  for (eAppUploadFailure reason = 0; reason < kAppUploadFailure_NumReasons; reason++) {
+    const uint32_t count = s_stats.failure_counts[reason];
+    app_metrics_set_unsigned(failure_keys[reason], count - s_last_reported_failures[reason]);
+    s_last_reported_failures[reason] = count;
+  }
+
+  // Runs in the timer task, whose stack has no room for copies of the histograms. Percentiles
+  // are a walk over 64 buckets, short enough to take under the lock.
+  sAppHistogramSummary connect_ms;
+  sAppHistogramSummary handshake_ms;
+  sAppHistogramSummary transfer_ms;
+  const uint32_t irq_state = Cy_SysLib_EnterCriticalSection();
+  app_histogram_summarize(&s_heartbeat_latency.connect_ms, &connect_ms);
+  app_histogram_summarize(&s_heartbeat_latency.handshake_ms, &handshake_ms);
+  app_histogram_summarize(&s_heartbeat_latency.transfer_ms, &transfer_ms);
+  app_histogram_reset(&s_heartbeat_latency.connect_ms);
+  app_histogram_reset(&s_heartbeat_latency.handshake_ms);
+  app_histogram_reset(&s_heartbeat_latency.transfer_ms);
+  const uint32_t max_sent_age_ms = s_heartbeat_max_sent_age_ms;
+  s_heartbeat_max_sent_age_ms = 0;
+  Cy_SysLib_ExitCriticalSection(irq_state);
+
+  prv_set_percentiles(&connect_ms, APP_METRIC_KEY(upload_connect_ms_p50),
+                      APP_METRIC_KEY(upload_connect_ms_p95));
+  prv_set_percentiles(&handshake_ms, APP_METRIC_KEY(upload_handshake_ms_p50),
+                      APP_METRIC_KEY(upload_handshake_ms_p95));
+  prv_set_percentiles(&transfer_ms, APP_METRIC_KEY(upload_transfer_ms_p50),
+                      APP_METRIC_KEY(upload_transfer_ms_p95));
+  APP_METRIC_SET(upload_sent_age_max_ms, max_sent_age_ms);
+  APP_METRIC_SET(upload_pending_age_ms, prv_ms_since(s_empty_since));
+  if (s_stats.last_handshake_ms != 0) {
+    APP_METRIC_SET(tls_handshake_ms, s_stats.last_handshake_ms);
+    APP_METRIC_SET(tls_handshake_heap_bytes, s_stats.last_handshake_heap_bytes);
+  }
+  if (s_stats.last_bytes_per_s != 0) {
+    APP_METRIC_SET(upload_bytes_per_s, s_stats.last_bytes_per_s);
+  }
+}
+
+static void prv_print_latency(const char *name, const sAppHistogram *histogram) {
+  if (histogram->count == 0) {
+    MEMFAULT_LOG_INFO("%-10s %6u", name, 0u);
+    return;
+  }
+  MEMFAULT_LOG_INFO("%-10s %6" PRIu32 " %7" PRIu32 " %7" PRIu32 " %7" PRIu32 " %7" PRIu32
+                    " %7" PRIu32,
+                    name, histogram->count, histogram->min,
+                    app_histogram_percentile(histogram, 500),
+                    app_histogram_percentile(histogram, 950), histogram->max,
+                    app_histogram_mean(histogram));
+}
+
+static void prv_print_pipeline(const sAppUploadStats *stats) {
+  MEMFAULT_LOG_INFO("Failures by reason:");
+  for (eAppUploadFailure reason = 0; reason < kAppUploadFailure_NumReasons; reason++) {
+    MEMFAULT_LOG_INFO("  %-12s %6" PRIu32, s_failure_names[reason],
+                      stats->failure_counts[reason]);
+  }
+  MEMFAULT_LOG_INFO("Oldest pending data: %" PRIu32 " ms, at most %" PRIu32 " ms when posted",
+                    prv_ms_since(s_empty_since), stats->max_sent_age_ms);
+  if (!APP_UPLOAD_ZERO_COPY) {
+    return;
+  }
+
+  // Written by the HTTP task, a post in progress can skew one sample of the copy
+  const sAppUploadLatency latency = s_latency;
+  MEMFAULT_LOG_INFO("%-10s %6s %7s %7s %7s %7s %7s", "Latency ms", "Count", "Min", "p50", "p95",
+                    "Max", "Mean");
+  prv_print_latency("connect", &latency.connect_ms);
+  prv_print_latency("handshake", &latency.handshake_ms);
+  prv_print_latency("transfer", &latency.transfer_ms);
+  const uint32_t mean_bytes_per_s = (uint32_t)(((uint64_t)stats->socket_bytes * 1000) /
+                                               MEMFAULT_MAX(stats->transfer_ms, 1));
+  MEMFAULT_LOG_INFO("Throughput: %" PRIu32 " bytes/s mean over transfers", mean_bytes_per_s);
+}
+
+int app_upload_cli_cmd(int argc, char *argv[]) {
+  const sAppUploadStats stats = s_stats;
+
+  MEMFAULT_LOG_INFO("Mode: %s", APP_UPLOAD_ZERO_COPY ? "zero-copy" : "port HTTP client");
+  MEMFAULT_LOG_INFO("Posts: %" PRIu32 " (%" PRIu32 " failed)", stats.posts, stats.failures);
+  prv_print_pipeline(&stats);
+  if (!APP_UPLOAD_ZERO_COPY) {
+    return 0;
+  }
+
+  MEMFAULT_LOG_INFO("Bytes sent: %" PRIu32 " (%" PRIu32 " chunk data)", stats.socket_bytes,
+                    stats.body_bytes);
+  MEMFAULT_LOG_INFO("TLS records: %" PRIu32 " of up to %u bytes, avg %" PRIu32 " bytes",
+                    stats.records, (unsigned int)APP_UPLOAD_RECORD_PAYLOAD_SIZE,
+                    stats.socket_bytes / MEMFAULT_MAX(stats.records, 1));
+  MEMFAULT_LOG_INFO("TLS framing overhead: %" PRIu32 " bytes",
+                    stats.records * APP_UPLOAD_TLS_RECORD_OVERHEAD);
+  // Each byte is also copied by mbedTLS into its output buffer and by lwIP into a pbuf
+  const uint32_t copies_permille = (uint32_t)(((uint64_t)stats.copied_bytes * 1000) /
+                                              MEMFAULT_MAX(stats.socket_bytes, 1));
+  MEMFAULT_LOG_INFO("Copies per byte: %" PRIu32 ".%03" PRIu32 " in app + 2 in TLS/TCP stack",
+                    copies_permille / 1000, copies_permille % 1000);
+  sAppDnsCacheStats dns_stats;
+  app_dns_cache_get_stats(&dns_stats);
+  MEMFAULT_LOG_INFO("DNS: %" PRIu32 " cached, %" PRIu32 " resolved (avg %" PRIu32
+                    " ms), %" PRIu32 " dropped, %" PRIu32 " ms saved",
+                    dns_stats.hits, dns_stats.resolves, dns_stats.mean_resolve_ms,
+                    dns_stats.invalidations, dns_stats.saved_ms);
+  MEMFAULT_LOG_INFO("TLS handshake: %" PRIu32 " ms, %" PRIu32 " bytes of heap (%s profile)",
+                    stats.last_handshake_ms, stats.last_handshake_heap_bytes,
+                    APP_TLS_LOW_MEMORY ? "low-memory" : "default");
+  MEMFAULT_LOG_INFO("Last post: connect %" PRIu32 " ms, transfer %" PRIu32 " ms, %" PRIu32
+                    " bytes/s",
+                    stats.last_connect_ms, stats.last_transfer_ms, stats.last_bytes_per_s);
+
+  sAppHeapStats heap_stats;
+  app_heap_stats_get(&heap_stats);
+  MEMFAULT_LOG_INFO("RAM: record buffer %u bytes, min free stack %" PRIu32
+                    " words, heap peak %" PRIu32 " bytes",
+                    (unsigned int)sizeof(s_record), stats.min_stack_free_words,
+                    heap_stats.peak_bytes);
+  return 0;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+//! @file
+//!
+//! @brief
+//! Chunk upload to Memfault over a TLS socket
+//!
+//! The port's HTTP client reads the packetizer into a 128 byte stack buffer and sends every
+//! buffer as its own TLS record and TCP segment. This client instead lets the packetizer write
+//! straight into a static record buffer, which also takes the HTTP request header, and sends it
+//! once full. The buffer is sized so that one TLS record plus its framing fills a whole number of
+//! TCP segments.
+//!
+//! mbedTLS still copies each record into its output buffer to encrypt it, and lwIP copies the
+//! ciphertext into pbufs: cy_secure_sockets has no API to hand either of them a buffer.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//! 1 to upload with this client, 0 to use the port's memfault_http_client_post_chunk()
+#ifndef APP_UPLOAD_ZERO_COPY
+  #define APP_UPLOAD_ZERO_COPY 1
+#endif
+
+//! TCP_MSS of the lwIP configuration
+#ifndef APP_UPLOAD_TCP_MSS
+  #define APP_UPLOAD_TCP_MSS (1460)
+#endif
+
+//! Bytes a TLS record adds to its payload: 5 byte header, 8 byte explicit nonce and 16 byte tag
+//! for the AES-GCM suites Memfault negotiates
+#ifndef APP_UPLOAD_TLS_RECORD_OVERHEAD
+  #define APP_UPLOAD_TLS_RECORD_OVERHEAD (29)
+#endif
+
+//! TCP segments filled by one TLS record
+#ifndef APP_UPLOAD_SEGMENTS_PER_RECORD
+  #define APP_UPLOAD_SEGMENTS_PER_RECORD (1)
+#endif
+
+//! Maximum fragment length requested from the server, 0 to not request one. One of 512, 1024,
+//! 2048 or 4096 and at least APP_UPLOAD_RECORD_PAYLOAD_SIZE. If the server accepts, mbedTLS
+//! shrinks its input buffer to this size after the handshake, see configs/mbedtls_app_config.h.
+#ifndef APP_UPLOAD_TLS_MFL
+  #define APP_UPLOAD_TLS_MFL (2048)
+#endif
+
+#define APP_UPLOAD_RECORD_PAYLOAD_SIZE \
+  ((APP_UPLOAD_TCP_MSS * APP_UPLOAD_SEGMENTS_PER_RECORD) - APP_UPLOAD_TLS_RECORD_OVERHEAD)
+
+//! Reasons a post fails, counted in `upload_stats` and the upload_fail_<reason>_count metrics.
+//! other is a failure of the port's client, which doesn't report a reason.
+#define APP_UPLOAD_FAILURES(X) \
+  X(dns)                       \
+  X(socket)                    \
+  X(connect)                   \
+  X(send)                      \
+  X(no_response)               \
+  X(rejected)                  \
+  X(other)
+
+//! Registers the upload byte sampler probe
+void app_upload_init(void);
+
+//! Posts the next chunk message
+//!
+//! @return 0 on success, 1 if there was no data to send, < 0 on error. Same as
+//! memfault_http_client_post_chunk().
+int app_upload_post_chunk(void);
+
+//! Holds off chunk posts so another task can use the packetizer, e.g. `bench`. Waits up to
+//! timeout_ms for a post in progress to finish.
+//!
+//! @return false if the post didn't finish in time, posts are not held off then
+bool app_upload_pause(uint32_t timeout_ms);
+
+//! Lets chunk posts continue after a successful app_upload_pause()
+void app_upload_resume(void);
+
+//! Called by the HTTP task after each upload cycle, with all data sources active. Notes when
+//! nothing was left to post, the reference for the age of pending data.
+void app_upload_cycle_done(void);
+
+//! Records upload volume, latency percentiles, failures by reason and pending data age in the
+//! heartbeat
+void app_upload_collect_metrics(void);
+
+//! Shell command which prints upload latency histograms, failures by reason, the age of pending
+//! data, throughput, record and copy counts, TLS handshake cost and RAM use
+int app_upload_cli_cmd(int argc, char *argv[]);
@@ -42,23 +42,45 @@
 /* Header file includes */
 #include "cy_log.h"
 #include "cy_retarget_io.h"
+#include "cy_serial_flash_qspi.h"
 #include "cybsp.h"
+#include "cycfg_qspi_memslot.h"
 #include "cyhal.h"
 
 /* FreeRTOS header file */
 #include <FreeRTOS.h>
 #include <task.h>
 
+#include "app_alloc_trace.h"
+#include "app_boot_profile.h"
+#include "app_config.h"
+#include "app_coredump.h"
+#include "app_coredump_storage.h"
 #include "app_kvstore.h"
+#include "app_log.h"
+#include "app_memmap.h"
+#include "app_metrics.h"
+#include "app_pool.h"
+#include "app_sampler.h"
+#include "app_supervisor.h"
+#include "app_trace.h"
+#include "app_upload.h"
 #include "memfault/components.h"
 #include "memfault_example_app.h"
 
 int main(void) {
   cy_rslt_t result;
 
+  /* Zero the static RTOS object storage, the startup code leaves it out */
+  app_memmap_init();
+
+  /* Time each boot phase, see the boot_profile shell command */
+  app_boot_profile_start();
+
   /* Initialize the board support package */
   result = cybsp_init();
   CY_ASSERT(result == CY_RSLT_SUCCESS);
+  app_boot_profile_mark(kAppBootPhase_Bsp);
 
   /* To avoid compiler warnings. */
   (void)result;
@@ -66,32 +88,57 @@ int main(void) {
   /* Enable global interrupts */
   __enable_irq();
 
+  /* Set up the TLS/network buffer pools before anything allocates from them */
+  app_pool_init();
+
   /* Initialize retarget-io to use the debug UART port */
   cy_retarget_io_init(CYBSP_DEBUG_UART_TX, CYBSP_DEBUG_UART_RX, CY_RETARGET_IO_BAUDRATE);
 
   /* Initialize the User LED. */
   cyhal_gpio_init(CYBSP_USER_LED, CYHAL_GPIO_DIR_OUTPUT, CYHAL_GPIO_DRIVE_STRONG,
                   CYBSP_LED_STATE_OFF);
+  app_boot_profile_mark(kAppBootPhase_RetargetIo);
 
-#if defined(TARGET_CY8CPROTO_062S3_4343W)
+  /* The external QSPI flash holds coredumps, nothing is placed in its XIP region */
   const uint32_t bus_frequency = 50000000lu;
 
-  cy_serial_flash_qspi_init(smifMemConfigs[0], CYBSP_QSPI_D0, CYBSP_QSPI_D1, CYBSP_QSPI_D2,
-                            CYBSP_QSPI_D3, NC, NC, NC, NC, CYBSP_QSPI_SCK, CYBSP_QSPI_SS,
-                            bus_frequency);
+  const cy_rslt_t qspi_result =
+    cy_serial_flash_qspi_init(smifMemConfigs[0], CYBSP_QSPI_D0, CYBSP_QSPI_D1, CYBSP_QSPI_D2,
+                              CYBSP_QSPI_D3, NC, NC, NC, NC, CYBSP_QSPI_SCK, CYBSP_QSPI_SS,
+                              bus_frequency);
 
-  cy_serial_flash_qspi_enable_xip(true);
+#if defined(TARGET_CY8CPROTO_062S3_4343W)
+  if (qspi_result == CY_RSLT_SUCCESS) {
+    cy_serial_flash_qspi_enable_xip(true);
+  }
 #endif
+  app_boot_profile_mark(kAppBootPhase_Qspi);
 
   /* Enable logging */
   result = cy_log_init(CY_LOG_INFO, NULL, NULL);
+  app_boot_profile_mark(kAppBootPhase_Log);
   app_kvstore_init();
+  /* Runtime config is read by the tasks created below */
+  app_config_init();
+  app_boot_profile_mark(kAppBootPhase_KvStore);
 
   /* Initialize Memfault */
   memfault_platform_init_serial_number();
+  /* Coredump storage must be ready before memfault_platform_boot() checks it for a coredump */
+  app_coredump_storage_init(qspi_result == CY_RSLT_SUCCESS);
+  app_coredump_register_region(app_alloc_trace_get(), sizeof(sAppAllocTrace));
   memfault_platform_boot();
+  app_trace_boot();
+  app_coredump_boot();
+  app_log_init();
+  app_boot_profile_mark(kAppBootPhase_MemfaultBoot);
   memfault_cli_task_start();
   memfault_http_task_start();
+  app_sampler_init();
+  app_upload_init();
+  app_supervisor_init();
+  app_metrics_init();
+  app_boot_profile_mark(kAppBootPhase_TasksCreated);
 
   /* Start the FreeRTOS scheduler */
   vTaskStartScheduler();
@@ -9,7 +9,23 @@
 #include <task.h>
 
 #include "ap.h"
+#include "app_bench.h"
+#include "app_boot_profile.h"
+#include "app_config.h"
+#include "app_coredump.h"
+#include "app_drain.h"
+#include "app_heap_stats.h"
+#include "app_impair.h"
 #include "app_kvstore.h"
+#include "app_log.h"
+#include "app_memmap.h"
+#include "app_metrics.h"
+#include "app_pool.h"
+#include "app_roam.h"
+#include "app_sampler.h"
+#include "app_supervisor.h"
+#include "app_trace.h"
+#include "app_upload.h"
 #include "cy_retarget_io.h"
 #include "cyhal.h"
 #include "cyhal_gpio.h"
@@ -17,22 +33,43 @@
 #include "memfault_example_app.h"
 
 #define MEMFAULT_CLI_TASK_SIZE (1024)
-#define MEMFAULT_CLI_TASK_PRIORITY (1)
-#define MAX_WIFI_CONN_RETRIES (5u)
 
 // Helper functions to drive wifi commands
 static int prv_join_wifi_cmd(int argc, char *argv[]);
 static int prv_save_wifi_cmd(int argc, char *argv[]);
 static int prv_scan_wifi_cmd(int argc, char *argv[]);
 
+static TaskHandle_t s_cli_task;
+static StackType_t s_cli_task_stack[MEMFAULT_CLI_TASK_SIZE] APP_STATIC(cli);
+static StaticTask_t s_cli_task_tcb APP_STATIC(cli);
+
 static const sMemfaultShellCommand s_memfault_shell_commands[] = {
+  {"bench", app_bench_cli_cmd, "Hot path cycles per op vs baselines: [case|baseline] [iter]"},
+  {"boot_profile", app_boot_profile_cli_cmd, "Time spent in each boot phase and crash recovery"},
   {"clear_core", memfault_demo_cli_cmd_clear_core, "Clear an existing coredump"},
+  {"config", app_config_cli_cmd, "List or change runtime config: [get <k>|set <k> <v>|reset <k>]"},
+  {"coredump_stats", app_coredump_cli_cmd,
+   "Coredump capture time and size per mode: [full|selective]"},
   {"drain_chunks", memfault_demo_drain_chunk_data,
    "Flushes queued Memfault data. To upload data see https://mflt.io/posting-chunks-with-gdb"},
+  {"drain_stats", app_drain_cli_cmd, "Chunk messages posted per data class, in upload priority"},
   {"export", memfault_demo_cli_cmd_export,
    "Export base64-encoded chunks. To upload data see https://mflt.io/chunk-data-export"},
   {"get_core", memfault_demo_cli_cmd_get_core, "Get coredump info"},
   {"get_device_info", memfault_demo_cli_cmd_get_device_info, "Get device info"},
+  {"heap_stats", app_heap_stats_cli_cmd, "Dump heap usage, fragmentation and allocation sizes"},
+  {"impair", app_impair_cli_cmd, "Run uploads under emulated loss, RTT and resets: [scenario]"},
+  {"log_bench", app_log_bench_cli_cmd, "Compare deferred vs formatted logging cost: [iterations]"},
+  {"log_storm", app_log_storm_cli_cmd, "Log buffer bytes of a retry storm, deduplicated or not"},
+  {"memmap", app_memmap_cli_cmd, "Static and heap RAM per subsystem, TLS heap headroom"},
+  {"metrics_stats", app_metrics_cli_cmd, "Compact metric frames and bytes per heartbeat: [keys]"},
+  {"pool_stats", app_pool_cli_cmd, "Dump TLS/network pool allocator occupancy"},
+  {"pool_soak", app_pool_soak_cli_cmd, "Compare pool vs heap allocation latency: [iterations]"},
+  {"roam", app_roam_cli_cmd, "AP link quality, background scans and roams: [scan]"},
+  {"sampler", app_sampler_cli_cmd, "Sampled probe aggregates this heartbeat: [bench]"},
+  {"supervisor", app_supervisor_cli_cmd, "Check-in gaps and stalls of supervised tasks"},
+  {"trace_stats", app_trace_cli_cmd, "Per-reason trace event counts and rate limiting"},
+  {"upload_stats", app_upload_cli_cmd, "Chunk upload throughput, TLS records, copies and RAM"},
 
   //
   // Test commands for validating SDK functionality: https://mflt.io/mcu-test-commands
@@ -70,7 +107,7 @@ static int prv_join_wifi_cmd(int argc, char *argv[]) {
     return -1;
   }
 
-  return connect_to_wifi_ap(argv[1], argv[2], argv[3], MAX_WIFI_CONN_RETRIES);
+  return connect_to_wifi_ap(argv[1], argv[2], argv[3], APP_CONFIG_GET(wifi_join_retries));
 }
 
 // Scans for available WiFi networks
@@ -149,6 +186,7 @@ void memfault_cli_task(void *arg) {
   memfault_demo_shell_boot(&impl);
 
   while (1) {
+    app_supervisor_checkin(kAppSupervisorTask_Cli);
     prv_check_user_buttons();
     uint32_t num_bytes = cyhal_uart_readable(&cy_retarget_io_uart_obj);
     if (num_bytes < 1) {
@@ -162,7 +200,7 @@ void memfault_cli_task(void *arg) {
     const uint32_t uart_input_timeout_ms = 1;
     cy_rslt_t result = cyhal_uart_getc(&cy_retarget_io_uart_obj, &rx_byte, uart_input_timeout_ms);
     if (result != CY_RSLT_SUCCESS) {
-      MEMFAULT_LOG_ERROR("Unexpected UART read error: 0x%x", (int)result);
+      APP_LOG_ERROR("Unexpected UART read error: 0x%x", (int)result);
       continue;
     }
 
@@ -170,9 +208,15 @@ void memfault_cli_task(void *arg) {
   }
 }
 
+static void prv_priority_changed(eAppConfigKey key) {
+  vTaskPrioritySet(s_cli_task, APP_CONFIG_GET(cli_task_priority));
+}
+
 void memfault_cli_task_start(void) {
   prv_init_user_buttons();
 
-  xTaskCreate(memfault_cli_task, "MFLT CLI", MEMFAULT_CLI_TASK_SIZE, NULL,
-              MEMFAULT_CLI_TASK_PRIORITY, NULL);
+  s_cli_task = xTaskCreateStatic(memfault_cli_task, "MFLT CLI", MEMFAULT_CLI_TASK_SIZE, NULL,
+                                 APP_CONFIG_GET(cli_task_priority), s_cli_task_stack,
+                                 &s_cli_task_tcb);
+  app_config_register_callback(kAppConfigKey_cli_task_priority, prv_priority_changed);
 }
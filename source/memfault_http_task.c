@@ -44,6 +44,7 @@
 #include <FreeRTOS.h>
 #include <task.h>
 #include <semphr.h>
+#include <event_groups.h>
 
 /* Standard C header file. */
 #include <string.h>
@@ -51,6 +52,7 @@
 /* Cypress secure socket header file. */
 #include "cy_secure_sockets.h"
 #include "cy_tls.h"
+#include "mbedtls/platform_util.h"
 
 /* Wi-Fi connection manager header files. */
 #include "cy_wcm.h"
@@ -63,13 +65,23 @@
 #include <inttypes.h>
 
 #include "ap.h"
+#include "app_backoff.h"
+#include "app_boot_profile.h"
+#include "app_config.h"
+#include "app_drain.h"
+#include "app_impair.h"
 #include "app_kvstore.h"
+#include "app_log.h"
+#include "app_memmap.h"
+#include "app_roam.h"
+#include "app_supervisor.h"
+#include "app_trace.h"
+#include "app_upload.h"
 #include "memfault/components.h"
 #include "memfault_psoc6_port.h"
 
-#if !defined(MEMFAULT_POST_SEND_INTERVAL_MS)
-  #define MEMFAULT_POST_SEND_INTERVAL_MS              (60 * 1000)
-#endif
+//! Longest sleep between supervisor check-ins, see app_supervisor.h, and between RSSI readings
+#define MEMFAULT_WAIT_SLICE_MS (10 * 1000)
 
 #if !defined(WIFI_SSID)
   #define WIFI_SSID ""
@@ -84,7 +96,31 @@
 #endif
 
 #define MEMFAULT_HTTP_TASK_SIZE (5 * 1024)
-#define MEMFAULT_HTTP_TASK_PRIORITY (1)
+
+// Words. Parsing the root certificates and a log line are the deepest calls, each well under
+// 2 KB. The task logs its high-water mark when it exits; lower this to that plus a margin, stack
+// overflow checking (configCHECK_FOR_STACK_OVERFLOW) catches a size that turns out too small.
+#define MEMFAULT_NET_INIT_TASK_SIZE (1024)
+
+//! Boot stages, set in s_boot_stages as they complete. Each stage only waits for the stages it
+//! depends on:
+//!
+//!   runtime config read from the kv-store (before the scheduler starts)
+//!     -> WCM init -> Wi-Fi auto-connect (HTTP task)   -> first upload
+//!                 -> socket init -> root CA load (net init task) ^
+#define BOOT_STAGE_WCM_READY (1 << 0)
+#define BOOT_STAGE_TLS_READY (1 << 1)
+
+static EventGroupHandle_t s_boot_stages;
+static StaticEventGroup_t s_boot_stages_storage APP_STATIC(http);
+static TaskHandle_t s_http_task;
+static StackType_t s_http_task_stack[MEMFAULT_HTTP_TASK_SIZE] APP_STATIC(http);
+static StaticTask_t s_http_task_tcb APP_STATIC(http);
+// The net init task exits once done, but its stack stays reserved for the whole uptime: 4 KB of
+// RAM, reported as the net subsystem by `memmap`. A heap stack would leave a hole between the
+// Wi-Fi and TLS allocations made meanwhile, so keep it small instead.
+static StackType_t s_net_init_task_stack[MEMFAULT_NET_INIT_TASK_SIZE] APP_STATIC(net);
+static StaticTask_t s_net_init_task_tcb APP_STATIC(net);
 
 //! Helper function to load saved WiFi AP config from the app kv-store
 static bool load_saved_wifi_config(char *ssid, char *auth_type, char *password) {
@@ -112,42 +148,86 @@ static bool load_saved_wifi_config(char *ssid, char *auth_type, char *password)
 //! 2. Use config in compile-time definitions
 //! 3. Skip auto connect
 static void prv_auto_connect_to_ap(void) {
-  // Attempt to connect to a saved wifi configuration
+  // Read for each attempt and cleared after, so the password isn't kept in RAM that every
+  // coredump captures
   char ssid[MEMFAULT_WIFI_CONFIG_MAX_SIZE] = {0};
   char auth_type[MEMFAULT_WIFI_CONFIG_MAX_SIZE] = {0};
   char password[MEMFAULT_WIFI_CONFIG_MAX_SIZE] = {0};
 
   if (load_saved_wifi_config(ssid, auth_type, password)) {
-    if (connect_to_wifi_ap(ssid, auth_type, password, 2) != CY_RSLT_SUCCESS) {
-      MEMFAULT_LOG_ERROR("Failed to connect to Wi-Fi AP w/ saved config");
+    const cy_rslt_t rv =
+      connect_to_wifi_ap(ssid, auth_type, password, APP_CONFIG_GET(wifi_boot_retries));
+    mbedtls_platform_zeroize(password, sizeof(password));
+    if (rv != CY_RSLT_SUCCESS) {
+      APP_LOG_ERROR("Failed to connect to Wi-Fi AP w/ saved config");
     }
   } else if (strlen(WIFI_SSID) > 0 &&
              strlen(WIFI_AUTH_TYPE) > 0 &&
              strlen(WIFI_PASSWORD) > 0) {
-    if (connect_to_wifi_ap(WIFI_SSID, WIFI_AUTH_TYPE, WIFI_PASSWORD, 2) != CY_RSLT_SUCCESS) {
-      MEMFAULT_LOG_ERROR("Failed to connect to Wi-Fi AP w/ compile-time config");
+    if (connect_to_wifi_ap(WIFI_SSID, WIFI_AUTH_TYPE, WIFI_PASSWORD,
+                           APP_CONFIG_GET(wifi_boot_retries)) != CY_RSLT_SUCCESS) {
+      APP_LOG_ERROR("Failed to connect to Wi-Fi AP w/ compile-time config");
     }
   } else {
-    MEMFAULT_LOG_DEBUG("No saved wifi configuration found");
+    APP_LOG_DEBUG("No saved wifi configuration found");
+  }
+}
+
+//! Initializes the socket and TLS cert components while the HTTP task associates with the AP
+//!
+//! Neither depends on the Wi-Fi connection. They are only started once WCM has brought up the
+//! network stack.
+static void prv_net_init_task(void *arg) {
+  xEventGroupWaitBits(s_boot_stages, BOOT_STAGE_WCM_READY, pdFALSE, pdTRUE, portMAX_DELAY);
+  const uint32_t heap_begin = app_memmap_heap_begin();
+
+  //! initialize secure socket library
+  cy_rslt_t result = cy_socket_init();
+  if (result != CY_RSLT_SUCCESS) {
+    APP_LOG_ERROR("Secure Socket initialization failed!");
+    CY_ASSERT(0);
+  }
+  APP_LOG_INFO("Secure Socket initialized");
+  app_boot_profile_mark(kAppBootPhase_SocketInit);
+
+  //! Load root certificates necessary for talking to Memfault servers
+  result = cy_tls_load_global_root_ca_certificates(MEMFAULT_ROOT_CERTS_PEM, sizeof(MEMFAULT_ROOT_CERTS_PEM) - 1);
+  if (result != CY_RSLT_SUCCESS) {
+    APP_LOG_ERROR("cy_tls_load_global_root_ca_certificates failed! rv=0x%x", (int)result);
+  } else {
+    APP_LOG_INFO("Global trusted RootCA certificate loaded");
+    app_boot_profile_mark(kAppBootPhase_CaLoaded);
   }
+  app_memmap_heap_end(kAppMemmap_net, heap_begin);
+  APP_LOG_INFO("Net init stack: %u of %u words used",
+               (unsigned int)(MEMFAULT_NET_INIT_TASK_SIZE - uxTaskGetStackHighWaterMark(NULL)),
+               (unsigned int)MEMFAULT_NET_INIT_TASK_SIZE);
+
+  xEventGroupSetBits(s_boot_stages, BOOT_STAGE_TLS_READY);
+  vTaskDelete(NULL);
 }
 
 //! Helper function to perform initialization of WCM and related components
 //!
 //! After initializing WCM, function then:
-//! * Attempts auto-connection
-//! * Initializes socket and TLS cert components
-static cy_rslt_t boot_wifi_subsystem(void) {
+//! * Releases the net init task, which initializes socket and TLS cert components
+//! * Attempts auto-connection in parallel
+//! * Waits for the net init task to finish
+static void boot_wifi_subsystem(void) {
   cy_wcm_config_t wifi_config = {
     .interface = CY_WCM_INTERFACE_TYPE_STA
   };
 
+  const uint32_t heap_begin = app_memmap_heap_begin();
   cy_rslt_t result = cy_wcm_init(&wifi_config);
   if (result != CY_RSLT_SUCCESS) {
-    MEMFAULT_LOG_ERROR("Wi-Fi Connection Manager initialization failed! rv=0x%x", (int)result);
+    APP_LOG_ERROR("Wi-Fi Connection Manager initialization failed! rv=0x%x", (int)result);
     CY_ASSERT(0);
   }
-  MEMFAULT_LOG_INFO("Wi-Fi Connection Manager initialized.");
+  APP_LOG_INFO("Wi-Fi Connection Manager initialized.");
+  app_memmap_heap_end(kAppMemmap_wifi, heap_begin);
+  app_boot_profile_mark(kAppBootPhase_WcmInit);
+  xEventGroupSetBits(s_boot_stages, BOOT_STAGE_WCM_READY);
 
   // Note: Must be called after cy_wcm_init()
 
@@ -156,37 +236,102 @@ static cy_rslt_t boot_wifi_subsystem(void) {
 #endif  // MEMFAULT_PORT_WIFI_TRACKING_ENABLED
 
   prv_auto_connect_to_ap();
-
-  //! initialize secure socket library
-  result = cy_socket_init();
-  if (result != CY_RSLT_SUCCESS) {
-    MEMFAULT_LOG_ERROR("Secure Socket initialization failed!");
-    CY_ASSERT(0);
+  if (cy_wcm_is_connected_to_ap()) {
+    app_boot_profile_mark(kAppBootPhase_WifiConnected);
   }
-  MEMFAULT_LOG_INFO("Secure Socket initialized");
 
-  //! Load root certificates necessary for talking to Memfault servers
-  result = cy_tls_load_global_root_ca_certificates(MEMFAULT_ROOT_CERTS_PEM, sizeof(MEMFAULT_ROOT_CERTS_PEM) - 1);
-  if (result != CY_RSLT_SUCCESS) {
-    MEMFAULT_LOG_ERROR("cy_tls_load_global_root_ca_certificates failed! rv=0x%x", (int)result);
-  } else {
-    MEMFAULT_LOG_INFO("Global trusted RootCA certificate loaded");
+  xEventGroupWaitBits(s_boot_stages, BOOT_STAGE_TLS_READY, pdFALSE, pdTRUE, portMAX_DELAY);
+  app_memmap_boot_report();
+}
+
+//! Posts queued data in priority order and records when the first upload, and the first
+//! coredump upload after a crash, went through
+//!
+//! @param[out] coredump_pending Set if a coredump is still waiting for upload
+//! @return app_drain_run() result
+static int prv_post_chunks(bool *coredump_pending) {
+  const bool had_coredump = memfault_coredump_has_valid_coredump(NULL);
+  // Save the repeat count of a pending duplicate log before logs are posted
+  app_log_dedup_flush();
+  const int rv = app_drain_run();
+  app_upload_cycle_done();
+  app_impair_cycle_done(rv);
+  if (rv < 0) {
+    APP_TRACE_EVENT(UploadFailure, rv);
+  }
+  if (rv == 0) {
+    app_boot_profile_mark(kAppBootPhase_FirstUpload);
+  }
+  *coredump_pending = had_coredump && memfault_coredump_has_valid_coredump(NULL);
+  if (had_coredump && !*coredump_pending) {
+    app_boot_profile_mark(kAppBootPhase_CoredumpAccepted);
   }
+  return rv;
+}
 
-  return result;
+//! Sleeps, checking in with the supervisor so long backoff delays don't count as a stall, and
+//! reading the RSSI for the sampler
+static void prv_wait_ms(uint32_t delay_ms) {
+  while (delay_ms > 0) {
+    const uint32_t slice_ms = MEMFAULT_MIN(delay_ms, MEMFAULT_WAIT_SLICE_MS);
+    vTaskDelay(pdMS_TO_TICKS(slice_ms));
+    app_roam_read_rssi();
+    app_supervisor_checkin(kAppSupervisorTask_Http);
+    delay_ms -= slice_ms;
+  }
 }
 
 void memfault_http_task(void *arg) {
+  app_boot_profile_mark(kAppBootPhase_HttpTaskStart);
   boot_wifi_subsystem();
+  app_supervisor_checkin(kAppSupervisorTask_Http);
+
+  // Spread the first post of devices that were power cycled together, unless a coredump waits
+  if (!memfault_coredump_has_valid_coredump(NULL)) {
+    prv_wait_ms(app_backoff_startup_delay_ms());
+  }
 
+  sAppBackoff backoff = { 0 };
   while (1) {
-    // Periodically attempt to post data
-    memfault_http_client_post_chunk();
-    vTaskDelay(pdMS_TO_TICKS(MEMFAULT_POST_SEND_INTERVAL_MS));
+    // Periodically attempt to post data, backing off after failures. After a crash, retry
+    // quickly until the coredump is accepted, reconnecting if the boot auto-connect failed.
+    bool coredump_pending;
+    const int rv = prv_post_chunks(&coredump_pending);
+    app_supervisor_checkin(kAppSupervisorTask_Http);
+
+    uint32_t delay_ms = (rv < 0) ?
+      app_backoff_next_failure_delay_ms(&backoff) :
+      app_backoff_next_success_delay_ms(&backoff, APP_CONFIG_GET(post_interval_ms));
+    if (coredump_pending) {
+      delay_ms = MEMFAULT_MIN(delay_ms, APP_CONFIG_GET(crash_retry_interval_ms));
+    }
+    // An impairment run measures the time to drain, so keep posting while posts go through
+    if ((rv == 0) && app_impair_run_active()) {
+      delay_ms = 0;
+    }
+    // Roam before the wait, so the next cycle posts over the stronger AP
+    app_roam_check();
+    app_supervisor_checkin(kAppSupervisorTask_Http);
+    prv_wait_ms(delay_ms);
+
+    if (coredump_pending && !cy_wcm_is_connected_to_ap()) {
+      prv_auto_connect_to_ap();
+    }
   }
 }
 
+static void prv_priority_changed(eAppConfigKey key) {
+  vTaskPrioritySet(s_http_task, APP_CONFIG_GET(http_task_priority));
+}
+
 void memfault_http_task_start(void) {
-  xTaskCreate(memfault_http_task, "MFLT CLI", MEMFAULT_HTTP_TASK_SIZE,
-              NULL, MEMFAULT_HTTP_TASK_PRIORITY, NULL);
+  s_boot_stages = xEventGroupCreateStatic(&s_boot_stages_storage);
+  app_roam_init();
+  s_http_task = xTaskCreateStatic(memfault_http_task, "MFLT HTTP", MEMFAULT_HTTP_TASK_SIZE, NULL,
+                                  APP_CONFIG_GET(http_task_priority), s_http_task_stack,
+                                  &s_http_task_tcb);
+  xTaskCreateStatic(prv_net_init_task, "Net Init", MEMFAULT_NET_INIT_TASK_SIZE, NULL,
+                    APP_CONFIG_GET(http_task_priority), s_net_init_task_stack,
+                    &s_net_init_task_tcb);
+  app_config_register_callback(kAppConfigKey_http_task_priority, prv_priority_changed);
 }
@@ -9,6 +9,18 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#include "app_boot_profile.h"
+#include "app_coredump.h"
+#include "app_dns_cache.h"
+#include "app_heap_stats.h"
+#include "app_log.h"
+#include "app_metrics.h"
+#include "app_pool.h"
+#include "app_roam.h"
+#include "app_sampler.h"
+#include "app_supervisor.h"
+#include "app_trace.h"
+#include "app_upload.h"
 #include "cy_device_headers.h"
 #include "cy_syslib.h"
 #include "memfault/components.h"
@@ -50,3 +62,19 @@ void memfault_platform_get_device_info(sMemfaultDeviceInfo *info) {
     .hardware_version = "dvt1",
   };
 }
+
+void memfault_metrics_heartbeat_collect_data(void) {
+  app_heap_stats_collect_metrics();
+  app_pool_collect_metrics();
+  app_coredump_collect_metrics();
+  app_boot_profile_collect_metrics();
+  app_trace_collect_metrics();
+  app_log_collect_metrics();
+  app_sampler_collect_metrics();
+  app_upload_collect_metrics();
+  app_dns_cache_collect_metrics();
+  app_roam_collect_metrics();
+  app_supervisor_collect_metrics();
+  // Last, it encodes what the others set
+  app_metrics_collect();
+}